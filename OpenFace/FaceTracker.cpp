@@ -0,0 +1,962 @@
+#include "stdafx.h"
+#include "FaceTracker.h"
+#include "Signature.h"
+#include "resource.h"
+#include "include/LandmarkDetectorModel.h"
+#include "include/GazeEstimation.h"
+#include <opencv2/imgproc.hpp>
+
+using namespace Eyw;
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block Signature.
+/// </summary>
+Eyw::block_class_registrant g_FaceTracker(
+	Eyw::block_class_registrant::block_id( "FaceTracker" )
+		.begin_language( EYW_LANGUAGE_US_ENGLISH )
+			.name( "Face tracker" )
+			.description( "This block fits the face model once per frame and outputs the landmarks, the eye landmarks, the head pose and the gaze of a single face, computing only the connected outputs."	)
+			.libraries( "MyLibrary" )
+			.bitmap( IDB_LANDMARKSDETECTOR_BITMAP )
+		.end_language()
+		.begin_authors()
+			.author( EYW_OPENFACE_CATALOG_AUTHOR_ID )
+		.end_authors()
+		.begin_companies()
+			.company( EYW_OPENFACE_COMPANY_ID )
+		.end_companies()
+		.begin_licences()
+			.licence( EYW_OPENFACE_LICENSE_ID )
+		.end_licences()
+		.default_factory< CFaceTracker >()
+	);
+
+//////////////////////////////////////////////////////////
+// Identifiers
+#define PAR_MODEL_LOCATION "model_locationPin"
+
+#define PAR_LIMIT_POSE "limit_posePin" //bool
+#define PAR_REFINE_HIERARCHICAL "refine_hierarchicalPin" //bool
+#define PAR_REFINE_PARAMETERS "refine_parametersPin" //bool
+#define PAR_MOTION_PREDICTION "motion_predictionPin" //bool
+#define PAR_POSE_WORLD "pose_worldPin" //bool
+
+#define PAR_REINIT_VIDEO_EVERY "reinit_video_everyPin" //int
+#define PAR_NUM_OPTIMIZATION_ITERATION "num_optimisation_iterationPin" //int
+#define PAR_MAX_THREADS "max_threadsPin" //int
+#define PAR_PIN_FIRST_CORE "pin_first_corePin" //int
+
+#define PAR_VALIDATION_BOUNDARY "validation_boundaryPin" //double
+#define PAR_SIGMA "sigmaPin" //double
+#define PAR_REG_FACTOR "reg_factorPin" //double
+#define PAR_WEIGHT_FACTOR "weight_factorPin" //double
+#define PAR_FX "fxPin" //double
+#define PAR_FY "fyPin" //double
+#define PAR_CX "cxPin" //double
+#define PAR_CY "cyPin" //double
+
+#define IN_FRAMEIMAGE "Frame/Image"
+#define OUT_LANDMARKS "Landmarks"
+#define OUT_LANDMARKS_EYE "Eyeball Landmarks"
+#define OUT_HEADPOSITION "HeadPosition"
+#define OUT_HEADROTATION "HeadRotation"
+#define OUT_GAZEESTIMATELEFT "GazeEstimateLeft"
+#define OUT_GAZEESTIMATERIGHT "GazeEstimateRight"
+#define OUT_PUPILLEFT "PupilLeft"
+#define OUT_PUPILRIGHT "PupilRight"
+#define OUT_LINELEFT "LeftGazeLine"
+#define OUT_LINERIGHT "RightGazeLine"
+
+// The detection certainty below which the landmarks are output, as in the landmarks detector block
+#define LANDMARKS_CERTAINTY_THRESHOLD 0.2
+
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Constructor.
+/// </summary>
+//////////////////////////////////////////////////////////
+CFaceTracker::CFaceTracker( const Eyw::OBJECT_CREATIONCTX* ctxPtr )
+:	Eyw::CBlockImpl( ctxPtr )
+{
+	m_inFrameImagePtr=NULL;
+	m_outLandmarksPtr=NULL;
+	m_outLandmarksEyePtr=NULL;
+	m_outHeadPositionPtr=NULL;
+	m_outHeadRotationPtr=NULL;
+	m_outGazeEstimateLeftPtr=NULL;
+	m_outGazeEstimateRightPtr=NULL;
+	m_pupilLeftPtr = NULL;
+	m_pupilRightPtr = NULL;
+	m_outLeftline = NULL;
+	m_outRightline = NULL;
+
+	_schedulingInfoPtr->SetActivationEventBased( true );
+	_schedulingInfoPtr->GetEventBasedActivationInfo()->SetActivationOnInputChanged( IN_FRAMEIMAGE, true );
+
+}
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Destructor.
+/// </summary>
+//////////////////////////////////////////////////////////
+CFaceTracker::~CFaceTracker()
+{
+}
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block signature initialization.
+/// </summary>
+//////////////////////////////////////////////////////////
+void CFaceTracker::InitSignature()
+{	
+	const char* model_location_description =
+		R"( "Location for the landmark detection model used by OpenFace: 
+	- "main_clnf_general" (default), trained on Multi-PIE of varying pose and illumination and In-the-wild data, works well for head pose tracking (CLNF model);
+	- "main_clnf_wild", trained on In-the-wild data, works better in noisy environments (not very well suited for head pose tracking), (CLNF in-the-wild model);
+	- "main_clm_general", a less accurate but slightly faster CLM model trained on Multi-PIE of varying pose and illumination and In-the-wild data, works well for head pose tracking;
+	- "main_clm-z", trained on Multi-PIE and BU-4DFE datasets, works with both intensity and depth signals (CLM-Z).)";
+
+	m_model_locationPinPtr = Eyw::Cast<Eyw::IInt*>(
+	                     SetParameter(Eyw::pin::id(PAR_MODEL_LOCATION)
+	                         .name("Model location")
+	                         .description(model_location_description)
+	                         .type<Eyw::IInt>()
+	                         .set_combo_layout(4) // change the number to the number of items
+	                             .item(0, "model/main_clnf_general.txt")
+	                             .item(1, "model/main_clnf_wild.txt")
+	                             .item(2, "model/main_clm_general.txt")
+								 .item(3, "model/main_clm-z.txt")
+	                         )->GetDatatype() );
+	m_model_locationPinPtr->SetValue(0);
+
+	m_limit_posePinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_LIMIT_POSE)
+							 .name("Limit Pose")
+							 .description("Should pose be limited to 180 degrees frontal")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_limit_posePinPtr->SetValue(true);
+
+	m_refine_hierarchicalPinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_REFINE_HIERARCHICAL)
+							 .name("Refine Hierarchical")
+							 .description("Should the model be refined hierarchically (if available)")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_refine_hierarchicalPinPtr->SetValue(true);
+
+	m_refine_parametersPinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_REFINE_PARAMETERS)
+							 .name("Refine Parameters")
+							 .description("Should the parameters be refined for different scales")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_refine_parametersPinPtr->SetValue(true);
+
+	m_motion_predictionPinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_MOTION_PREDICTION)
+							 .name("Motion prediction")
+							 .description("Start tracking each frame from where the face motion predicts it, keeping the search windows small while the predictions are good")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_motion_predictionPinPtr->SetValue(false);
+
+	m_pose_worldPinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_POSE_WORLD)
+							 .name("Pose in world coordinates")
+							 .description("Output the head pose in world coordinates, corrected for the perspective of the camera, instead of camera coordinates")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_pose_worldPinPtr->SetValue(false);
+
+	m_num_optimisation_iterationPinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_NUM_OPTIMIZATION_ITERATION)
+							 .name("Number of optimisation iterations")
+							 .description("A number of RLMS or NU-RLMS iterations")
+							 .type<Eyw::IInt>()
+							 .set_int_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_num_optimisation_iterationPinPtr->SetValue(5);
+
+	m_reinit_video_everyPinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_REINIT_VIDEO_EVERY)
+							 .name("Reinit video every n frames")
+							 .description("How often should face detection be used to attempt reinitialisation, every n frames (set to negative not to reinit)")
+							 .type<Eyw::IInt>()
+							 )->GetDatatype() );
+	m_reinit_video_everyPinPtr->SetValue(4);
+
+	m_max_threadsPinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_MAX_THREADS)
+							 .name("Max threads")
+							 .description("How many worker threads this block may use for the detection (0 to share all of the threads with the other blocks)")
+							 .type<Eyw::IInt>()
+							 .set_int_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_max_threadsPinPtr->SetValue(0);
+
+	m_pin_first_corePinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_PIN_FIRST_CORE)
+							 .name("Pin to first core")
+							 .description("Pin the worker threads of this block to the cores starting from this one (negative not to pin, only used if max threads is set)")
+							 .type<Eyw::IInt>()
+							 )->GetDatatype() );
+	m_pin_first_corePinPtr->SetValue(-1);
+
+	m_validation_boundaryPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_VALIDATION_BOUNDARY)
+							 .name("Validation boundary")
+							 .description("Landmark detection validator boundary for correct detection, the regressor output -1 (perfect alignment) 1 (bad alignment),")
+							 .type<Eyw::IDouble>()
+							 )->GetDatatype() );
+	m_validation_boundaryPinPtr->SetValue(-0.45);
+
+	m_sigmaPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_SIGMA)
+							 .name("Sigma")
+							 .description("Used for the smooting of response maps (KDE sigma)")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_sigmaPinPtr->SetValue(1.5);
+
+	m_reg_factorPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_REG_FACTOR)
+							 .name("Regularization factor")
+							 .description("Weight put to regularisation")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_reg_factorPinPtr->SetValue(25);
+
+	m_weight_factorPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_WEIGHT_FACTOR)
+							 .name("Weight factor")
+							 .description("Factor for weighted least squares. By default 0, as for videos doesn't work well")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_weight_factorPinPtr->SetValue(0);
+
+	m_fxPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_FX)
+							 .name("Focal X")
+							 .description("Focal length X coordinate")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+
+
+	m_fyPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_FY)
+							 .name("Focal Y")
+							 .description("Focal length Y coordinate")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+
+	m_cxPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_CX)
+							 .name("Optical center X")
+							 .description("Optical X axis center")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+
+	m_cyPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_CY)
+							 .name("Optical center Y")
+							 .description("Optical Y axis center")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+
+
+
+
+	SetInput(Eyw::pin::id(IN_FRAMEIMAGE)
+		.name("Frame/Image")
+		.description("Input Image or Frame")
+		.type<Eyw::IImage>()
+		);
+	SetOutput(Eyw::pin::id(OUT_LANDMARKS)
+		.name("Landmarks' position")
+		.description("Labelled set of 2D points of the facial landmarks")
+		.type<Eyw::IGraphicLabelledSet2DDouble>()
+		);
+	SetOutput(Eyw::pin::id(OUT_LANDMARKS_EYE)
+		.name("Eye Landmarks' position")
+		.description("Labelled set of 2D points of the landmarks of the eyeballs")
+		.type<Eyw::IGraphicLabelledSet2DDouble>()
+		);
+	SetOutput(Eyw::pin::id(OUT_HEADPOSITION)
+		.name("Head position")
+		.description("Position of the head in millimetres, in camera or world coordinates")
+		.type<Eyw::IVector3DDouble>()
+		);
+	SetOutput(Eyw::pin::id(OUT_HEADROTATION)
+		.name("Head rotation")
+		.description("Rotation of the head as Euler angles in radians (pitch, yaw, roll), in camera or world coordinates")
+		.type<Eyw::IVector3DDouble>()
+		);
+	SetOutput(Eyw::pin::id(OUT_GAZEESTIMATELEFT)
+		.name("GazeEstimateLeft")
+		.description("Vector estimating the left eye gaze direction")
+		.type<Eyw::IVector3DDouble>()
+		);
+	SetOutput(Eyw::pin::id(OUT_GAZEESTIMATERIGHT)
+		.name("GazeEstimateRight")
+		.description("Vector estimating the right eye gaze direction")
+		.type<Eyw::IVector3DDouble>()
+		);
+	SetOutput(Eyw::pin::id(OUT_PUPILLEFT)
+		.name("Left pupil position")
+		.description("Left pupil estimated position")
+		.type<Eyw::IGraphicPoint2DInt>()
+		);
+	SetOutput(Eyw::pin::id(OUT_PUPILRIGHT)
+		.name("Right Pupil Position")
+		.description("Right pupil estimated position")
+		.type<Eyw::IGraphicPoint2DInt>()
+		);
+	SetOutput(Eyw::pin::id(OUT_LINELEFT)
+		.name("Left gaze Line")
+		.description("2D representation of the left gaze")
+		.type<Eyw::IGraphicLine2DInt>()
+		);
+	SetOutput(Eyw::pin::id(OUT_LINERIGHT)
+		.name("Right gaze Line")
+		.description("2D representation of the right gaze")
+		.type<Eyw::IGraphicLine2DInt>()
+		);
+
+}
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block signature check.
+/// </summary>
+//////////////////////////////////////////////////////////
+void CFaceTracker::CheckSignature()
+{
+	m_model_locationPinPtr = get_parameter_datatype<Eyw::IInt>(PAR_MODEL_LOCATION);
+
+	m_limit_posePinPtr=get_parameter_datatype<Eyw::IBool>(PAR_LIMIT_POSE);
+	m_refine_hierarchicalPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_REFINE_HIERARCHICAL);
+	m_refine_parametersPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_REFINE_PARAMETERS);
+	m_motion_predictionPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_MOTION_PREDICTION);
+	m_pose_worldPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_POSE_WORLD);
+
+	//int ptrs
+	m_num_optimisation_iterationPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_NUM_OPTIMIZATION_ITERATION);
+	m_reinit_video_everyPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_REINIT_VIDEO_EVERY);
+	m_max_threadsPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_MAX_THREADS);
+	m_pin_first_corePinPtr=get_parameter_datatype<Eyw::IInt>(PAR_PIN_FIRST_CORE);
+
+	//double ptrs
+	m_validation_boundaryPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_VALIDATION_BOUNDARY);
+	m_sigmaPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_SIGMA);
+	m_reg_factorPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_REG_FACTOR);
+	m_weight_factorPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_WEIGHT_FACTOR);
+	m_fxPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_FX);
+	m_fyPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_FY);
+	m_cxPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_CX);
+	m_cyPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_CY);
+
+
+	_signaturePtr->GetInputs()->FindItem( IN_FRAMEIMAGE );
+	_signaturePtr->GetOutputs()->FindItem( OUT_LANDMARKS );
+	_signaturePtr->GetOutputs()->FindItem( OUT_LANDMARKS_EYE );
+	_signaturePtr->GetOutputs()->FindItem( OUT_HEADPOSITION );
+	_signaturePtr->GetOutputs()->FindItem( OUT_HEADROTATION );
+	_signaturePtr->GetOutputs()->FindItem( OUT_GAZEESTIMATELEFT );
+	_signaturePtr->GetOutputs()->FindItem( OUT_GAZEESTIMATERIGHT );
+	_signaturePtr->GetOutputs()->FindItem( OUT_PUPILLEFT );
+	_signaturePtr->GetOutputs()->FindItem( OUT_PUPILRIGHT );
+	_signaturePtr->GetOutputs()->FindItem( OUT_LINELEFT );
+	_signaturePtr->GetOutputs()->FindItem( OUT_LINERIGHT );
+
+}
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block signature deinitialization.
+/// </summary>
+//////////////////////////////////////////////////////////
+void CFaceTracker::DoneSignature()
+{
+	m_model_locationPinPtr=NULL;
+
+	m_limit_posePinPtr=NULL;
+	m_refine_hierarchicalPinPtr=NULL;
+	m_refine_parametersPinPtr=NULL;
+	m_motion_predictionPinPtr=NULL;
+	m_pose_worldPinPtr=NULL;
+
+	//int ptrs
+	m_num_optimisation_iterationPinPtr=NULL;
+	m_reinit_video_everyPinPtr=NULL;
+	m_max_threadsPinPtr=NULL;
+	m_pin_first_corePinPtr=NULL;
+
+	//double ptrs
+	m_validation_boundaryPinPtr=NULL;
+	m_sigmaPinPtr=NULL;
+	m_reg_factorPinPtr=NULL;
+	m_weight_factorPinPtr=NULL;
+	m_fxPinPtr=NULL;
+	m_fyPinPtr=NULL;
+	m_cxPinPtr=NULL;
+	m_cyPinPtr=NULL;
+
+}
+
+/// Block Actions
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block initialization action.
+/// </summary>
+/// <returns>
+/// true if success, otherwise false.
+/// </returns>
+//////////////////////////////////////////////////////////
+bool CFaceTracker::Init() throw()
+{
+	try
+	{
+		m_inFrameImagePtr = get_input_datatype<Eyw::IImage>( IN_FRAMEIMAGE );
+
+		m_outLandmarksPtr = get_output_datatype<Eyw::IGraphicLabelledSet2DDouble>(OUT_LANDMARKS);
+
+			list_init_info_ptr listInitInfoPtr = datatype_init_info<IListInitInfo>::create(_kernelServicesPtr);
+			listInitInfoPtr->SetCatalogID(EYW_BASE_CATALOG_ID);
+			listInitInfoPtr->SetClassID(EYW_BASE_CATALOG_GRAPHIC_POINT2D_DOUBLE_ID);
+
+			m_outLandmarksPtr->InitInstance(listInitInfoPtr.get());
+
+		m_outLandmarksEyePtr = get_output_datatype<Eyw::IGraphicLabelledSet2DDouble>(OUT_LANDMARKS_EYE);
+
+			list_init_info_ptr listInitInfoPtr2 = datatype_init_info<IListInitInfo>::create(_kernelServicesPtr);
+			listInitInfoPtr2->SetCatalogID(EYW_BASE_CATALOG_ID);
+			listInitInfoPtr2->SetClassID(EYW_BASE_CATALOG_GRAPHIC_POINT2D_DOUBLE_ID);
+
+			m_outLandmarksEyePtr->InitInstance(listInitInfoPtr2.get());
+
+			m_pointPtr = datatype<Eyw::IGraphicPoint2DDouble>::create(_kernelServicesPtr);
+
+		landmarks_output.Init(m_outLandmarksPtr, m_pointPtr);
+		eye_landmarks_output.Init(m_outLandmarksEyePtr, m_pointPtr);
+
+		m_outHeadPositionPtr = get_output_datatype<Eyw::IVector3DDouble>( OUT_HEADPOSITION );
+		m_outHeadRotationPtr = get_output_datatype<Eyw::IVector3DDouble>( OUT_HEADROTATION );
+		m_outGazeEstimateLeftPtr = get_output_datatype<Eyw::IVector3DDouble>( OUT_GAZEESTIMATELEFT );
+		m_outGazeEstimateRightPtr = get_output_datatype<Eyw::IVector3DDouble>( OUT_GAZEESTIMATERIGHT );
+		m_pupilLeftPtr = get_output_datatype<Eyw::IGraphicPoint2DInt>( OUT_PUPILLEFT );
+		m_pupilRightPtr = get_output_datatype<Eyw::IGraphicPoint2DInt>( OUT_PUPILRIGHT );
+		m_outLeftline = get_output_datatype<Eyw::IGraphicLine2DInt>(OUT_LINELEFT);
+		m_outRightline = get_output_datatype<Eyw::IGraphicLine2DInt>(OUT_LINERIGHT);
+
+			m_gazeLeftEndPtr = datatype<Eyw::IPoint2DInt>::create(_kernelServicesPtr);
+			m_gazeRightEndPtr = datatype<Eyw::IPoint2DInt>::create(_kernelServicesPtr);
+
+		det_parameters.model_location = GetComboParameterItem(PAR_MODEL_LOCATION, m_model_locationPinPtr->GetValue());
+
+		clnf_model = LandmarkDetector::CLNF(det_parameters.model_location);
+		gaze_parts = FaceAnalysis::FindGazeParts(clnf_model);
+
+		// The labels are built here rather than while outputting the first frames (two eyes of 28 landmarks)
+		for(int i = 0; i < clnf_model.pdm.NumberOfPoints(); ++i)
+		{
+			landmarks_output.Label(i);
+		}
+		for(int i = 0; i < 2 * 28; ++i)
+		{
+			eye_landmarks_output.Label(i);
+		}
+
+		det_parameters.track_gaze = true;
+		det_parameters.limit_pose = m_limit_posePinPtr->GetValue();
+		det_parameters.refine_hierarchical = m_refine_hierarchicalPinPtr->GetValue();
+		det_parameters.refine_parameters = m_refine_parametersPinPtr->GetValue();
+		det_parameters.use_motion_prediction = m_motion_predictionPinPtr->GetValue();
+
+		det_parameters.num_optimisation_iteration = m_num_optimisation_iterationPinPtr->GetValue();
+		det_parameters.reinit_video_every = m_reinit_video_everyPinPtr->GetValue();
+		det_parameters.max_concurrency = m_max_threadsPinPtr->GetValue();
+		det_parameters.pin_first_core = m_pin_first_corePinPtr->GetValue();
+
+		det_parameters.reg_factor = m_reg_factorPinPtr->GetValue();
+		det_parameters.weight_factor = m_weight_factorPinPtr->GetValue();
+		det_parameters.sigma = m_sigmaPinPtr->GetValue();
+		det_parameters.validation_boundary = m_validation_boundaryPinPtr->GetValue();
+
+		if (m_fxPinPtr->GetValue() == 0.0 || m_fyPinPtr->GetValue() == 0.0)
+		{
+			Notify_DebugString("fx_undefined is true\n");
+			fx_undefined = true;
+		}
+
+		if (m_cxPinPtr->GetValue() == 0.0 || m_cyPinPtr->GetValue() == 0.0)
+		{
+			Notify_DebugString("cx_undefined is true\n");
+			cx_undefined = true;
+		}
+
+		return true;
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block start action.
+/// </summary>
+/// <returns>
+/// true if success, otherwise false.
+/// </returns>
+//////////////////////////////////////////////////////////
+bool CFaceTracker::Start() throw()
+{
+	try
+	{
+		return true;
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block execution action.
+/// </summary>
+/// <returns>
+/// true if success, otherwise false.
+/// </returns>
+//////////////////////////////////////////////////////////
+bool CFaceTracker::Execute() throw()
+{
+	try
+	{
+		// A model chosen at run time that finished loading in the background, the tracking starts again with it
+		if (model_loader.TakeLoaded(clnf_model, det_parameters.model_location))
+		{
+			clnf_model.Reset();
+			gaze_parts = FaceAnalysis::FindGazeParts(clnf_model);
+		}
+
+		// Nothing to compute if no output is connected
+		det_parameters.feature_mask = GetRequestedFeatures();
+		if (det_parameters.feature_mask < 0)
+		{
+			return true;
+		}
+
+		// The gray frame points into the input image, or into the buffer of the ingestion for colour images
+		cv::Mat_<uchar> grayscale_image;
+
+		if(frame_ingestion.GetGray(m_inFrameImagePtr, grayscale_image))
+		{
+			int rows = frame_ingestion.Height();
+			int cols = frame_ingestion.Width();
+
+			normFacX = cols;
+			normFacY = rows;
+
+			if(cx_undefined)
+			{
+				cx = cols / 2.0;
+				cy = rows / 2.0;
+
+			} else
+			{
+				cx = m_cxPinPtr->GetValue();
+				cy = m_cyPinPtr->GetValue();
+			}
+
+
+			if(fx_undefined)
+			{
+				fx = 500 * (cols / 640.0);
+				fy = 500 * (rows / 480.0);
+
+				fx = (fx + fy) / 2.0;
+				fy = fx;
+			} else
+			{
+				fx = m_fxPinPtr->GetValue();
+				fy = m_fyPinPtr->GetValue();
+
+			}
+
+			// The model works in the coordinates of the region of interest, if its origin moved it is moved by as much in the other
+			// direction so that the tracking carries on from the same place in the image
+			if(frame_ingestion.Offset() != tracked_roi_offset)
+			{
+				clnf_model.Translate(tracked_roi_offset.x - frame_ingestion.Offset().x, tracked_roi_offset.y - frame_ingestion.Offset().y);
+				tracked_roi_offset = frame_ingestion.Offset();
+			}
+
+			// One fit for all of the outputs, refining only the part models that the connected ones need
+			bool detection_success = DetectLandmarksInVideo(grayscale_image, clnf_model, det_parameters);
+
+			// All of the outputs are stamped with the time of the frame they come from
+			Eyw::TIME creation_time = m_inFrameImagePtr->GetCreationTime();
+			FillLandmarks(creation_time);
+			FillHeadPose(creation_time);
+			FillGaze(detection_success, creation_time);
+		}
+
+		frame_count++;
+
+	}
+	catch(...)
+	{
+		Notify_ErrorString("Exception thrown on execution");
+	}
+	return true;
+}
+
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block stop action.
+/// </summary>
+//////////////////////////////////////////////////////////
+void CFaceTracker::Stop() throw()
+{
+	try
+	{
+		Notify_DebugString("Stopping...\n");
+	}
+	catch(...)
+	{
+	}
+}
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Block deinitialization action.
+/// </summary>
+//////////////////////////////////////////////////////////
+void CFaceTracker::Done() throw()
+{
+	try
+	{
+		landmarks_output.Done();
+		eye_landmarks_output.Done();
+
+		m_inFrameImagePtr = NULL;
+		m_outLandmarksPtr = NULL;
+		m_outLandmarksEyePtr = NULL;
+		m_outHeadPositionPtr = NULL;
+		m_outHeadRotationPtr = NULL;
+		m_outGazeEstimateLeftPtr = NULL;
+		m_outGazeEstimateRightPtr = NULL;
+		m_pupilLeftPtr = NULL;
+		m_pupilRightPtr = NULL;
+		m_outLeftline = NULL;
+		m_outRightline = NULL;
+		m_pointPtr = 0;
+		m_gazeLeftEndPtr = 0;
+		m_gazeRightEndPtr = 0;
+
+		Notify_DebugString("We are done\n");
+
+	}
+	catch(...)
+	{
+	}
+}
+
+/// optionals
+
+//////////////////////////////////////////////////////////
+/// <summary>
+/// Manage the ChangedParameter event.
+/// </summary>
+/// <param name="csParameterID">
+/// [in] id of the changed parameter.
+/// </param>
+//////////////////////////////////////////////////////////
+void CFaceTracker::OnChangedParameter( const std::string& csParameterID )
+{
+	if(IsRunTime())
+	{
+		ApplyChangedParameter(csParameterID);
+	}
+}
+
+// Only a new model resets the tracking, the fitting parameters apply from the next frame on and sigma only drops the
+// responses that were precalculated with it
+void CFaceTracker::ApplyChangedParameter( const std::string& csParameterID )
+{
+	if (csParameterID == PAR_MODEL_LOCATION)
+	{
+		// The current model keeps tracking while the new one is read, it is swapped in at the start of a frame
+		model_loader.Load(GetComboParameterItem(PAR_MODEL_LOCATION, m_model_locationPinPtr->GetValue()));
+	}
+	else if(csParameterID == PAR_SIGMA)
+	{
+		det_parameters.sigma = m_sigmaPinPtr->GetValue();
+		clnf_model.InvalidateResponseCaches();
+	}
+	// The thread budget and the pose coordinates do not affect the tracking state
+	else if (csParameterID == PAR_MAX_THREADS)
+		det_parameters.max_concurrency = m_max_threadsPinPtr->GetValue();
+	else if (csParameterID == PAR_PIN_FIRST_CORE)
+		det_parameters.pin_first_core = m_pin_first_corePinPtr->GetValue();
+	else if (csParameterID == PAR_POSE_WORLD)
+		return;
+
+	else if (csParameterID == PAR_LIMIT_POSE)
+		det_parameters.limit_pose = m_limit_posePinPtr->GetValue();
+	else if (csParameterID == PAR_NUM_OPTIMIZATION_ITERATION)
+		det_parameters.num_optimisation_iteration = m_num_optimisation_iterationPinPtr->GetValue();
+	else if (csParameterID == PAR_REFINE_HIERARCHICAL)
+		det_parameters.refine_hierarchical = m_refine_hierarchicalPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REFINE_PARAMETERS)
+		det_parameters.refine_parameters = m_refine_parametersPinPtr->GetValue();
+	else if (csParameterID == PAR_MOTION_PREDICTION)
+		det_parameters.use_motion_prediction = m_motion_predictionPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REG_FACTOR)
+		det_parameters.reg_factor = m_reg_factorPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REINIT_VIDEO_EVERY)
+		det_parameters.reinit_video_every = m_reinit_video_everyPinPtr->GetValue();
+
+	else if (csParameterID == PAR_CX)
+		cx = m_cxPinPtr->GetValue();
+	else if (csParameterID == PAR_CY)
+		cy = m_cyPinPtr->GetValue();
+	else if (csParameterID == PAR_FX)
+		fx = m_fxPinPtr->GetValue();
+	else if (csParameterID == PAR_FY)
+		fy = m_fyPinPtr->GetValue();
+
+	else if(csParameterID == PAR_VALIDATION_BOUNDARY)
+		det_parameters.validation_boundary = m_validation_boundaryPinPtr->GetValue();
+	else if(csParameterID == PAR_WEIGHT_FACTOR)
+		det_parameters.weight_factor = m_weight_factorPinPtr->GetValue();
+
+	cx_undefined = cx == 0.0 || cy == 0.0;
+	fx_undefined = fx == 0.0 || fy == 0.0;
+}
+
+bool CFaceTracker::IsConnected(const char* output)
+{
+	return _signaturePtr->GetOutputs()->FindItem( output )->IsConnected();
+}
+
+// The facial features needed by the connected output pins, -1 if none is connected
+int CFaceTracker::GetRequestedFeatures()
+{
+	int features = 0;
+	bool any_connected = false;
+
+	if(IsConnected( OUT_LANDMARKS ))
+	{
+		features |= LandmarkDetector::FaceModelParameters::FEATURE_CONTOUR | LandmarkDetector::FaceModelParameters::FEATURE_MOUTH |
+			LandmarkDetector::FaceModelParameters::FEATURE_BROWS | LandmarkDetector::FaceModelParameters::FEATURE_EYES;
+		any_connected = true;
+	}
+
+	// Every gaze output comes from the eye models
+	const char* gaze_outputs[] = { OUT_LANDMARKS_EYE, OUT_GAZEESTIMATELEFT, OUT_GAZEESTIMATERIGHT, OUT_PUPILLEFT, OUT_PUPILRIGHT, OUT_LINELEFT, OUT_LINERIGHT };
+	for(size_t i = 0; i < sizeof(gaze_outputs) / sizeof(gaze_outputs[0]); ++i)
+	{
+		if(IsConnected( gaze_outputs[i] ))
+		{
+			features |= LandmarkDetector::FaceModelParameters::FEATURE_GAZE;
+			any_connected = true;
+			break;
+		}
+	}
+
+	// The head pose only needs the main face model
+	if(IsConnected( OUT_HEADPOSITION ) || IsConnected( OUT_HEADROTATION ))
+	{
+		any_connected = true;
+	}
+
+	return any_connected ? features : -1;
+}
+
+// From pixels within the region of interest to the coordinates normalized by the size of the whole image (rounded to 1/16 of a pixel)
+double CFaceTracker::NormalizedX(double x) const
+{
+	return cvRound((x + frame_ingestion.Offset().x)*16-10)/(normFacX*16);
+}
+
+double CFaceTracker::NormalizedY(double y) const
+{
+	return cvRound((y + frame_ingestion.Offset().y)*16)/(normFacY*16);
+}
+
+// The visible facial landmarks and the eye landmarks, as 2D normalized coordinates on the image
+void CFaceTracker::FillLandmarks(Eyw::TIME creation_time)
+{
+	bool landmarks_connected = IsConnected( OUT_LANDMARKS );
+	bool eyes_connected = IsConnected( OUT_LANDMARKS_EYE );
+
+	if(!landmarks_connected && !eyes_connected)
+	{
+		return;
+	}
+
+	landmarks_output.Begin();
+	eye_landmarks_output.Begin();
+
+	if(clnf_model.detection_certainty < LANDMARKS_CERTAINTY_THRESHOLD)
+	{
+		if(landmarks_connected)
+		{
+			// Only the points that the patch experts consider visible at this orientation
+			int idx = clnf_model.patch_experts.GetViewIdx(clnf_model.params_global, 0);
+			const cv::Mat_<int>& visibilities = clnf_model.patch_experts.visibilities[0][idx];
+
+			int n = clnf_model.detected_landmarks.rows/2;
+			for(int i = 0; i < n; ++i)
+			{
+				if(visibilities.at<int>(i))
+				{
+					landmarks_output.Add(landmarks_output.Label(i), NormalizedX(clnf_model.detected_landmarks.at<double>(i)), NormalizedY(clnf_model.detected_landmarks.at<double>(i + n)));
+				}
+			}
+		}
+
+		if(eyes_connected)
+		{
+			// The eye models, numbered on from each other
+			int eye_label = 0;
+			for(size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
+			{
+				const cv::Mat_<double>& eye_landmarks = clnf_model.hierarchical_models[i].detected_landmarks;
+				int n_eye = eye_landmarks.rows/2;
+
+				if(n_eye != 28 || clnf_model.hierarchical_models[i].pdm.NumberOfPoints() == clnf_model.hierarchical_mapping[i].size())
+				{
+					continue;
+				}
+
+				for(int j = 0; j < n_eye; ++j)
+				{
+					eye_landmarks_output.Add(eye_landmarks_output.Label(eye_label++), NormalizedX(eye_landmarks.at<double>(j)), NormalizedY(eye_landmarks.at<double>(j + n_eye)));
+				}
+			}
+		}
+	}
+
+	landmarks_output.End();
+	eye_landmarks_output.End();
+
+	m_outLandmarksPtr->SetCreationTime(creation_time);
+	m_outLandmarksEyePtr->SetCreationTime(creation_time);
+}
+
+// The head pose, either relative to the camera or corrected for the perspective (as if the head was seen from straight ahead)
+void CFaceTracker::FillHeadPose(Eyw::TIME creation_time)
+{
+	if(!IsConnected( OUT_HEADPOSITION ) && !IsConnected( OUT_HEADROTATION ))
+	{
+		return;
+	}
+
+	// The model is fitted in the region of interest, which moves the optical centre
+	double roi_cx = cx - frame_ingestion.Offset().x;
+	double roi_cy = cy - frame_ingestion.Offset().y;
+
+	cv::Vec6d pose;
+	if(m_pose_worldPinPtr->GetValue())
+	{
+		pose = LandmarkDetector::GetCorrectedPoseWorld(clnf_model, fx, fy, roi_cx, roi_cy);
+	}
+	else
+	{
+		pose = LandmarkDetector::GetPoseCamera(clnf_model, fx, fy, roi_cx, roi_cy);
+	}
+
+	m_outHeadPositionPtr->SetValue(pose[0], pose[1], pose[2]);
+	m_outHeadRotationPtr->SetValue(pose[3], pose[4], pose[5]);
+
+	m_outHeadPositionPtr->SetCreationTime(creation_time);
+	m_outHeadRotationPtr->SetCreationTime(creation_time);
+}
+
+// The gaze vectors, and the pupils and the gaze lines projected on the image
+void CFaceTracker::FillGaze(bool detection_success, Eyw::TIME creation_time)
+{
+	if(!(det_parameters.feature_mask & LandmarkDetector::FaceModelParameters::FEATURE_GAZE))
+	{
+		return;
+	}
+
+	// The model is fitted in the region of interest, which moves the optical centre
+	cv::Point roi_offset = frame_ingestion.Offset();
+	double roi_cx = cx - roi_offset.x;
+	double roi_cy = cy - roi_offset.y;
+
+	// Both eyes at once, the pupils (looking straight ahead) are output even when the detection failed
+	FaceAnalysis::BinocularGaze gaze;
+	gaze.gaze_left = cv::Point3f(0, 0, -1);
+	gaze.gaze_right = cv::Point3f(0, 0, -1);
+
+	if (gaze_parts.Valid())
+	{
+		FaceAnalysis::EstimateBinocularGaze(clnf_model, gaze_parts, fx, fy, roi_cx, roi_cy, det_parameters.track_gaze && detection_success && clnf_model.eye_model, gaze);
+	}
+
+	m_outGazeEstimateLeftPtr->SetValue(gaze.gaze_left.x, gaze.gaze_left.y, gaze.gaze_left.z);
+	m_outGazeEstimateRightPtr->SetValue(gaze.gaze_right.x, gaze.gaze_right.y, gaze.gaze_right.z);
+
+	m_outGazeEstimateLeftPtr->SetCreationTime(creation_time);
+	m_outGazeEstimateRightPtr->SetCreationTime(creation_time);
+
+	if(!gaze_parts.Valid() || (!IsConnected( OUT_PUPILLEFT ) && !IsConnected( OUT_PUPILRIGHT ) && !IsConnected( OUT_LINELEFT ) && !IsConnected( OUT_LINERIGHT )))
+	{
+		return;
+	}
+
+	// Projected on the region of interest, moved onto the whole image
+	cv::Point pupil_left = cv::Point(cvRound(gaze.pupil_left_image.x), cvRound(gaze.pupil_left_image.y)) + roi_offset;
+	cv::Point pupil_right = cv::Point(cvRound(gaze.pupil_right_image.x), cvRound(gaze.pupil_right_image.y)) + roi_offset;
+	cv::Point gaze_left_end = cv::Point(cvRound(gaze.gaze_left_end_image.x), cvRound(gaze.gaze_left_end_image.y)) + roi_offset;
+	cv::Point gaze_right_end = cv::Point(cvRound(gaze.gaze_right_end_image.x), cvRound(gaze.gaze_right_end_image.y)) + roi_offset;
+
+	//setting pupils position
+	m_pupilLeftPtr->SetValue(pupil_left.x, pupil_left.y);
+	m_pupilRightPtr->SetValue(pupil_right.x, pupil_right.y);
+
+	m_gazeLeftEndPtr->SetValue(gaze_left_end.x, gaze_left_end.y);
+	m_gazeRightEndPtr->SetValue(gaze_right_end.x, gaze_right_end.y);
+
+	m_outLeftline->SetValue(m_pupilLeftPtr->GetValue(), m_gazeLeftEndPtr->GetValue());
+	m_outRightline->SetValue(m_pupilRightPtr->GetValue(), m_gazeRightEndPtr->GetValue());
+
+	m_pupilLeftPtr->SetCreationTime(creation_time);
+	m_pupilRightPtr->SetCreationTime(creation_time);
+
+	m_outLeftline->SetCreationTime(creation_time);
+	m_outRightline->SetCreationTime(creation_time);
+}
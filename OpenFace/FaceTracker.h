@@ -0,0 +1,219 @@
+#pragma once
+#include "StdAfx.h"
+#include "BaseCatalog/EywGeometricVector3D.h"
+#include "BaseCatalog/EywGeometricPoint2D.h"
+#include "BaseCatalog/EywGraphicPoint2D.h"
+#include "BaseCatalog/EywGraphicLine2D.h"
+#include "BaseCatalog/EywGraphicLabelledSet2D.h"
+#include <opencv2/core/mat.hpp>
+#include "./include/LandmarkDetectorParameters.h"
+#include "./include/LandmarkDetectorModel.h"
+#include "./include/GazeEstimation.h"
+#include "./include/BackgroundModelLoader.h"
+#include "FrameIngestion.h"
+#include "LabelledPointsOutput.h"
+
+class CFaceTracker : public Eyw::CBlockImpl
+{
+public:
+	//////////////////////////////////////////////////////////
+	/// <summary>
+	/// Constructor.
+	/// </summary>
+	//////////////////////////////////////////////////////////
+	CFaceTracker( const Eyw::OBJECT_CREATIONCTX* ctxPtr );
+	
+	//////////////////////////////////////////////////////////
+	/// <summary>	
+	/// Destructor.
+	/// </summary>
+	//////////////////////////////////////////////////////////
+	~CFaceTracker();
+
+protected:
+
+	//////////////////////////////////////////////////////////
+	/// <summary>
+	/// Block signature initialization.
+	/// </summary>
+	//////////////////////////////////////////////////////////
+	virtual void InitSignature();	// should also initialize layout and private data
+	
+	//////////////////////////////////////////////////////////
+	/// <summary>
+	/// Block signature check.
+	/// </summary>
+	//////////////////////////////////////////////////////////
+	virtual void CheckSignature();
+	
+	//////////////////////////////////////////////////////////
+	/// <summary>
+	/// Block signature deinitialization.
+	/// </summary>
+	//////////////////////////////////////////////////////////
+	virtual void DoneSignature();
+
+	//////////////////////////////////////////////////////////
+	/// Block Actions
+	/// <summary>
+	/// Block initialization action.
+	/// </summary>
+	/// <returns>
+	/// true if success, otherwise false.
+	/// </returns>
+	//////////////////////////////////////////////////////////
+	virtual bool Init() throw();
+
+	//////////////////////////////////////////////////////////
+	/// <summary>
+	/// Block start action.
+	/// </summary>
+	/// <returns>
+	/// true if success, otherwise false.
+	/// </returns>
+	//////////////////////////////////////////////////////////
+	virtual bool Start() throw();
+
+	//////////////////////////////////////////////////////////
+	/// <summary>
+	/// Block execution action.
+	/// </summary>
+	/// <returns>
+	/// true if success, otherwise false.
+	/// </returns>
+	//////////////////////////////////////////////////////////
+	virtual bool Execute() throw();
+	
+
+
+	//////////////////////////////////////////////////////////
+	/// <summary>
+	/// Block stop action.
+	/// </summary>
+	//////////////////////////////////////////////////////////
+	virtual void Stop() throw();
+
+	//////////////////////////////////////////////////////////
+	/// <summary>
+	/// Block deinitialization action.
+	/// </summary>
+	//////////////////////////////////////////////////////////
+	virtual void Done() throw();
+
+	//////////////////////////////////////////////////////////
+	/// optionals
+	/// <summary>
+	/// Manage the ChangedParameter event.
+	/// </summary>
+	/// <param name="csParameterID">
+	/// [in] id of the changed parameter.
+	/// </param>
+	//////////////////////////////////////////////////////////
+	void OnChangedParameter( const std::string& csParameterID );
+
+private:
+	/*
+	 *
+	 *	PARAMETERS
+	 *
+	 */
+	Eyw::int_ptr m_model_locationPinPtr;
+
+	//bool ptrs
+	Eyw::bool_ptr m_limit_posePinPtr;
+	Eyw::bool_ptr m_refine_hierarchicalPinPtr;
+	Eyw::bool_ptr m_refine_parametersPinPtr;
+	Eyw::bool_ptr m_motion_predictionPinPtr;
+	Eyw::bool_ptr m_pose_worldPinPtr;
+
+	//int ptrs
+	Eyw::int_ptr m_num_optimisation_iterationPinPtr;
+	Eyw::int_ptr m_reinit_video_everyPinPtr;
+	Eyw::int_ptr m_max_threadsPinPtr;
+	Eyw::int_ptr m_pin_first_corePinPtr;
+
+	//double ptrs
+	Eyw::double_ptr m_validation_boundaryPinPtr;
+	Eyw::double_ptr m_sigmaPinPtr;
+	Eyw::double_ptr m_reg_factorPinPtr;
+	Eyw::double_ptr m_weight_factorPinPtr;
+	Eyw::double_ptr m_fxPinPtr;
+	Eyw::double_ptr m_fyPinPtr;
+	Eyw::double_ptr m_cxPinPtr;
+	Eyw::double_ptr m_cyPinPtr;
+
+	/*
+	 *
+	 *	INPUTS AND OUTPUTS
+	 *
+	 */
+	Eyw::image_ptr m_inFrameImagePtr;
+
+	Eyw::graphic_point2d_double_ptr m_pointPtr;
+
+	Eyw::graphic_labelled_set_2d_double_ptr m_outLandmarksPtr;
+	Eyw::graphic_labelled_set_2d_double_ptr m_outLandmarksEyePtr;
+
+	Eyw::vector3d_double_ptr m_outHeadPositionPtr;
+	Eyw::vector3d_double_ptr m_outHeadRotationPtr;
+
+	Eyw::vector3d_double_ptr m_outGazeEstimateLeftPtr;
+	Eyw::vector3d_double_ptr m_outGazeEstimateRightPtr;
+
+	Eyw::graphic_point2d_int_ptr m_pupilLeftPtr;
+	Eyw::graphic_point2d_int_ptr m_pupilRightPtr;
+
+	Eyw::graphic_line2d_int_ptr m_outLeftline;
+	Eyw::graphic_line2d_int_ptr m_outRightline;
+
+	// The end points of the gaze lines, reused every frame
+	Eyw::point2d_int_ptr m_gazeLeftEndPtr;
+	Eyw::point2d_int_ptr m_gazeRightEndPtr;
+
+	//utility function
+	bool IsConnected(const char* output);
+	int GetRequestedFeatures();
+	void ApplyChangedParameter( const std::string& csParameterID );
+
+	// Filling in the outputs from the fitted model, each only if its pin is connected
+	void FillLandmarks(Eyw::TIME creation_time);
+	void FillHeadPose(Eyw::TIME creation_time);
+	void FillGaze(bool detection_success, Eyw::TIME creation_time);
+	double NormalizedX(double x) const;
+	double NormalizedY(double y) const;
+
+	/*
+	 *
+	 *	INTERNAL DATA
+	 *
+	 */
+
+	double fx, fy, cx, cy; //focal length e optical axis centre
+
+	double normFacX, normFacY;
+
+	// The one model all of the outputs come from
+	LandmarkDetector::CLNF clnf_model;
+	LandmarkDetector::FaceModelParameters det_parameters = LandmarkDetector::FaceModelParameters();
+
+	// Where the region of interest the models currently track in starts, they are moved along when it moves
+	cv::Point tracked_roi_offset;
+
+	// The eye models of clnf_model, found when it is loaded
+	FaceAnalysis::GazeParts gaze_parts;
+
+	// Reads the model chosen at run time without stopping the tracking
+	LandmarkDetector::BackgroundModelLoader model_loader;
+
+	FrameIngestion frame_ingestion;
+
+	// The labelled sets of the landmarks and of the eye landmarks, updated in place from frame to frame
+	LabelledPointsOutput landmarks_output;
+	LabelledPointsOutput eye_landmarks_output;
+
+	int frame_count = 0;
+
+	bool cx_undefined = false;
+	bool fx_undefined = false;
+
+};
@@ -0,0 +1,77 @@
+#include "stdafx.h"
+#include "FrameIngestion.h"
+#include <opencv2/imgproc.hpp>
+
+using namespace Eyw;
+
+FrameIngestion::FrameIngestion() : offset(0, 0), width(0), height(0)
+{
+}
+
+bool FrameIngestion::GetGray(const image_ptr& sourceImagePtr, cv::Mat_<uchar>& o_gray)
+{
+	BOOST_ASSERT(sourceImagePtr);
+
+	try
+	{
+		if (!sourceImagePtr)
+			return false;
+
+		width = sourceImagePtr->GetWidth();
+		height = sourceImagePtr->GetHeight();
+
+		int type;
+		int conversion;
+		if (sourceImagePtr->GetColorModel() == Eyw::ecmBW)
+		{
+			type = CV_8UC1;
+			conversion = -1;
+		}
+		else if (sourceImagePtr->GetColorModel() == Eyw::ecmBGR)
+		{
+			type = CV_8UC3;
+			conversion = CV_BGR2GRAY;
+		}
+		else if (sourceImagePtr->GetColorModel() == Eyw::ecmRGB)
+		{
+			type = CV_8UC3;
+			conversion = CV_RGB2GRAY;
+		}
+		else
+		{
+			return false;
+		}
+
+		// A header on the buffer of the image, restricted to its region of interest (clipped to the image)
+		const RECT_2D_INT roi = sourceImagePtr->GetROI();
+		cv::Rect region = cv::Rect(roi.left, roi.top, roi.right - roi.left, roi.bottom - roi.top) & cv::Rect(0, 0, width, height);
+		if (region.area() == 0)
+		{
+			region = cv::Rect(0, 0, width, height);
+		}
+		if (region.area() == 0)
+		{
+			return false;
+		}
+
+		offset = region.tl();
+
+		cv::Mat image(height, width, type, sourceImagePtr->GetBuffer(), sourceImagePtr->GetStepSize());
+
+		if (conversion == -1)
+		{
+			o_gray = image(region);
+		}
+		else
+		{
+			// Only the region of interest is converted, into the same buffer every frame
+			cv::cvtColor(image(region), gray_buffer, conversion);
+			o_gray = gray_buffer;
+		}
+		return true;
+	}
+	catch (const IException&)
+	{
+		return false;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "StdAfx.h"
+#include <opencv2/core/mat.hpp>
+
+// Reading the frames of the EyesWeb input images for the face models, without copying them when they are already 8 bit gray
+// and without allocating anything once the frame size is steady
+class FrameIngestion
+{
+public:
+
+	FrameIngestion();
+
+	// The 8 bit gray view of the region of interest of the image. For gray images it points into the buffer of the image
+	// (valid until the image changes), otherwise into a buffer owned by this object that is reused from frame to frame.
+	// Returns false if the colour model is not supported or the region of interest is empty
+	bool GetGray(const Eyw::image_ptr& sourceImagePtr, cv::Mat_<uchar>& o_gray);
+
+	// Where the region of interest of the last image starts, the face models work in its coordinates
+	const cv::Point& Offset() const { return offset; }
+
+	// Size of the whole last image (not of its region of interest)
+	int Width() const { return width; }
+	int Height() const { return height; }
+
+private:
+
+	cv::Point offset;
+	int width;
+	int height;
+
+	// The gray conversion of colour images
+	cv::Mat_<uchar> gray_buffer;
+};
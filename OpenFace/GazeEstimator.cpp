@@ -8,8 +8,6 @@
 
 using namespace Eyw;
 
-cv::Point3f GetPupilPosition(cv::Mat_<double> eyeLdmks3d); 
-
 //////////////////////////////////////////////////////////
 /// <summary>
 /// Block Signature.
@@ -41,9 +39,15 @@ Eyw::block_class_registrant g_GazeEstimator(
 #define PAR_LIMIT_POSE "limit_posePin" //bool
 #define PAR_REFINE_HIERARCHICAL "refine_hierarchicalPin" //bool
 #define PAR_REFINE_PARAMETERS "refine_parametersPin" //bool
+#define PAR_MOTION_PREDICTION "motion_predictionPin" //bool
 
 #define PAR_REINIT_VIDEO_EVERY "reinit_video_everyPin" //int
 #define PAR_NUM_OPTIMIZATION_ITERATION "num_optimisation_iterationPin" //int
+#define PAR_MAX_THREADS "max_threadsPin" //int
+#define PAR_PIN_FIRST_CORE "pin_first_corePin" //int
+#define PAR_PIPELINED "pipelinedPin" //bool
+#define PAR_LATENCY_BUDGET "latency_budgetPin" //double
+#define PAR_FULL_FIT_EVERY "full_fit_everyPin" //int
 
 #define PAR_VALIDATION_BOUNDARY "validation_boundaryPin" //double
 #define PAR_SIGMA "sigmaPin" //double
@@ -61,6 +65,7 @@ Eyw::block_class_registrant g_GazeEstimator(
 #define OUT_PUPILRIGHT "PupiRight"
 #define OUT_LINELEFT "LeftGazeLine"
 #define OUT_LINERIGHT "RightGazeLine"
+#define OUT_RESULT_AGE "Result Age"
 
 //#define OUT_PROCESSEDIMAGE "ProcessedImage"
 
@@ -80,6 +85,7 @@ CGazeEstimator::CGazeEstimator( const Eyw::OBJECT_CREATIONCTX* ctxPtr )
 	m_pupilRightPtr = NULL;
 	m_outLeftline = NULL;
 	m_outRightline = NULL;
+	m_outResultAgePtr = NULL;
 
 	_schedulingInfoPtr->SetActivationEventBased( true );
 	_schedulingInfoPtr->GetEventBasedActivationInfo()->SetActivationOnInputChanged( IN_FRAMEIMAGE, true );
@@ -146,6 +152,14 @@ void CGazeEstimator::InitSignature()
 							 )->GetDatatype() );
 	m_refine_parametersPinPtr->SetValue(true);
 
+	m_motion_predictionPinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_MOTION_PREDICTION)
+							 .name("Motion prediction")
+							 .description("Start tracking each frame from where the face motion predicts it, keeping the search windows small while the predictions are good")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_motion_predictionPinPtr->SetValue(false);
+
 	m_num_optimisation_iterationPinPtr= Eyw::Cast<Eyw::IInt*>(
 						 SetParameter(Eyw::pin::id(PAR_NUM_OPTIMIZATION_ITERATION)
 							 .name("Number of optimisation iterations")
@@ -164,6 +178,52 @@ void CGazeEstimator::InitSignature()
 							 )->GetDatatype() );
 	m_reinit_video_everyPinPtr->SetValue(4);
 
+	m_max_threadsPinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_MAX_THREADS)
+							 .name("Max threads")
+							 .description("How many worker threads this block may use for the detection (0 to share all of the threads with the other blocks)")
+							 .type<Eyw::IInt>()
+							 .set_int_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_max_threadsPinPtr->SetValue(0);
+
+	m_pin_first_corePinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_PIN_FIRST_CORE)
+							 .name("Pin to first core")
+							 .description("Pin the worker threads of this block to the cores starting from this one (negative not to pin, only used if max threads is set)")
+							 .type<Eyw::IInt>()
+							 )->GetDatatype() );
+	m_pin_first_corePinPtr->SetValue(-1);
+
+	m_pipelinedPinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_PIPELINED)
+							 .name("Pipelined")
+							 .description("Fit the frames on a worker thread, each execution returns immediately and outputs the newest result that is ready")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_pipelinedPinPtr->SetValue(false);
+
+	m_latency_budgetPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_LATENCY_BUDGET)
+							 .name("Latency budget (ms)")
+							 .description("In pipelined mode, 0 only keeps the latest frame waiting, otherwise all of the frames are fitted as long as they have not waited longer than this")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_latency_budgetPinPtr->SetValue(0);
+
+	m_full_fit_everyPinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_FULL_FIT_EVERY)
+							 .name("Full fit every n frames")
+							 .description("Fit the whole face every n frames, in between only the eye models are refit (1 to fit the whole face in every frame)")
+							 .type<Eyw::IInt>()
+							 .set_int_domain()
+							 .min(1)
+							 )->GetDatatype() );
+	m_full_fit_everyPinPtr->SetValue(1);
+
 
 
 	m_validation_boundaryPinPtr= Eyw::Cast<Eyw::IDouble*>(
@@ -276,6 +336,11 @@ void CGazeEstimator::InitSignature()
 		.description("2D representation of the right gaze")
 		.type<Eyw::IGraphicLine2DInt>()
 		);
+	SetOutput(Eyw::pin::id(OUT_RESULT_AGE)
+		.name("Result age")
+		.description("Time in seconds from the arrival of the frame the gaze comes from to its output")
+		.type<Eyw::IDouble>()
+		);
 	
 
 }
@@ -292,10 +357,16 @@ void CGazeEstimator::CheckSignature()
 	m_limit_posePinPtr=get_parameter_datatype<Eyw::IBool>(PAR_LIMIT_POSE);
 	m_refine_hierarchicalPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_REFINE_HIERARCHICAL);
 	m_refine_parametersPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_REFINE_PARAMETERS);
+	m_motion_predictionPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_MOTION_PREDICTION);
 
 	//int ptrs
 	m_num_optimisation_iterationPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_NUM_OPTIMIZATION_ITERATION);
 	m_reinit_video_everyPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_REINIT_VIDEO_EVERY);
+	m_max_threadsPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_MAX_THREADS);
+	m_pin_first_corePinPtr=get_parameter_datatype<Eyw::IInt>(PAR_PIN_FIRST_CORE);
+	m_pipelinedPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_PIPELINED);
+	m_latency_budgetPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_LATENCY_BUDGET);
+	m_full_fit_everyPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_FULL_FIT_EVERY);
 
 	//double ptrs
 	m_validation_boundaryPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_VALIDATION_BOUNDARY);
@@ -315,6 +386,7 @@ void CGazeEstimator::CheckSignature()
 	_signaturePtr->GetOutputs()->FindItem( OUT_PUPILRIGHT );
 	_signaturePtr->GetOutputs()->FindItem( OUT_LINELEFT );
 	_signaturePtr->GetOutputs()->FindItem( OUT_LINERIGHT );
+	_signaturePtr->GetOutputs()->FindItem( OUT_RESULT_AGE );
 
 	//_signaturePtr->GetOutputs()->FindItem( OUT_PROCESSEDIMAGE );
 
@@ -331,10 +403,16 @@ void CGazeEstimator::DoneSignature()
 	m_limit_posePinPtr=NULL;
 	m_refine_hierarchicalPinPtr=NULL;
 	m_refine_parametersPinPtr=NULL;
+	m_motion_predictionPinPtr=NULL;
 
 	//int ptrs
 	m_num_optimisation_iterationPinPtr=NULL;
 	m_reinit_video_everyPinPtr=NULL;
+	m_max_threadsPinPtr=NULL;
+	m_pin_first_corePinPtr=NULL;
+	m_pipelinedPinPtr=NULL;
+	m_latency_budgetPinPtr=NULL;
+	m_full_fit_everyPinPtr=NULL;
 
 	//double ptrs
 	m_validation_boundaryPinPtr=NULL;
@@ -371,20 +449,26 @@ bool CGazeEstimator::Init() throw()
 		m_pupilRightPtr = get_output_datatype<Eyw::IGraphicPoint2DInt>( OUT_PUPILRIGHT );
 		m_outLeftline = get_output_datatype<Eyw::IGraphicLine2DInt>(OUT_LINELEFT);
 		m_outRightline = get_output_datatype<Eyw::IGraphicLine2DInt>(OUT_LINERIGHT);
+		m_outResultAgePtr = get_output_datatype<Eyw::IDouble>(OUT_RESULT_AGE);
 
 		// m_outProcessedImagePtr = get_output_datatype<Eyw::IImage>( OUT_PROCESSEDIMAGE );
 		
 		det_parameters.model_location = GetComboParameterItem(PAR_MODEL_LOCATION, m_model_locationPinPtr->GetValue());
 
 		clnf_model = LandmarkDetector::CLNF(det_parameters.model_location);
+		gaze_parts = FaceAnalysis::FindGazeParts(clnf_model);
 
 		det_parameters.track_gaze = true;
 		det_parameters.limit_pose = m_limit_posePinPtr->GetValue();
 		det_parameters.refine_hierarchical = m_refine_hierarchicalPinPtr->GetValue();
 		det_parameters.refine_parameters = m_refine_parametersPinPtr->GetValue();
+		det_parameters.use_motion_prediction = m_motion_predictionPinPtr->GetValue();
 
 		det_parameters.num_optimisation_iteration = m_num_optimisation_iterationPinPtr->GetValue();
 		det_parameters.reinit_video_every = m_reinit_video_everyPinPtr->GetValue();
+		full_fit_every = m_full_fit_everyPinPtr->GetValue();
+		det_parameters.max_concurrency = m_max_threadsPinPtr->GetValue();
+		det_parameters.pin_first_core = m_pin_first_corePinPtr->GetValue();
 
 		det_parameters.reg_factor = m_reg_factorPinPtr->GetValue();
 		det_parameters.weight_factor = m_weight_factorPinPtr->GetValue();
@@ -426,7 +510,9 @@ bool CGazeEstimator::Start() throw()
 {
 	try
 	{
-		/// TODO: add your logic
+		if(m_pipelinedPinPtr->GetValue())
+			StartPipeline();
+
 		return true;
 	}
 	catch(...)
@@ -448,75 +534,73 @@ bool CGazeEstimator::Execute() throw()
 {
 	try
 	{
-		int rows = m_inFrameImagePtr->GetHeight();
-		int cols = m_inFrameImagePtr->GetWidth();
+		AdoptLoadedModel();
 
-		PrepareCvImage(m_inFrameImagePtr, captured_image);
+		// The gray frame points into the input image, or into the buffer of the ingestion for colour images
+		cv::Mat_<uchar> grayscale_image;
 
-		if(cx_undefined)
+		if(frame_ingestion.GetGray(m_inFrameImagePtr, grayscale_image))
 		{
-			cx = rows / 2.0f;
-			cy = cols / 2.0f;
-			
-		} else
-		{
-			cx = m_cxPinPtr->GetValue();
-			cy = m_cyPinPtr->GetValue();
-		}
-
-
-		if(fx_undefined)
-		{
-			fx = 500 * ( rows / 640.0);
-			fy = 500 * ( cols / 480.0);
-
-			fx = (fx + fy) / 2.0;
-			fy = fx;	
-		} else
-		{
-			fx = m_fxPinPtr->GetValue();
-			fy = m_fyPinPtr->GetValue();
+			int rows = frame_ingestion.Height();
+			int cols = frame_ingestion.Width();
 
-		}
-
-		if(!captured_image.empty())
-		{
-			// Reading the images
-			cv::Mat_<uchar> grayscale_image;
-
-			if(captured_image.channels() == 3)
+			if(cx_undefined)
 			{
-				cv::cvtColor(captured_image, grayscale_image, CV_BGR2GRAY);				
-			}
-			else
+				cx = rows / 2.0f;
+				cy = cols / 2.0f;
+				
+			} else
 			{
-				grayscale_image = captured_image.clone();				
+				cx = m_cxPinPtr->GetValue();
+				cy = m_cyPinPtr->GetValue();
 			}
 
 
-			bool detection_success = DetectLandmarksInVideo(grayscale_image, clnf_model, det_parameters);
-			double detection_certainty = clnf_model.detection_certainty;
-
-			leftEyeVector = cv::Point3f(0, 0, -1);
-			rightEyeVector = cv::Point3f(0, 0, -1);
-
+			if(fx_undefined)
+			{
+				fx = 500 * ( rows / 640.0);
+				fy = 500 * ( cols / 480.0);
 
-			if (det_parameters.track_gaze && detection_success && clnf_model.eye_model)
+				fx = (fx + fy) / 2.0;
+				fy = fx;	
+			} else
 			{
-				FaceAnalysis::EstimateGaze(clnf_model, leftEyeVector, fx, fy, cx, cy, true);
-				FaceAnalysis::EstimateGaze(clnf_model, rightEyeVector, fx, fy, cx, cy, false);
+				fx = m_fxPinPtr->GetValue();
+				fy = m_fyPinPtr->GetValue();
+
 			}
 
+			FrameTag tag;
+			tag.creation_time = m_inFrameImagePtr->GetCreationTime();
+			tag.roi_offset = frame_ingestion.Offset();
 
-			m_outGazeEstimateLeftPtr->SetValue(leftEyeVector.x, leftEyeVector.y, leftEyeVector.z );
-			m_outGazeEstimateRightPtr->SetValue(rightEyeVector.x, rightEyeVector.y, rightEyeVector.z);
-			//riempire 	m_outProcessedImagePtr
+			// The model is fitted in the region of interest, which moves the optical centre
+			tag.fx = fx;
+			tag.fy = fy;
+			tag.cx = cx - tag.roi_offset.x;
+			tag.cy = cy - tag.roi_offset.y;
 
-			m_outGazeEstimateLeftPtr->SetCreationTime(_clockPtr->GetTime());
-			m_outGazeEstimateRightPtr->SetCreationTime(_clockPtr->GetTime());
-			//m_outProcessedImagePtr->SetCreationTime(_clockPtr->GetTime());
+			// Every output of this block comes from the eye models, so skip the rest of the part models (this does not require a model reset)
+			tag.feature_mask = GetRequestedFeatures();
 
-			fillPupilPosition();
+			FrameOutput output;
+			if(pipeline.Running())
+			{
+				// The frame is fitted on the worker, output the newest result if there is one that was not output yet
+				pipeline.Push(grayscale_image, tag);
+
+				double age;
+				if(pipeline.TakeLatest(output, tag, age))
+				{
+					PublishFrame(output, tag.creation_time, age);
+				}
+			}
+			else
+			{
+				int64 start = cv::getTickCount();
+				FitFrame(grayscale_image, tag, output);
+				PublishFrame(output, tag.creation_time, (cv::getTickCount() - start) / cv::getTickFrequency());
+			}
 
 			Notify_DebugString("Completing execute()");
 
@@ -536,33 +620,6 @@ bool CGazeEstimator::Execute() throw()
 	return true;
 }
 
-	void CGazeEstimator::PrepareCvImage(const image_ptr& sourceImagePtr, cv::Mat &destinationImage)
-	{
-		BOOST_ASSERT(sourceImagePtr);		
-
-		try
-		{
-			if (!sourceImagePtr)
-				return;
-			const RECT_2D_INT roi = sourceImagePtr->GetROI();
-
-			int width, height, step;
-			width = sourceImagePtr->GetWidth();
-			height = sourceImagePtr->GetHeight();
-			step = sourceImagePtr->GetStepSize();
-			if (sourceImagePtr->GetColorModel() == Eyw::ecmBW)
-				destinationImage = *(new cv::Mat(height, width, CV_8UC1, sourceImagePtr->GetBuffer(), step));
-			if ((sourceImagePtr->GetColorModel() == Eyw::ecmRGB) || (sourceImagePtr->GetColorModel() == Eyw::ecmBGR))
-				destinationImage = *(new cv::Mat(height, width, CV_8UC3, sourceImagePtr->GetBuffer(), step));
-			return;
-			
-		}
-		catch (const IException&)
-		{
-			return;
-		}
-	}
-
 
 //////////////////////////////////////////////////////////
 /// <summary>
@@ -574,6 +631,7 @@ void CGazeEstimator::Stop() throw()
 	try
 	{
 		Notify_DebugString("Stopping...\n");
+		pipeline.Stop();
 	}
 	catch(...)
 	{
@@ -596,6 +654,7 @@ void CGazeEstimator::Done() throw()
 		m_pupilRightPtr = NULL;
 		m_outLeftline = NULL;
 		m_outRightline = NULL;
+		m_outResultAgePtr = NULL;
 
 		Notify_DebugString("We are done\n");
 
@@ -617,117 +676,204 @@ void CGazeEstimator::Done() throw()
 //////////////////////////////////////////////////////////
 void CGazeEstimator::OnChangedParameter( const std::string& csParameterID )
 {
-	/// TODO: manage the changed parameters
 	if(IsRunTime())
 	{
-		clnf_model.Reset();
-		if (csParameterID == PAR_LIMIT_POSE)
-			det_parameters.limit_pose = m_limit_posePinPtr->GetValue();
-		else if (csParameterID == PAR_NUM_OPTIMIZATION_ITERATION)
-			det_parameters.num_optimisation_iteration = m_num_optimisation_iterationPinPtr->GetValue();
-		else if (csParameterID == PAR_REFINE_HIERARCHICAL)
-			det_parameters.refine_hierarchical = m_refine_hierarchicalPinPtr->GetValue();
-
-		else if (csParameterID == PAR_REFINE_PARAMETERS)
-			det_parameters.refine_parameters = m_refine_parametersPinPtr->GetValue();
-
-		else if (csParameterID == PAR_REG_FACTOR)
-			det_parameters.reg_factor = m_reg_factorPinPtr->GetValue();
-
-		else if (csParameterID == PAR_REINIT_VIDEO_EVERY)
-			det_parameters.reinit_video_every = m_reinit_video_everyPinPtr->GetValue();
-
-		else if (csParameterID == PAR_CX)
-			cx = m_cxPinPtr->GetValue();
-		else if (csParameterID == PAR_CY)
-			cy = m_cyPinPtr->GetValue();
-		else if (csParameterID == PAR_FX)
-			fx = m_fxPinPtr->GetValue();
-		else if (csParameterID == PAR_FY)
-			fy = m_fyPinPtr->GetValue();
-
-		else if(csParameterID == PAR_SIGMA)
-			det_parameters.sigma = m_sigmaPinPtr->GetValue();
-		else if(csParameterID == PAR_VALIDATION_BOUNDARY)
-			det_parameters.validation_boundary = m_validation_boundaryPinPtr->GetValue();
-		else if(csParameterID == PAR_WEIGHT_FACTOR)
-			det_parameters.weight_factor = m_weight_factorPinPtr->GetValue();
-
-		cx_undefined = cx == 0.0 || cy == 0.0;
-		fx_undefined = fx == 0.0 || fy == 0.0;
+		// The worker must not be fitting while the parameters or the model change
+		pipeline.Stop();
 
+		ApplyChangedParameter(csParameterID);
+
+		if(m_pipelinedPinPtr->GetValue())
+			StartPipeline();
 	}
-		
-	
 }
 
+// Only a new model resets the tracking, the fitting parameters apply from the next frame on and sigma only drops the
+// responses that were precalculated with it
+void CGazeEstimator::ApplyChangedParameter( const std::string& csParameterID )
+{
+	if (csParameterID == PAR_MODEL_LOCATION)
+	{
+		// The current model keeps tracking while the new one is read, it is swapped in by AdoptLoadedModel
+		model_loader.Load(GetComboParameterItem(PAR_MODEL_LOCATION, m_model_locationPinPtr->GetValue()));
+	}
+	else if(csParameterID == PAR_SIGMA)
+	{
+		det_parameters.sigma = m_sigmaPinPtr->GetValue();
+		clnf_model.InvalidateResponseCaches();
+	}
+	// The thread budget does not affect the tracking state, the arena is reconfigured on the next frame
+	else if (csParameterID == PAR_MAX_THREADS)
+		det_parameters.max_concurrency = m_max_threadsPinPtr->GetValue();
+	else if (csParameterID == PAR_PIN_FIRST_CORE)
+		det_parameters.pin_first_core = m_pin_first_corePinPtr->GetValue();
+
+	// The pipeline is restarted with the new settings by OnChangedParameter
+	else if (csParameterID == PAR_PIPELINED || csParameterID == PAR_LATENCY_BUDGET)
+		return;
+
+	else if (csParameterID == PAR_LIMIT_POSE)
+		det_parameters.limit_pose = m_limit_posePinPtr->GetValue();
+	else if (csParameterID == PAR_NUM_OPTIMIZATION_ITERATION)
+		det_parameters.num_optimisation_iteration = m_num_optimisation_iterationPinPtr->GetValue();
+	else if (csParameterID == PAR_REFINE_HIERARCHICAL)
+		det_parameters.refine_hierarchical = m_refine_hierarchicalPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REFINE_PARAMETERS)
+		det_parameters.refine_parameters = m_refine_parametersPinPtr->GetValue();
+	else if (csParameterID == PAR_MOTION_PREDICTION)
+		det_parameters.use_motion_prediction = m_motion_predictionPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REG_FACTOR)
+		det_parameters.reg_factor = m_reg_factorPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REINIT_VIDEO_EVERY)
+		det_parameters.reinit_video_every = m_reinit_video_everyPinPtr->GetValue();
+	else if (csParameterID == PAR_FULL_FIT_EVERY)
+		full_fit_every = m_full_fit_everyPinPtr->GetValue();
+
+	else if (csParameterID == PAR_CX)
+		cx = m_cxPinPtr->GetValue();
+	else if (csParameterID == PAR_CY)
+		cy = m_cyPinPtr->GetValue();
+	else if (csParameterID == PAR_FX)
+		fx = m_fxPinPtr->GetValue();
+	else if (csParameterID == PAR_FY)
+		fy = m_fyPinPtr->GetValue();
+
+	else if(csParameterID == PAR_VALIDATION_BOUNDARY)
+		det_parameters.validation_boundary = m_validation_boundaryPinPtr->GetValue();
+	else if(csParameterID == PAR_WEIGHT_FACTOR)
+		det_parameters.weight_factor = m_weight_factorPinPtr->GetValue();
+
+	cx_undefined = cx == 0.0 || cy == 0.0;
+	fx_undefined = fx == 0.0 || fy == 0.0;
+}
 
-void CGazeEstimator::fillPupilPosition()
+
+// The facial features needed by the connected output pins
+int CGazeEstimator::GetRequestedFeatures()
 {
-	int part_left = -1;
-	int part_right = -1;
-	for (size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
+	const char* outputs[] = { OUT_GAZEESTIMATELEFT, OUT_GAZEESTIMATERIGHT, OUT_PUPILLEFT, OUT_PUPILRIGHT, OUT_LINELEFT, OUT_LINERIGHT };
+
+	for(size_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); ++i)
 	{
-		if (clnf_model.hierarchical_model_names[i].compare("left_eye_28") == 0)
-		{
-			part_left = i;
-		}
-		if (clnf_model.hierarchical_model_names[i].compare("right_eye_28") == 0)
+		if(_signaturePtr->GetOutputs()->FindItem( outputs[i] )->IsConnected())
 		{
-			part_right = i;
+			return LandmarkDetector::FaceModelParameters::FEATURE_GAZE;
 		}
 	}
 
-	//3D representation of pupil position
-	cv::Mat eyeLdmks3d_left = clnf_model.hierarchical_models[part_left].GetShape(fx, fy, cx, cy);
-	cv::Point3f pupil_left = GetPupilPosition(eyeLdmks3d_left);
+	return 0;
+}
 
-	cv::Mat eyeLdmks3d_right = clnf_model.hierarchical_models[part_right].GetShape(fx, fy, cx, cy);
-	cv::Point3f pupil_right = GetPupilPosition(eyeLdmks3d_right);
+// Fitting the model to a frame and estimating the gaze (on the pipeline worker in pipelined mode)
+void CGazeEstimator::FitFrame(const cv::Mat& grayscale_frame, const FrameTag& tag, FrameOutput& o_output)
+{
+	cv::Mat_<uchar> grayscale_image = grayscale_frame;
 
+	det_parameters.feature_mask = tag.feature_mask;
 
-	vector<cv::Point3d> points_left;
-	points_left.push_back(cv::Point3d(pupil_left));
-	points_left.push_back(cv::Point3d(pupil_left + leftEyeVector*50.0));
+	// The model works in the coordinates of the region of interest, if its origin moved it is moved by as much in the other
+	// direction so that the tracking carries on from the same place in the image
+	if(tag.roi_offset != tracked_roi_offset)
+	{
+		clnf_model.Translate(tracked_roi_offset.x - tag.roi_offset.x, tracked_roi_offset.y - tag.roi_offset.y);
+		tracked_roi_offset = tag.roi_offset;
+	}
 
-	vector<cv::Point3d> points_right;
-	points_right.push_back(cv::Point3d(pupil_right));
-	points_right.push_back(cv::Point3d(pupil_right + rightEyeVector*50.0));
+	// In between the full fits only the eyes are refit, as long as the face is tracked (the eye fit refuses otherwise)
+	bool detection_success;
+	bool eyes_requested = (det_parameters.feature_mask & LandmarkDetector::FaceModelParameters::FEATURE_GAZE) && det_parameters.track_gaze;
+	if(eyes_requested && ++frames_since_full_fit < full_fit_every && LandmarkDetector::DetectEyesInVideo(grayscale_image, clnf_model, det_parameters, gaze_parts.left_eye, gaze_parts.right_eye))
+	{
+		detection_success = clnf_model.detection_success;
+	}
+	else
+	{
+		detection_success = DetectLandmarksInVideo(grayscale_image, clnf_model, det_parameters);
+		frames_since_full_fit = 0;
+	}
 
-	//Projection on a 2D image, Left
-	cv::Mat_<double> proj_points;
-	cv::Mat_<double> left_mesh = (cv::Mat_<double>(2, 3) << points_left[0].x, points_left[0].y, points_left[0].z, points_left[1].x, points_left[1].y, points_left[1].z);
-	LandmarkDetector::Project(proj_points, left_mesh, fx, fy, cx, cy);
+	o_output.left_gaze = cv::Point3f(0, 0, -1);
+	o_output.right_gaze = cv::Point3f(0, 0, -1);
+	o_output.has_pupils = false;
 
-	cv::Point projectedPupilLeft = cv::Point(cvRound(proj_points.at<double>(0, 0) ), cvRound(proj_points.at<double>(0, 1) /** (double)gaze_draw_multiplier*/));
-	cv::Point gazeLeftEndPoint = cv::Point(cvRound(proj_points.at<double>(1, 0)), cvRound(proj_points.at<double>(1, 1)));
+	if ((det_parameters.feature_mask & LandmarkDetector::FaceModelParameters::FEATURE_GAZE) && gaze_parts.Valid())
+	{
+		// Both eyes at once, the pupils are output (looking straight ahead) even when the detection failed
+		FaceAnalysis::BinocularGaze gaze;
+		FaceAnalysis::EstimateBinocularGaze(clnf_model, gaze_parts, tag.fx, tag.fy, tag.cx, tag.cy,
+			det_parameters.track_gaze && detection_success && clnf_model.eye_model, gaze);
+
+		o_output.left_gaze = gaze.gaze_left;
+		o_output.right_gaze = gaze.gaze_right;
+
+		// Projected on the region of interest, moved onto the whole input image
+		o_output.pupil_left = cv::Point(cvRound(gaze.pupil_left_image.x), cvRound(gaze.pupil_left_image.y)) + tag.roi_offset;
+		o_output.pupil_right = cv::Point(cvRound(gaze.pupil_right_image.x), cvRound(gaze.pupil_right_image.y)) + tag.roi_offset;
+		o_output.gaze_left_end = cv::Point(cvRound(gaze.gaze_left_end_image.x), cvRound(gaze.gaze_left_end_image.y)) + tag.roi_offset;
+		o_output.gaze_right_end = cv::Point(cvRound(gaze.gaze_right_end_image.x), cvRound(gaze.gaze_right_end_image.y)) + tag.roi_offset;
+		o_output.has_pupils = true;
+	}
+}
 
-	//Projection on a 2D image, Right
-	cv::Mat_<double> right_mesh = (cv::Mat_<double>(2, 3) << points_right[0].x, points_right[0].y, points_right[0].z, points_right[1].x, points_right[1].y, points_right[1].z);
-	LandmarkDetector::Project(proj_points, right_mesh, fx, fy, cx, cy);
+void CGazeEstimator::PublishFrame(const FrameOutput& output, Eyw::TIME creation_time, double age)
+{
+	m_outGazeEstimateLeftPtr->SetValue(output.left_gaze.x, output.left_gaze.y, output.left_gaze.z);
+	m_outGazeEstimateRightPtr->SetValue(output.right_gaze.x, output.right_gaze.y, output.right_gaze.z);
 
-	cv::Point projectedPupilRight = cv::Point(cvRound(proj_points.at<double>(0, 0) /** (double)gaze_draw_multiplier*/), cvRound(proj_points.at<double>(0, 1) /** (double)gaze_draw_multiplier*/));
-	cv::Point gazeRightEndPoint = cv::Point(cvRound(proj_points.at<double>(1, 0)), cvRound(proj_points.at<double>(1, 1)));
+	m_outGazeEstimateLeftPtr->SetCreationTime(creation_time);
+	m_outGazeEstimateRightPtr->SetCreationTime(creation_time);
 
-	//setting pupils position
-	m_pupilLeftPtr->SetValue(projectedPupilLeft.x, projectedPupilLeft.y);
-	m_pupilRightPtr->SetValue(projectedPupilRight.x, projectedPupilRight.y);
+	if (output.has_pupils)
+	{
+		//setting pupils position
+		m_pupilLeftPtr->SetValue(output.pupil_left.x, output.pupil_left.y);
+		m_pupilRightPtr->SetValue(output.pupil_right.x, output.pupil_right.y);
 
+		Eyw::point2d_int_ptr gazeLeft = Eyw::datatype<IPoint2DInt>::create(_kernelServicesPtr);
+		Eyw::point2d_int_ptr gazeRight = Eyw::datatype<IPoint2DInt>::create(_kernelServicesPtr);
+		gazeLeft->SetValue(output.gaze_left_end.x, output.gaze_left_end.y);
+		gazeRight->SetValue(output.gaze_right_end.x, output.gaze_right_end.y);
 
-	
-	Eyw::point2d_int_ptr gazeLeft = Eyw::datatype<IPoint2DInt>::create(_kernelServicesPtr);
-	Eyw::point2d_int_ptr gazeRight = Eyw::datatype<IPoint2DInt>::create(_kernelServicesPtr); ;
-	gazeLeft->SetValue(gazeLeftEndPoint.x, gazeLeftEndPoint.y);
-	gazeRight->SetValue(gazeRightEndPoint.x, gazeRightEndPoint.y);
+		m_outLeftline->SetValue(m_pupilLeftPtr->GetValue(), gazeLeft->GetValue());
+		m_outRightline->SetValue(m_pupilRightPtr->GetValue(), gazeRight->GetValue());
 
-	m_outLeftline->SetValue(m_pupilLeftPtr->GetValue(), gazeLeft->GetValue());
-	m_outRightline->SetValue(m_pupilRightPtr->GetValue(), gazeRight->GetValue());
+		m_pupilLeftPtr->SetCreationTime(creation_time);
+		m_pupilRightPtr->SetCreationTime(creation_time);
 
-	m_pupilLeftPtr->SetCreationTime(_clockPtr->GetTime());
-	m_pupilRightPtr->SetCreationTime(_clockPtr->GetTime());
+		m_outLeftline->SetCreationTime(creation_time);
+		m_outRightline->SetCreationTime(creation_time);
+	}
 
-	m_outLeftline->SetCreationTime(_clockPtr->GetTime());
-	m_outRightline->SetCreationTime(_clockPtr->GetTime());
+	m_outResultAgePtr->SetValue(age);
+	m_outResultAgePtr->SetCreationTime(creation_time);
+}
 
+// Swapping in a model that finished loading in the background, the tracking starts again with it
+void CGazeEstimator::AdoptLoadedModel()
+{
+	if(!model_loader.Loaded())
+		return;
+
+	// The worker must not be fitting with the model that is replaced
+	bool pipelined = pipeline.Running();
+	pipeline.Stop();
+
+	model_loader.TakeLoaded(clnf_model, det_parameters.model_location);
+	clnf_model.Reset();
+	gaze_parts = FaceAnalysis::FindGazeParts(clnf_model);
+
+	if(pipelined)
+		StartPipeline();
+}
+
+void CGazeEstimator::StartPipeline()
+{
+	double latency_budget = m_latency_budgetPinPtr->GetValue() / 1000.0;
 
+	pipeline.Start([this](const cv::Mat& frame, const FrameTag& tag, FrameOutput& o_output){ FitFrame(frame, tag, o_output); },
+		latency_budget > 0 ? LandmarkDetector::FramePipeline<FrameTag, FrameOutput>::KEEP_WITHIN_BUDGET : LandmarkDetector::FramePipeline<FrameTag, FrameOutput>::KEEP_LATEST,
+		8, latency_budget);
 }
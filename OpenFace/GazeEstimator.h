@@ -6,6 +6,10 @@
 #include <opencv2/core/mat.hpp>
 #include "./include/LandmarkDetectorParameters.h"
 #include "./include/LandmarkDetectorModel.h"
+#include "./include/GazeEstimation.h"
+#include "./include/FramePipeline.h"
+#include "./include/BackgroundModelLoader.h"
+#include "FrameIngestion.h"
 #include "BaseCatalog/EywGraphicLine2D.h"
 
 class CGazeEstimator : public Eyw::CBlockImpl
@@ -118,10 +122,20 @@ private:
 	Eyw::bool_ptr m_limit_posePinPtr;
 	Eyw::bool_ptr m_refine_hierarchicalPinPtr;
 	Eyw::bool_ptr m_refine_parametersPinPtr;
+	Eyw::bool_ptr m_motion_predictionPinPtr;
 
 	//int ptrs
 	Eyw::int_ptr m_num_optimisation_iterationPinPtr;
 	Eyw::int_ptr m_reinit_video_everyPinPtr;
+	Eyw::int_ptr m_max_threadsPinPtr;
+	Eyw::int_ptr m_pin_first_corePinPtr;
+
+	//pipelined mode
+	Eyw::bool_ptr m_pipelinedPinPtr;
+	Eyw::double_ptr m_latency_budgetPinPtr;
+
+	//eye-only fitting in between the full fits
+	Eyw::int_ptr m_full_fit_everyPinPtr;
 
 	//double ptrs
 	Eyw::double_ptr m_validation_boundaryPinPtr;
@@ -149,13 +163,44 @@ private:
 	Eyw::graphic_line2d_int_ptr m_outLeftline;
 	Eyw::graphic_line2d_int_ptr m_outRightline;
 
+	Eyw::double_ptr m_outResultAgePtr;
+
+	// What is output for a frame, handed over from the pipeline worker in pipelined mode
+	struct FrameOutput
+	{
+		cv::Point3f left_gaze;
+		cv::Point3f right_gaze;
+
+		// Set when the eye models were fitted
+		bool has_pupils;
+		cv::Point pupil_left, pupil_right;
+		cv::Point gaze_left_end, gaze_right_end;
+	};
+
+	// The camera parameters are those of the frame the result belongs to
+	struct FrameTag
+	{
+		Eyw::TIME creation_time;
+		int feature_mask;
+
+		// The optical centre is relative to the region of interest the frame was cut from, which starts at roi_offset
+		double fx, fy, cx, cy;
+		cv::Point roi_offset;
+	};
+
 	Eyw::POINT_2D point;
 
 	//Eyw::image_ptr m_outProcessedImagePtr;
 
 	//utility function
-	void PrepareCvImage(const Eyw::image_ptr& sourceImagePtr, cv::Mat& destinationImage);
-	void fillPupilPosition();
+	int GetRequestedFeatures();
+	void ApplyChangedParameter( const std::string& csParameterID );
+
+	// Fitting (on the pipeline worker in pipelined mode) and outputting of a frame
+	void FitFrame(const cv::Mat& grayscale_frame, const FrameTag& tag, FrameOutput& o_output);
+	void PublishFrame(const FrameOutput& output, Eyw::TIME creation_time, double age);
+	void StartPipeline();
+	void AdoptLoadedModel();
 
 	/*
 	 *
@@ -172,10 +217,23 @@ private:
 	LandmarkDetector::CLNF clnf_model;
 	LandmarkDetector::FaceModelParameters det_parameters = LandmarkDetector::FaceModelParameters();
 
-	cv::Point3f leftEyeVector; 
-	cv::Point3f rightEyeVector;
+	// Where the region of interest the models currently track in starts, they are moved along when it moves
+	cv::Point tracked_roi_offset;
+
+	// The eye models of clnf_model, found when it is loaded
+	FaceAnalysis::GazeParts gaze_parts;
+
+	// The face is fit every full_fit_every frames, in between only the eye models (counted on the thread that fits)
+	int full_fit_every = 1;
+	int frames_since_full_fit = 0;
+
+	// Fits the frames on a worker thread in pipelined mode
+	LandmarkDetector::FramePipeline<FrameTag, FrameOutput> pipeline;
+
+	// Reads the model chosen at run time without stopping the tracking
+	LandmarkDetector::BackgroundModelLoader model_loader;
 
-	cv::Mat captured_image;
+	FrameIngestion frame_ingestion;
 
 	int frame_count = 0;
 
@@ -0,0 +1,83 @@
+#include "stdafx.h"
+#include "LabelledPointsOutput.h"
+
+using namespace Eyw;
+
+LabelledPointsOutput::LabelledPointsOutput()
+{
+}
+
+void LabelledPointsOutput::Init(const graphic_labelled_set_2d_double_ptr& set, const graphic_point2d_double_ptr& point)
+{
+	this->set = set;
+	this->point = point;
+
+	entries.clear();
+	published.clear();
+}
+
+void LabelledPointsOutput::Done()
+{
+	set = NULL;
+	point = 0;
+
+	entries.clear();
+	published.clear();
+}
+
+const std::string& LabelledPointsOutput::Label(int index, int group)
+{
+	std::deque<std::string>& group_labels = labels[group];
+
+	while((int)group_labels.size() <= index)
+	{
+		int i = (int)group_labels.size();
+		group_labels.push_back(group < 0 ? std::to_string(i) : std::to_string(group) + "_" + std::to_string(i));
+	}
+
+	return group_labels[index];
+}
+
+void LabelledPointsOutput::Begin()
+{
+	// Keeps the capacity, so nothing is allocated once the number of points is steady
+	entries.clear();
+}
+
+void LabelledPointsOutput::Add(const std::string& label, double x, double y)
+{
+	Entry entry;
+	entry.label = &label;
+	entry.x = x;
+	entry.y = y;
+	entries.push_back(entry);
+}
+
+void LabelledPointsOutput::End()
+{
+	bool same_labels = entries.size() == published.size();
+	for(size_t i = 0; i < entries.size() && same_labels; ++i)
+	{
+		same_labels = entries[i].label == published[i];
+	}
+
+	if(same_labels)
+	{
+		for(size_t i = 0; i < entries.size(); ++i)
+		{
+			Eyw::Cast<Eyw::IGraphicPoint2DDouble*>(set->GetItem(entries[i].label->c_str()))->SetValue(entries[i].x, entries[i].y);
+		}
+	}
+	else
+	{
+		set->Clear();
+		published.resize(entries.size());
+
+		for(size_t i = 0; i < entries.size(); ++i)
+		{
+			point->SetValue(entries[i].x, entries[i].y);
+			set->Insert(entries[i].label->c_str(), point.get());
+			published[i] = entries[i].label;
+		}
+	}
+}
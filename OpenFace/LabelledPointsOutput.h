@@ -0,0 +1,51 @@
+#pragma once
+#include "StdAfx.h"
+#include "BaseCatalog/EywGraphicPoint2D.h"
+#include "BaseCatalog/EywGraphicLabelledSet2D.h"
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// Filling a labelled set of 2D points output frame after frame. The labels are built once and kept, and when a frame has
+// the same labels as the previous one the points are updated in place instead of clearing the set and inserting them again
+class LabelledPointsOutput
+{
+public:
+
+	LabelledPointsOutput();
+
+	// The set to fill, and the point datatype used to insert new entries
+	void Init(const Eyw::graphic_labelled_set_2d_double_ptr& set, const Eyw::graphic_point2d_double_ptr& point);
+
+	// Release the datatypes
+	void Done();
+
+	// The label of a point: its index (e.g. "17"), or the group and the index (e.g. "3_17", as for the faces of a multiple face
+	// tracker) if group is not negative. The reference stays valid for the life of this object
+	const std::string& Label(int index, int group = -1);
+
+	// The points of a frame are added between Begin and End, which writes them to the set
+	void Begin();
+	void Add(const std::string& label, double x, double y);
+	void End();
+
+private:
+
+	Eyw::graphic_labelled_set_2d_double_ptr set;
+	Eyw::graphic_point2d_double_ptr point;
+
+	// By group (-1 for the plain indices), a deque so that the labels never move
+	std::map<int, std::deque<std::string> > labels;
+
+	struct Entry
+	{
+		const std::string* label;
+		double x;
+		double y;
+	};
+
+	// The entries of the frame being added, and the labels in the set
+	std::vector<Entry> entries;
+	std::vector<const std::string*> published;
+};
@@ -40,9 +40,15 @@ Eyw::block_class_registrant g_Landmarksdetector(
 #define PAR_LIMIT_POSE "limit_posePin" //bool
 #define PAR_REFINE_HIERARCHICAL "refine_hierarchicalPin" //bool
 #define PAR_REFINE_PARAMETERS "refine_parametersPin" //bool
+#define PAR_MOTION_PREDICTION "motion_predictionPin" //bool
 
 #define PAR_REINIT_VIDEO_EVERY "reinit_video_everyPin" //int
 #define PAR_NUM_OPTIMIZATION_ITERATION "num_optimisation_iterationPin" //int
+#define PAR_MAX_THREADS "max_threadsPin" //int
+#define PAR_PIN_FIRST_CORE "pin_first_corePin" //int
+#define PAR_MAX_FACES "max_facesPin" //int
+#define PAR_PIPELINED "pipelinedPin" //bool
+#define PAR_LATENCY_BUDGET "latency_budgetPin" //double
 
 #define PAR_VALIDATION_BOUNDARY "validation_boundaryPin" //double
 #define PAR_SIGMA "sigmaPin" //double
@@ -56,6 +62,8 @@ Eyw::block_class_registrant g_Landmarksdetector(
 #define IN_FRAMEIMAGE "Frame/Image"
 #define OUT_LANDMARKS "Landmarks"
 #define OUT_LANDMARKS_EYE "Eyeball Landmarks"
+#define OUT_LANDMARKS_ARRAY "Landmarks Array"
+#define OUT_RESULT_AGE "Result Age"
 
 //////////////////////////////////////////////////////////
 /// <summary>
@@ -68,6 +76,8 @@ CLandmarksdetector::CLandmarksdetector( const Eyw::OBJECT_CREATIONCTX* ctxPtr )
 	m_inFrameImagePtr=NULL;
 	m_outLandmarksPtr = NULL;
 	m_outLandmarksEyePtr = NULL;
+	m_outLandmarksArrayPtr = NULL;
+	m_outResultAgePtr = NULL;
 	_schedulingInfoPtr->SetActivationEventBased( true );
 	_schedulingInfoPtr->GetEventBasedActivationInfo()->SetActivationOnInputChanged( IN_FRAMEIMAGE, true );
 }
@@ -132,6 +142,14 @@ void CLandmarksdetector::InitSignature()
 							 )->GetDatatype() );
 	m_refine_parametersPinPtr->SetValue(true);
 
+	m_motion_predictionPinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_MOTION_PREDICTION)
+							 .name("Motion prediction")
+							 .description("Start tracking each frame from where the face motion predicts it, keeping the search windows small while the predictions are good")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_motion_predictionPinPtr->SetValue(false);
+
 	m_num_optimisation_iterationPinPtr= Eyw::Cast<Eyw::IInt*>(
 						 SetParameter(Eyw::pin::id(PAR_NUM_OPTIMIZATION_ITERATION)
 							 .name("Number of optimisation iterations")
@@ -150,6 +168,52 @@ void CLandmarksdetector::InitSignature()
 							 )->GetDatatype() );
 	m_reinit_video_everyPinPtr->SetValue(4);
 
+	m_max_threadsPinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_MAX_THREADS)
+							 .name("Max threads")
+							 .description("How many worker threads this block may use for the detection (0 to share all of the threads with the other blocks)")
+							 .type<Eyw::IInt>()
+							 .set_int_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_max_threadsPinPtr->SetValue(0);
+
+	m_pin_first_corePinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_PIN_FIRST_CORE)
+							 .name("Pin to first core")
+							 .description("Pin the worker threads of this block to the cores starting from this one (negative not to pin, only used if max threads is set)")
+							 .type<Eyw::IInt>()
+							 )->GetDatatype() );
+	m_pin_first_corePinPtr->SetValue(-1);
+
+	m_max_facesPinPtr= Eyw::Cast<Eyw::IInt*>(
+						 SetParameter(Eyw::pin::id(PAR_MAX_FACES)
+							 .name("Max faces")
+							 .description("How many faces to track at once, with more than one the landmarks of every face are output with labels prefixed by the face id")
+							 .type<Eyw::IInt>()
+							 .set_int_domain()
+							 .min(1)
+							 )->GetDatatype() );
+	m_max_facesPinPtr->SetValue(1);
+
+	m_pipelinedPinPtr= Eyw::Cast<Eyw::IBool*>(
+						 SetParameter(Eyw::pin::id(PAR_PIPELINED)
+							 .name("Pipelined")
+							 .description("Fit the frames on a worker thread, each execution returns immediately and outputs the newest result that is ready")
+							 .type<Eyw::IBool>()
+							 )->GetDatatype() );
+	m_pipelinedPinPtr->SetValue(false);
+
+	m_latency_budgetPinPtr= Eyw::Cast<Eyw::IDouble*>(
+						 SetParameter(Eyw::pin::id(PAR_LATENCY_BUDGET)
+							 .name("Latency budget (ms)")
+							 .description("In pipelined mode, 0 only keeps the latest frame waiting, otherwise all of the frames are fitted as long as they have not waited longer than this")
+							 .type<Eyw::IDouble>()
+							 .set_double_domain()
+							 .min(0)
+							 )->GetDatatype() );
+	m_latency_budgetPinPtr->SetValue(0);
+
 
 
 	m_validation_boundaryPinPtr= Eyw::Cast<Eyw::IDouble*>(
@@ -245,6 +309,18 @@ void CLandmarksdetector::InitSignature()
 		.type < Eyw::IGraphicLabelledSet2DDouble > ()
 		);
 
+	SetOutput(Eyw::pin::id(OUT_LANDMARKS_ARRAY)
+		.name("Landmarks array")
+		.description("The facial landmarks as a flat array of 2D normalized coordinates, all of the x coordinates of a face followed by its y ones, face after face")
+		.type < Eyw::IDoubleMatrix > ()
+		);
+
+	SetOutput(Eyw::pin::id(OUT_RESULT_AGE)
+		.name("Result age")
+		.description("Time in seconds from the arrival of the frame the landmarks come from to their output")
+		.type < Eyw::IDouble > ()
+		);
+
 }
 
 //////////////////////////////////////////////////////////
@@ -259,10 +335,16 @@ void CLandmarksdetector::CheckSignature()
 	m_limit_posePinPtr=get_parameter_datatype<Eyw::IBool>(PAR_LIMIT_POSE);
 	m_refine_hierarchicalPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_REFINE_HIERARCHICAL);
 	m_refine_parametersPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_REFINE_PARAMETERS);
+	m_motion_predictionPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_MOTION_PREDICTION);
 
 	//int ptrs
 	m_num_optimisation_iterationPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_NUM_OPTIMIZATION_ITERATION);
 	m_reinit_video_everyPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_REINIT_VIDEO_EVERY);
+	m_max_threadsPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_MAX_THREADS);
+	m_pin_first_corePinPtr=get_parameter_datatype<Eyw::IInt>(PAR_PIN_FIRST_CORE);
+	m_max_facesPinPtr=get_parameter_datatype<Eyw::IInt>(PAR_MAX_FACES);
+	m_pipelinedPinPtr=get_parameter_datatype<Eyw::IBool>(PAR_PIPELINED);
+	m_latency_budgetPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_LATENCY_BUDGET);
 
 	//double ptrs
 	m_validation_boundaryPinPtr=get_parameter_datatype<Eyw::IDouble>(PAR_VALIDATION_BOUNDARY);
@@ -278,6 +360,8 @@ void CLandmarksdetector::CheckSignature()
 	_signaturePtr->GetInputs()->FindItem( IN_FRAMEIMAGE );
 	_signaturePtr->GetOutputs()->FindItem( OUT_LANDMARKS );
 	_signaturePtr->GetOutputs()->FindItem( OUT_LANDMARKS_EYE );
+	_signaturePtr->GetOutputs()->FindItem( OUT_LANDMARKS_ARRAY );
+	_signaturePtr->GetOutputs()->FindItem( OUT_RESULT_AGE );
 }
 
 //////////////////////////////////////////////////////////
@@ -290,10 +374,16 @@ void CLandmarksdetector::DoneSignature()
 	m_limit_posePinPtr=NULL;
 	m_refine_hierarchicalPinPtr=NULL;
 	m_refine_parametersPinPtr=NULL;
+	m_motion_predictionPinPtr=NULL;
 
 	//int ptrs
 	m_num_optimisation_iterationPinPtr=NULL;
 	m_reinit_video_everyPinPtr=NULL;
+	m_max_threadsPinPtr=NULL;
+	m_pin_first_corePinPtr=NULL;
+	m_max_facesPinPtr=NULL;
+	m_pipelinedPinPtr=NULL;
+	m_latency_budgetPinPtr=NULL;
 
 	//double ptrs
 	m_validation_boundaryPinPtr=NULL;
@@ -341,6 +431,13 @@ bool CLandmarksdetector::Init() throw()
 			m_outLandmarksEyePtr->InitInstance(listInitInfoPtr2.get());
 
 			m_pointPtr = datatype<Eyw::IGraphicPoint2DDouble>::create(_kernelServicesPtr);
+
+		landmarks_output.Init(m_outLandmarksPtr, m_pointPtr);
+		eye_landmarks_output.Init(m_outLandmarksEyePtr, m_pointPtr);
+
+		m_outLandmarksArrayPtr = get_output_datatype<Eyw::IDoubleMatrix>(OUT_LANDMARKS_ARRAY);
+
+		m_outResultAgePtr = get_output_datatype<Eyw::IDouble>(OUT_RESULT_AGE);
 		//m_outLandmarksPtr = get_output_datatype<Eyw::IGraphicPoint2DDouble>( OUT_LANDMARKS );
 		
 		/*list_init_info_ptr listInitInfoPtr = datatype_init_info<IListInitInfo>::create(_kernelServicesPtr);
@@ -351,14 +448,28 @@ bool CLandmarksdetector::Init() throw()
 		det_parameters.model_location = GetComboParameterItem(PAR_MODEL_LOCATION, m_model_locationPinPtr->GetValue());
 
 		clnf_model = LandmarkDetector::CLNF(det_parameters.model_location);
+		multi_face_tracker.max_faces = m_max_facesPinPtr->GetValue();
+
+		// The labels of a single face are built here rather than while outputting the first frames (two eyes of 28 landmarks)
+		for(int i = 0; i < clnf_model.pdm.NumberOfPoints(); ++i)
+		{
+			landmarks_output.Label(i);
+		}
+		for(int i = 0; i < 2 * 28; ++i)
+		{
+			eye_landmarks_output.Label(i);
+		}
 
 		det_parameters.track_gaze = true;
 		det_parameters.limit_pose = m_limit_posePinPtr->GetValue();
 		det_parameters.refine_hierarchical = m_refine_hierarchicalPinPtr->GetValue();
 		det_parameters.refine_parameters = m_refine_parametersPinPtr->GetValue();
+		det_parameters.use_motion_prediction = m_motion_predictionPinPtr->GetValue();
 
 		det_parameters.num_optimisation_iteration = m_num_optimisation_iterationPinPtr->GetValue();
 		det_parameters.reinit_video_every = m_reinit_video_everyPinPtr->GetValue();
+		det_parameters.max_concurrency = m_max_threadsPinPtr->GetValue();
+		det_parameters.pin_first_core = m_pin_first_corePinPtr->GetValue();
 
 		det_parameters.reg_factor = m_reg_factorPinPtr->GetValue();
 		det_parameters.weight_factor = m_weight_factorPinPtr->GetValue();
@@ -402,7 +513,10 @@ bool CLandmarksdetector::Start() throw()
     try
     {
 		Notify_DebugString("Start\n");
-    	/// TODO: add your logic
+
+		if(m_pipelinedPinPtr->GetValue())
+			StartPipeline();
+
     	return true;
     }
     catch(...)
@@ -424,74 +538,73 @@ bool CLandmarksdetector::Execute() throw()
     try
 	{
 
-		int rows = m_inFrameImagePtr->GetHeight();
-		int cols = m_inFrameImagePtr->GetWidth();
+		AdoptLoadedModel();
 
-		m_outLandmarksPtr->Clear();
-		m_outLandmarksEyePtr->Clear();
+		// The gray frame points into the input image, or into the buffer of the ingestion for colour images
+		cv::Mat_<uchar> grayscale_image;
 
-		labelCount = 0;
-		labelCount_2 = 0;
+		if(frame_ingestion.GetGray(m_inFrameImagePtr, grayscale_image))
+		{
+			int rows = frame_ingestion.Height();
+			int cols = frame_ingestion.Width();
 
-		cv::Mat output_image;
+			normFacX = cols;
+			normFacY = rows;
 
-		PrepareCvImage(m_inFrameImagePtr, captured_image);
-		
-		captured_image.copyTo(output_image);
+			if(cx_undefined)
+			{
+				cx = rows / 2.0f;
+				cy = cols / 2.0f;
+				
+			} else
+			{
+				cx = m_cxPinPtr->GetValue();
+				cy = m_cyPinPtr->GetValue();
+			}
 
-		if(cx_undefined)
-		{
-			cx = rows / 2.0f;
-			cy = cols / 2.0f;
-			
-		} else
-		{
-			cx = m_cxPinPtr->GetValue();
-			cy = m_cyPinPtr->GetValue();
-		}
 
+			if(fx_undefined)
+			{
+				fx = 500 * ( rows / 640.0);
+				fy = 500 * ( cols / 480.0);
 
-		if(fx_undefined)
-		{
-			fx = 500 * ( rows / 640.0);
-			fy = 500 * ( cols / 480.0);
+				fx = (fx + fy) / 2.0;
+				fy = fx;	
+			} else
+			{
+				fx = m_fxPinPtr->GetValue();
+				fy = m_fyPinPtr->GetValue();
 
-			fx = (fx + fy) / 2.0;
-			fy = fx;	
-		} else
-		{
-			fx = m_fxPinPtr->GetValue();
-			fy = m_fyPinPtr->GetValue();
+			}
 
-		}
+			//Notify_DebugString("Part 1\n");
 
+			FrameTag tag;
+			tag.creation_time = m_inFrameImagePtr->GetCreationTime();
+			tag.roi_offset = frame_ingestion.Offset();
 
-		if(!captured_image.empty())
-		{
-			// Reading the images
-			cv::Mat_<uchar> grayscale_image;
+			// Only refine the parts of the face that a connected output needs (this does not require a model reset)
+			tag.feature_mask = GetRequestedFeatures();
 
-			if(captured_image.channels() == 3)
+			FrameOutput output;
+			if(pipeline.Running())
 			{
-				cv::cvtColor(captured_image, grayscale_image, CV_BGR2GRAY);				
+				// The frame is fitted on the worker, output the newest result if there is one that was not output yet
+				pipeline.Push(grayscale_image, tag);
+
+				double age;
+				if(pipeline.TakeLatest(output, tag, age))
+				{
+					PublishFrame(output, tag.creation_time, age);
+				}
 			}
 			else
 			{
-				grayscale_image = captured_image.clone();				
+				int64 start = cv::getTickCount();
+				FitFrame(grayscale_image, tag, output);
+				PublishFrame(output, tag.creation_time, (cv::getTickCount() - start) / cv::getTickFrequency());
 			}
 
-			//Notify_DebugString("Part 1\n");
-
-			
-
-			bool detection_success = DetectLandmarksInVideo(grayscale_image, clnf_model, det_parameters);
-			double detection_certainty = clnf_model.detection_certainty;
-
-			double threshold = 0.2;
-
-			if (detection_certainty < threshold)
-				DrawLandmark(clnf_model);
-
 			/*landmarks = cv::Mat();
 
 			landmarks = clnf_model.detected_landmarks;
@@ -513,9 +626,6 @@ bool CLandmarksdetector::Execute() throw()
 			}
 
 			//Notify_DebugString(str);*/
-			
-			m_outLandmarksPtr->SetCreationTime(_clockPtr->GetTime());
-			m_outLandmarksEyePtr->SetCreationTime(_clockPtr->GetTime());
 			return true;
 			Notify_DebugString("Completing execute()");
 		}
@@ -536,35 +646,6 @@ bool CLandmarksdetector::Execute() throw()
 	return true;
 }
 
-void CLandmarksdetector::PrepareCvImage(const image_ptr& sourceImagePtr, cv::Mat &destinationImage)
-	{
-		BOOST_ASSERT(sourceImagePtr);		
-
-		try
-		{
-			if (!sourceImagePtr)
-				return;
-			const RECT_2D_INT roi = sourceImagePtr->GetROI();
-
-			int width, height, step;
-			width = sourceImagePtr->GetWidth();
-			height = sourceImagePtr->GetHeight();
-			normFacX = width;
-			normFacY = height;
-			step = sourceImagePtr->GetStepSize();
-			if (sourceImagePtr->GetColorModel() == Eyw::ecmBW)
-				destinationImage = *(new cv::Mat(height, width, CV_8UC1, sourceImagePtr->GetBuffer(), step));
-			if ((sourceImagePtr->GetColorModel() == Eyw::ecmRGB) || (sourceImagePtr->GetColorModel() == Eyw::ecmBGR))
-				destinationImage = *(new cv::Mat(height, width, CV_8UC3, sourceImagePtr->GetBuffer(), step));
-			return;
-			
-		}
-		catch (const IException&)
-		{
-			return;
-		}
-	}
-
 
 //////////////////////////////////////////////////////////
 /// <summary>
@@ -576,6 +657,7 @@ void CLandmarksdetector::Stop() throw()
     try
 	{
 		Notify_DebugString("Stopping...\n");
+		pipeline.Stop();
 	}
 	catch(...)
 	{
@@ -593,7 +675,12 @@ void CLandmarksdetector::Done() throw()
 	{
 		m_inFrameImagePtr = NULL;
 		m_outLandmarksPtr = NULL;
+		landmarks_output.Done();
+		eye_landmarks_output.Done();
+
 		m_outLandmarksEyePtr = NULL;
+		m_outLandmarksArrayPtr = NULL;
+		m_outResultAgePtr = NULL;
 		m_pointPtr = 0;
 		Notify_DebugString("We are done\n");
 
@@ -617,120 +704,328 @@ void CLandmarksdetector::OnChangedParameter( const std::string& csParameterID )
 {
 	if(IsRunTime())
 	{
+		// The worker must not be fitting while the parameters or the model change
+		pipeline.Stop();
+
+		ApplyChangedParameter(csParameterID);
+
+		if(m_pipelinedPinPtr->GetValue())
+			StartPipeline();
+	}
+}
+
+// Only the parameters that change what is being tracked reset the tracking, the fitting parameters apply from the next frame on
+// (the faces keep being tracked) and sigma only drops the responses that were precalculated with it
+void CLandmarksdetector::ApplyChangedParameter( const std::string& csParameterID )
+{
+	if (csParameterID == PAR_MAX_FACES)
+	{
+		// Switching between the single and multiple face modes starts the tracking again
+		multi_face_tracker.max_faces = m_max_facesPinPtr->GetValue();
+		multi_face_tracker.Reset();
 		clnf_model.Reset();
-		if (csParameterID == PAR_LIMIT_POSE)
-			det_parameters.limit_pose = m_limit_posePinPtr->GetValue();
-		else if (csParameterID == PAR_NUM_OPTIMIZATION_ITERATION)
-			det_parameters.num_optimisation_iteration = m_num_optimisation_iterationPinPtr->GetValue();
-		else if (csParameterID == PAR_REFINE_HIERARCHICAL)
-			det_parameters.refine_hierarchical = m_refine_hierarchicalPinPtr->GetValue();
-
-		else if (csParameterID == PAR_REFINE_PARAMETERS)
-			det_parameters.refine_parameters = m_refine_parametersPinPtr->GetValue();
-
-		else if (csParameterID == PAR_REG_FACTOR)
-			det_parameters.reg_factor = m_reg_factorPinPtr->GetValue();
-
-		else if (csParameterID == PAR_REINIT_VIDEO_EVERY)
-			det_parameters.reinit_video_every = m_reinit_video_everyPinPtr->GetValue();
-
-		else if (csParameterID == PAR_CX)
-			cx = m_cxPinPtr->GetValue();
-		else if (csParameterID == PAR_CY)
-			cy = m_cyPinPtr->GetValue();
-		else if (csParameterID == PAR_FX)
-			fx = m_fxPinPtr->GetValue();
-		else if (csParameterID == PAR_FY)
-			fy = m_fyPinPtr->GetValue();
-
-		else if(csParameterID == PAR_SIGMA)
-			det_parameters.sigma = m_sigmaPinPtr->GetValue();
-		else if(csParameterID == PAR_VALIDATION_BOUNDARY)
-			det_parameters.validation_boundary = m_validation_boundaryPinPtr->GetValue();
-		else if(csParameterID == PAR_WEIGHT_FACTOR)
-			det_parameters.weight_factor = m_weight_factorPinPtr->GetValue();
-
-		cx_undefined = cx == 0.0 || cy == 0.0;
-		fx_undefined = fx == 0.0 || fy == 0.0;
+	}
+	else if (csParameterID == PAR_MODEL_LOCATION)
+	{
+		// The current model keeps tracking while the new one is read, it is swapped in by AdoptLoadedModel
+		model_loader.Load(GetComboParameterItem(PAR_MODEL_LOCATION, m_model_locationPinPtr->GetValue()));
+	}
+	else if(csParameterID == PAR_SIGMA)
+	{
+		det_parameters.sigma = m_sigmaPinPtr->GetValue();
+		clnf_model.InvalidateResponseCaches();
+		multi_face_tracker.InvalidateResponseCaches();
+	}
+	// The thread budget does not affect the tracking state, the arena is reconfigured on the next frame
+	else if (csParameterID == PAR_MAX_THREADS)
+		det_parameters.max_concurrency = m_max_threadsPinPtr->GetValue();
+	else if (csParameterID == PAR_PIN_FIRST_CORE)
+		det_parameters.pin_first_core = m_pin_first_corePinPtr->GetValue();
+
+	// The pipeline is restarted with the new settings by OnChangedParameter
+	else if (csParameterID == PAR_PIPELINED || csParameterID == PAR_LATENCY_BUDGET)
+		return;
+
+	else if (csParameterID == PAR_LIMIT_POSE)
+		det_parameters.limit_pose = m_limit_posePinPtr->GetValue();
+	else if (csParameterID == PAR_NUM_OPTIMIZATION_ITERATION)
+		det_parameters.num_optimisation_iteration = m_num_optimisation_iterationPinPtr->GetValue();
+	else if (csParameterID == PAR_REFINE_HIERARCHICAL)
+		det_parameters.refine_hierarchical = m_refine_hierarchicalPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REFINE_PARAMETERS)
+		det_parameters.refine_parameters = m_refine_parametersPinPtr->GetValue();
+	else if (csParameterID == PAR_MOTION_PREDICTION)
+		det_parameters.use_motion_prediction = m_motion_predictionPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REG_FACTOR)
+		det_parameters.reg_factor = m_reg_factorPinPtr->GetValue();
+
+	else if (csParameterID == PAR_REINIT_VIDEO_EVERY)
+		det_parameters.reinit_video_every = m_reinit_video_everyPinPtr->GetValue();
+
+	else if (csParameterID == PAR_CX)
+		cx = m_cxPinPtr->GetValue();
+	else if (csParameterID == PAR_CY)
+		cy = m_cyPinPtr->GetValue();
+	else if (csParameterID == PAR_FX)
+		fx = m_fxPinPtr->GetValue();
+	else if (csParameterID == PAR_FY)
+		fy = m_fyPinPtr->GetValue();
 
+	else if(csParameterID == PAR_VALIDATION_BOUNDARY)
+		det_parameters.validation_boundary = m_validation_boundaryPinPtr->GetValue();
+	else if(csParameterID == PAR_WEIGHT_FACTOR)
+		det_parameters.weight_factor = m_weight_factorPinPtr->GetValue();
+
+	cx_undefined = cx == 0.0 || cy == 0.0;
+	fx_undefined = fx == 0.0 || fy == 0.0;
+
+}
+
+// The facial features needed by the connected output pins
+int CLandmarksdetector::GetRequestedFeatures()
+{
+	int features = 0;
+
+	if(_signaturePtr->GetOutputs()->FindItem( OUT_LANDMARKS )->IsConnected())
+	{
+		features |= LandmarkDetector::FaceModelParameters::FEATURE_CONTOUR | LandmarkDetector::FaceModelParameters::FEATURE_MOUTH |
+			LandmarkDetector::FaceModelParameters::FEATURE_BROWS | LandmarkDetector::FaceModelParameters::FEATURE_EYES;
 	}
+
+	if(_signaturePtr->GetOutputs()->FindItem( OUT_LANDMARKS_EYE )->IsConnected())
+	{
+		features |= LandmarkDetector::FaceModelParameters::FEATURE_GAZE;
+	}
+
+	return features;
 }
 
-// Drawing detected landmarks on a face image
-void CLandmarksdetector::DrawLandmark(const LandmarkDetector::CLNF& clnf_model)
+namespace
 {
+	// A copy of the landmarks (x coordinates first, then the y ones) moved by an offset
+	cv::Mat_<double> ShiftLandmarks(const cv::Mat_<double>& landmarks, const cv::Point& offset)
+	{
+		cv::Mat_<double> shifted = landmarks.clone();
 
-	int idx = clnf_model.patch_experts.GetViewIdx(clnf_model.params_global, 0);
+		int n = shifted.rows/2;
+		cv::Mat_<double> xs = shifted.rowRange(0, n);
+		cv::Mat_<double> ys = shifted.rowRange(n, 2*n);
+		xs += offset.x;
+		ys += offset.y;
+
+		return shifted;
+	}
+}
+
+// Fitting the model to a frame and keeping what the outputs need (on the pipeline worker in pipelined mode)
+void CLandmarksdetector::FitFrame(const cv::Mat& grayscale_frame, const FrameTag& tag, FrameOutput& o_output)
+{
+	cv::Mat_<uchar> grayscale_image = grayscale_frame;
 
-	// Because we only draw visible points, need to find which points patch experts consider visible at a certain orientation
-	DrawLandmark(clnf_model.detected_landmarks, clnf_model.patch_experts.visibilities[0][idx]);
+	det_parameters.feature_mask = tag.feature_mask;
 
-	// If the model has hierarchical updates draw those too
-	for(size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
+	// The models work in the coordinates of the region of interest, if its origin moved they are moved by as much in the other
+	// direction so that the tracking carries on from the same place in the image
+	if(tag.roi_offset != tracked_roi_offset)
 	{
-		if(clnf_model.hierarchical_models[i].pdm.NumberOfPoints() != clnf_model.hierarchical_mapping[i].size())
+		double dx = tracked_roi_offset.x - tag.roi_offset.x;
+		double dy = tracked_roi_offset.y - tag.roi_offset.y;
+		clnf_model.Translate(dx, dy);
+		multi_face_tracker.Translate(dx, dy);
+		tracked_roi_offset = tag.roi_offset;
+	}
+
+	double threshold = 0.2;
+
+	o_output.multi_face = multi_face_tracker.max_faces > 1;
+	o_output.faces.clear();
+
+	if(o_output.multi_face)
+	{
+		// The face trackers are copied from the single face model (only once it is needed)
+		if(multi_face_tracker.Empty())
+			multi_face_tracker.SetModel(clnf_model);
+
+		multi_face_tracker.Track(grayscale_image, det_parameters);
+
+		for(size_t face = 0; face < multi_face_tracker.NumFaces(); ++face)
+		{
+			if(multi_face_tracker.Face(face).detection_certainty < threshold)
+			{
+				o_output.faces.push_back(FaceOutput());
+				SnapshotFace(multi_face_tracker.Face(face), multi_face_tracker.FaceID(face), tag.roi_offset, o_output.faces.back());
+			}
+		}
+	}
+	else
+	{
+		DetectLandmarksInVideo(grayscale_image, clnf_model, det_parameters);
+
+		if (clnf_model.detection_certainty < threshold)
 		{
-			DrawLandmark(clnf_model.hierarchical_models[i]);
+			o_output.faces.push_back(FaceOutput());
+			SnapshotFace(clnf_model, 0, tag.roi_offset, o_output.faces.back());
 		}
 	}
 }
 
-void CLandmarksdetector::DrawLandmark(const cv::Mat_<double>& shape2D,const cv::Mat_<int> &visibilities)
+// Copying the landmarks of a model into the coordinates of the whole input image, only the points that the patch experts
+// consider visible at its orientation are output
+void CLandmarksdetector::SnapshotFace(const LandmarkDetector::CLNF& clnf_model, int face_id, const cv::Point& roi_offset, FaceOutput& o_face)
 {
-	int n = shape2D.rows/2;
+	o_face.id = face_id;
+	o_face.landmarks = ShiftLandmarks(clnf_model.detected_landmarks, roi_offset);
+
+	int idx = clnf_model.patch_experts.GetViewIdx(clnf_model.params_global, 0);
+	o_face.visibilities = clnf_model.patch_experts.visibilities[0][idx];
 
-	if(n > 66)
+	// The eye models are only fit when the eye output is used
+	o_face.eye_landmarks.clear();
+	if(det_parameters.feature_mask & LandmarkDetector::FaceModelParameters::FEATURE_GAZE)
 	{
-		for( int i = 0; i < n; ++i)
-		{		
-			if(visibilities.at<int>(i))
+		for(size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
+		{
+			if(clnf_model.hierarchical_models[i].pdm.NumberOfPoints() != clnf_model.hierarchical_mapping[i].size())
 			{
-				labelCount++;
+				o_face.eye_landmarks.push_back(ShiftLandmarks(clnf_model.hierarchical_models[i].detected_landmarks, roi_offset));
+			}
+		}
+	}
+}
 
-				m_pointPtr->SetValue(cvRound(shape2D.at<double>(i)*16-10)/(normFacX*16),cvRound(shape2D.at<double>(i + n)*16)/(normFacY*16));
+void CLandmarksdetector::PublishFrame(const FrameOutput& output, Eyw::TIME creation_time, double age)
+{
+	landmarks_output.Begin();
+	eye_landmarks_output.Begin();
 
-				str = labelCount;
+	for(size_t face = 0; face < output.faces.size(); ++face)
+	{
+		// The landmarks of several faces are told apart by the face id
+		DrawFaceLandmarks(output.faces[face], output.multi_face ? output.faces[face].id : -1);
+	}
 
-				//Notify_DebugString("labelCount %d",labelCount);
+	landmarks_output.End();
+	eye_landmarks_output.End();
 
-				m_outLandmarksPtr->Insert(str.c_str(), m_pointPtr.get());
+	if(_signaturePtr->GetOutputs()->FindItem( OUT_LANDMARKS_ARRAY )->IsConnected())
+	{
+		FillLandmarksArray(output);
+		m_outLandmarksArrayPtr->SetCreationTime(creation_time);
+	}
 
-			}
+	m_outResultAgePtr->SetValue(age);
+
+	m_outLandmarksPtr->SetCreationTime(creation_time);
+	m_outLandmarksEyePtr->SetCreationTime(creation_time);
+	m_outResultAgePtr->SetCreationTime(creation_time);
+}
+
+// Swapping in a model that finished loading in the background, the tracking starts again with it
+void CLandmarksdetector::AdoptLoadedModel()
+{
+	if(!model_loader.Loaded())
+		return;
+
+	// The worker must not be fitting with the model that is replaced
+	bool pipelined = pipeline.Running();
+	pipeline.Stop();
+
+	model_loader.TakeLoaded(clnf_model, det_parameters.model_location);
+	clnf_model.Reset();
+
+	// The face trackers are copied from the new model
+	if(!multi_face_tracker.Empty())
+		multi_face_tracker.SetModel(clnf_model);
+
+	if(pipelined)
+		StartPipeline();
+}
+
+void CLandmarksdetector::StartPipeline()
+{
+	double latency_budget = m_latency_budgetPinPtr->GetValue() / 1000.0;
+
+	pipeline.Start([this](const cv::Mat& frame, const FrameTag& tag, FrameOutput& o_output){ FitFrame(frame, tag, o_output); },
+		latency_budget > 0 ? LandmarkDetector::FramePipeline<FrameTag, FrameOutput>::KEEP_WITHIN_BUDGET : LandmarkDetector::FramePipeline<FrameTag, FrameOutput>::KEEP_LATEST,
+		8, latency_budget);
+}
+
+// Outputting the visible landmarks of a face, labelled by the landmark index or, with several faces, by the face id and the
+// landmark index (e.g. "3_17")
+void CLandmarksdetector::DrawFaceLandmarks(const FaceOutput& face, int label_group)
+{
+	int n = face.landmarks.rows/2;
+
+	for( int i = 0; i < n; ++i)
+	{
+		if(face.visibilities.at<int>(i))
+		{
+			landmarks_output.Add(landmarks_output.Label(i, label_group), NormalizedX(face.landmarks.at<double>(i)), NormalizedY(face.landmarks.at<double>(i + n)));
 		}
 	}
-	else if(n == 28) // drawing eyes
+
+	// The eye models, numbered on from each other
+	int eye_label = 0;
+	for(size_t eye = 0; eye < face.eye_landmarks.size(); ++eye)
 	{
-		for( int i = 0; i < n; ++i)
-		{		
-			labelCount_2++;
+		const cv::Mat_<double>& eye_landmarks = face.eye_landmarks[eye];
+		int n_eye = eye_landmarks.rows/2;
 
-				m_pointPtr->SetValue(cvRound(shape2D.at<double>(i)*16-10)/(normFacX*16),cvRound(shape2D.at<double>(i + n)*16)/(normFacY*16));
-			
-				str = labelCount_2;
+		if(n_eye != 28)
+		{
+			continue;
+		}
 
-				//Notify_DebugString("labelCount %d",labelCount);
+		for( int j = 0; j < n_eye; ++j)
+		{
+			eye_landmarks_output.Add(eye_landmarks_output.Label(eye_label++, label_group), NormalizedX(eye_landmarks.at<double>(j)), NormalizedY(eye_landmarks.at<double>(j + n_eye)));
+		}
+	}
+}
 
-				m_outLandmarksEyePtr->Insert(str.c_str(), m_pointPtr.get());
+// All of the landmarks (visible or not) of every face in one flat array, without a datatype per point
+void CLandmarksdetector::FillLandmarksArray(const FrameOutput& output)
+{
+	int rows = 0;
+	for(size_t face = 0; face < output.faces.size(); ++face)
+	{
+		rows += output.faces[face].landmarks.rows;
+	}
 
-		}
-	}	
-	else if (n == 6)
+	// Only resized when the number of faces changes
+	if(m_outLandmarksArrayPtr->GetNumberOfRows() != rows)
 	{
-		for( int i = 0; i < n; ++i)
-		{		
-					labelCount++;
+		matrix_init_info_ptr matrixInitInfoPtr = datatype_init_info<IMatrixInitInfo>::create(_kernelServicesPtr);
+		matrixInitInfoPtr->SetNumberOfRows(rows);
+		matrixInitInfoPtr->SetNumberOfColumns(1);
 
-					m_pointPtr->SetValue(cvRound(shape2D.at<double>(i)*16-10)/(normFacX*16),cvRound(shape2D.at<double>(i + n)*16)/(normFacY*16));
-			
-					if (labelCount < 10)
-					{
-						m_outLandmarksPtr->Insert("Landmark_0"+labelCount, m_pointPtr.get());
-					}
-					else
-					{
-						m_outLandmarksPtr->Insert("Landmark_"+labelCount, m_pointPtr.get());
-					}
-
-		}	
+		m_outLandmarksArrayPtr->InitInstance(matrixInitInfoPtr.get());
+	}
+
+	double* buffer = m_outLandmarksArrayPtr->GetBuffer();
+	for(size_t face = 0; face < output.faces.size(); ++face)
+	{
+		const cv::Mat_<double>& landmarks = output.faces[face].landmarks;
+		int n = landmarks.rows/2;
+
+		for( int i = 0; i < n; ++i)
+		{
+			buffer[i] = NormalizedX(landmarks.at<double>(i));
+			buffer[i + n] = NormalizedY(landmarks.at<double>(i + n));
+		}
+		buffer += 2*n;
 	}
-}
\ No newline at end of file
+}
+
+// From pixels to the coordinates normalized by the size of the image (rounded to 1/16 of a pixel)
+double CLandmarksdetector::NormalizedX(double x) const
+{
+	return cvRound(x*16-10)/(normFacX*16);
+}
+
+double CLandmarksdetector::NormalizedY(double y) const
+{
+	return cvRound(y*16)/(normFacY*16);
+}
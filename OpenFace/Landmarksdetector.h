@@ -6,8 +6,14 @@
 #include <opencv2/core/mat.hpp>
 #include "./include/LandmarkDetectorParameters.h"
 #include "./include/LandmarkDetectorModel.h"
+#include "./include/MultiFaceTracker.h"
+#include "./include/FramePipeline.h"
+#include "./include/BackgroundModelLoader.h"
+#include "FrameIngestion.h"
+#include "LabelledPointsOutput.h"
 #include "BaseCatalog/EywGraphicPoint2D.h"
 #include "BaseCatalog/EywGraphicLabelledSet2D.h"
+#include "BaseCatalog/EywDoubleMatrix.h"
 
 class CLandmarksdetector : public Eyw::CBlockImpl
 {
@@ -117,10 +123,18 @@ private:
 	Eyw::bool_ptr m_limit_posePinPtr;
 	Eyw::bool_ptr m_refine_hierarchicalPinPtr;
 	Eyw::bool_ptr m_refine_parametersPinPtr;
+	Eyw::bool_ptr m_motion_predictionPinPtr;
 
 	//int ptrs
 	Eyw::int_ptr m_num_optimisation_iterationPinPtr;
 	Eyw::int_ptr m_reinit_video_everyPinPtr;
+	Eyw::int_ptr m_max_threadsPinPtr;
+	Eyw::int_ptr m_pin_first_corePinPtr;
+	Eyw::int_ptr m_max_facesPinPtr;
+
+	//pipelined mode
+	Eyw::bool_ptr m_pipelinedPinPtr;
+	Eyw::double_ptr m_latency_budgetPinPtr;
 
 	//double ptrs
 	Eyw::double_ptr m_validation_boundaryPinPtr;
@@ -146,12 +160,49 @@ private:
 
 	Eyw::graphic_labelled_set_2d_double_ptr m_outLandmarksEyePtr;
 
+	Eyw::double_matrix_ptr m_outLandmarksArrayPtr;
+
+	Eyw::double_ptr m_outResultAgePtr;
+
+	// What is output for a face, copied out of the model so that it can be handed over from the pipeline worker
+	struct FaceOutput
+	{
+		int id;
+		cv::Mat_<double> landmarks;
+		cv::Mat_<int> visibilities;
+		vector<cv::Mat_<double> > eye_landmarks;
+	};
+
+	struct FrameOutput
+	{
+		bool multi_face;
+		vector<FaceOutput> faces;
+	};
+
+	struct FrameTag
+	{
+		Eyw::TIME creation_time;
+		int feature_mask;
+
+		// Where the region of interest the frame was cut from starts in the input image
+		cv::Point roi_offset;
+	};
 
 	//utility function
-	void PrepareCvImage(const Eyw::image_ptr& sourceImagePtr, cv::Mat& destinationImage);
 	//void visualise_tracking(cv::Mat& captured_image, const LandmarkDetector::CLNF& face_model, const LandmarkDetector::FaceModelParameters& det_parameters, cv::Point3f gazeDirection0, cv::Point3f gazeDirection1, int frame_count, double fx, double fy, double cx, double cy);
-	void DrawLandmark(const LandmarkDetector::CLNF& clnf_model);
-	void DrawLandmark(const cv::Mat_<double>& shape2D, const cv::Mat_<int> &visibilities);
+	void DrawFaceLandmarks(const FaceOutput& face, int label_group);
+	void FillLandmarksArray(const FrameOutput& output);
+	double NormalizedX(double x) const;
+	double NormalizedY(double y) const;
+	int GetRequestedFeatures();
+	void ApplyChangedParameter( const std::string& csParameterID );
+
+	// Fitting (on the pipeline worker in pipelined mode) and outputting of a frame
+	void FitFrame(const cv::Mat& grayscale_frame, const FrameTag& tag, FrameOutput& o_output);
+	void SnapshotFace(const LandmarkDetector::CLNF& clnf_model, int face_id, const cv::Point& roi_offset, FaceOutput& o_face);
+	void PublishFrame(const FrameOutput& output, Eyw::TIME creation_time, double age);
+	void StartPipeline();
+	void AdoptLoadedModel();
 	/*
 	 *
 	 *	INTERNAL DATA
@@ -163,16 +214,26 @@ private:
 	double normFacX, normFacY;
 
 	LandmarkDetector::CLNF clnf_model;
+
+	// Used instead of clnf_model when more than one face is tracked
+	LandmarkDetector::MultiFaceTracker multi_face_tracker;
+
+	// Where the region of interest the models currently track in starts, they are moved along when it moves
+	cv::Point tracked_roi_offset;
 	LandmarkDetector::FaceModelParameters det_parameters = LandmarkDetector::FaceModelParameters();
 
-	cv::Mat landmarks;
-	cv::Mat captured_image;
+	// Fits the frames on a worker thread in pipelined mode
+	LandmarkDetector::FramePipeline<FrameTag, FrameOutput> pipeline;
 
-	std::string str;
+	// Reads the model chosen at run time without stopping the tracking
+	LandmarkDetector::BackgroundModelLoader model_loader;
 
-	int labelCount = 0;
-	
-	int labelCount_2 = 0;
+	cv::Mat landmarks;
+	FrameIngestion frame_ingestion;
+
+	// The labelled sets of the landmarks and of the eye landmarks, updated in place from frame to frame
+	LabelledPointsOutput landmarks_output;
+	LabelledPointsOutput eye_landmarks_output;
 
 	int frame_count = 0;
 
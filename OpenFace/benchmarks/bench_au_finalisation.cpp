@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Times the offline finalisation of the AU predictions (FaceAnalyser::ExtractAllPredictionsOfflineReg and Class) against the
+//  length of the video
+//
+//  bench_au_finalisation <video or image sequence> [longest length as a multiple of the video = 8]
+//
+//  The video is tracked once, then the FaceAnalyser is fed the tracked frames (looping over the video for the lengths above it, at
+//  30 fps timestamps) for a quarter, a half, one, two, ... times its length, and the finalisation is timed after each. The time per
+//  thousand frames shows how it scales. Run from the OpenFace directory (the models are read from model/ and AU_predictors/).
+
+#include <LandmarkCoreIncludes.h>
+#include <FaceAnalyser.h>
+
+#include <BenchmarkUtils.h>
+
+#include <cstdlib>
+
+using namespace std;
+
+namespace
+{
+	// What the FaceAnalyser reads of the fitted model
+	struct TrackedState
+	{
+		bool detection_success;
+		cv::Vec6d params_global;
+		cv::Mat_<double> params_local;
+		cv::Mat_<double> detected_landmarks;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "Usage: bench_au_finalisation <video or image sequence> [longest length as a multiple of the video = 8]" << endl;
+		return 2;
+	}
+
+	double longest = argc > 2 ? atof(argv[2]) : 8;
+
+	vector<cv::Mat> frames;
+	if(!Benchmark::LoadFrames(argv[1], frames))
+	{
+		return 2;
+	}
+
+	vector<cv::Mat_<uchar> > grayscale_frames;
+	Benchmark::ToGrayscale(frames, grayscale_frames);
+
+	LandmarkDetector::FaceModelParameters params;
+	LandmarkDetector::CLNF clnf_model(params.model_location);
+	if(clnf_model.pdm.NumberOfPoints() == 0)
+	{
+		return 2;
+	}
+
+	vector<TrackedState> states(frames.size());
+	for(size_t f = 0; f < frames.size(); ++f)
+	{
+		LandmarkDetector::DetectLandmarksInVideo(grayscale_frames[f], clnf_model, params);
+		states[f].detection_success = clnf_model.detection_success;
+		states[f].params_global = clnf_model.params_global;
+		states[f].params_local = clnf_model.params_local.clone();
+		states[f].detected_landmarks = clnf_model.detected_landmarks.clone();
+	}
+
+	FaceAnalysis::FaceAnalyser face_analyser;
+
+	cout << frames.size() << " frames in the video" << endl;
+
+	for(double multiple = 0.25; multiple <= longest; multiple *= 2)
+	{
+		const int length = max(1, (int)(frames.size() * multiple));
+
+		face_analyser.Reset();
+
+		double start = Benchmark::Now();
+		for(int f = 0; f < length; ++f)
+		{
+			const TrackedState& state = states[f % states.size()];
+			clnf_model.detection_success = state.detection_success;
+			clnf_model.params_global = state.params_global;
+			state.params_local.copyTo(clnf_model.params_local);
+			state.detected_landmarks.copyTo(clnf_model.detected_landmarks);
+
+			face_analyser.AddNextFrame(frames[f % frames.size()], clnf_model, f / 30.0, false, false);
+		}
+		double added = Benchmark::Now() - start;
+
+		vector<pair<string, vector<double> > > intensities;
+		vector<pair<string, vector<double> > > presences;
+		vector<double> confidences;
+		vector<bool> successes;
+		vector<double> timestamps;
+
+		start = Benchmark::Now();
+		face_analyser.ExtractAllPredictionsOfflineReg(intensities, confidences, successes, timestamps, true);
+		double intensity_time = Benchmark::Now() - start;
+
+		start = Benchmark::Now();
+		face_analyser.ExtractAllPredictionsOfflineClass(presences, confidences, successes, timestamps, true);
+		double presence_time = Benchmark::Now() - start;
+
+		double finalisation = intensity_time + presence_time;
+		cout << length << " frames: adding " << added * 1000 / length << " ms per frame, finalisation " << finalisation * 1000 << " ms (intensities "
+			<< intensity_time * 1000 << " ms, presences " << presence_time * 1000 << " ms), " << finalisation * 1e6 / length << " ms per 1000 frames" << endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Compares the gaze tracking throughput and CPU cost of fitting the whole face every frame with refitting only the eyes in between
+//  (DetectEyesInVideo), for a full fit every 1, 2, 4 and 8 frames
+//
+//  bench_eye_tracking <video or image sequence> [fps = 0, as fast as possible]
+//
+//  The frames are fitted as the gaze block does with full_fit_every, and the gaze of both eyes is estimated after each fit (with
+//  the default intrinsics of the blocks). Reports the gaze updates per second (frames with a tracked gaze over the wall time) and
+//  the CPU time per frame. With an fps the frames are replayed in real time, which shows the CPU left over at camera rate. Run from
+//  the OpenFace directory (the model is read from model/main_clnf_general.txt).
+
+#include <LandmarkCoreIncludes.h>
+#include <GazeEstimation.h>
+
+#include <BenchmarkUtils.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "Usage: bench_eye_tracking <video or image sequence> [fps = 0, as fast as possible]" << endl;
+		return 2;
+	}
+
+	double fps = argc > 2 ? atof(argv[2]) : 0;
+
+	vector<cv::Mat> frames;
+	if(!Benchmark::LoadFrames(argv[1], frames))
+	{
+		return 2;
+	}
+
+	vector<cv::Mat_<uchar> > grayscale_frames;
+	Benchmark::ToGrayscale(frames, grayscale_frames);
+
+	LandmarkDetector::FaceModelParameters params;
+	params.track_gaze = true;
+	LandmarkDetector::CLNF clnf_model(params.model_location);
+	if(clnf_model.pdm.NumberOfPoints() == 0)
+	{
+		return 2;
+	}
+
+	FaceAnalysis::GazeParts gaze_parts = FaceAnalysis::FindGazeParts(clnf_model);
+	if(!gaze_parts.Valid())
+	{
+		cout << "The model " << params.model_location << " has no eye models" << endl;
+		return 2;
+	}
+
+	float cx = grayscale_frames[0].cols / 2.0f;
+	float cy = grayscale_frames[0].rows / 2.0f;
+	float fx = 500 * (grayscale_frames[0].cols / 640.0f);
+	float fy = 500 * (grayscale_frames[0].rows / 480.0f);
+
+	cout << grayscale_frames.size() << " frames";
+	if(fps > 0)
+	{
+		cout << " replayed at " << fps << " fps";
+	}
+	cout << endl;
+
+	const int full_fit_intervals[] = {1, 2, 4, 8};
+	for(int r = 0; r < 4; ++r)
+	{
+		const int full_fit_every = full_fit_intervals[r];
+
+		clnf_model.Reset();
+
+		Benchmark::Timings fit_times;
+		int gaze_updates = 0;
+		int eye_fits = 0;
+		int frames_since_full_fit = 0;
+
+		double wall_start = Benchmark::Now();
+		double cpu_start = Benchmark::CpuTime();
+		for(size_t f = 0; f < grayscale_frames.size(); ++f)
+		{
+			if(fps > 0)
+			{
+				double wait = wall_start + f / fps - Benchmark::Now();
+				if(wait > 0)
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds((long long)(wait * 1e6)));
+				}
+			}
+
+			double start = Benchmark::Now();
+
+			// As the gaze block fits the frames
+			bool detection_success;
+			if(++frames_since_full_fit < full_fit_every && LandmarkDetector::DetectEyesInVideo(grayscale_frames[f], clnf_model, params, gaze_parts.left_eye, gaze_parts.right_eye))
+			{
+				detection_success = clnf_model.detection_success;
+				eye_fits++;
+			}
+			else
+			{
+				detection_success = LandmarkDetector::DetectLandmarksInVideo(grayscale_frames[f], clnf_model, params);
+				frames_since_full_fit = 0;
+			}
+
+			FaceAnalysis::BinocularGaze gaze;
+			FaceAnalysis::EstimateBinocularGaze(clnf_model, gaze_parts, fx, fy, cx, cy, detection_success && clnf_model.eye_model, gaze);
+
+			fit_times.Add(Benchmark::Now() - start);
+			if(detection_success)
+			{
+				gaze_updates++;
+			}
+		}
+		double wall_time = Benchmark::Now() - wall_start;
+		double cpu_time = Benchmark::CpuTime() - cpu_start;
+
+		cout << "Full fit every " << full_fit_every << " frames: " << gaze_updates / wall_time << " gaze updates/s, " << cpu_time * 1000 / grayscale_frames.size()
+			<< " ms CPU per frame, " << eye_fits << " eye only fits, " << gaze_updates << " of " << grayscale_frames.size() << " frames tracked" << endl;
+		fit_times.Report("  fit and gaze");
+	}
+
+	return 0;
+}
@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Compares the native FHOG extraction with the dlib one on faces of the size FaceAnalyser aligns to, and times both
+//
+//  bench_fhog <video or image sequence> [max frames = 200]
+//
+//  The frames are scaled to square images (the aligned faces are 112x112) in colour and in grayscale. Returns 1 if a descriptor differs
+//  from the dlib one by more than the single precision tolerance, or if the native extraction is not built in (OpenCV older than 3.2).
+
+#include <Face_utils.h>
+
+#include <BenchmarkUtils.h>
+
+#include <cstdlib>
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "Usage: bench_fhog <video or image sequence> [max frames = 200]" << endl;
+		return 2;
+	}
+
+#if !OPENFACE_SIMD128
+	cout << "The native FHOG extraction needs OpenCV 3.2 or newer with SIMD support" << endl;
+	return 1;
+#else
+	vector<cv::Mat> frames;
+	if(!Benchmark::LoadFrames(argv[1], frames, argc > 2 ? atoi(argv[2]) : 200))
+	{
+		return 2;
+	}
+
+	// The largest difference allowed between the two, the dlib extraction also works in single precision
+	const double tolerance = 1e-4;
+
+	const int sizes[] = {112, 96, 100};
+	int failures = 0;
+
+	for(int s = 0; s < 3; ++s)
+	{
+		for(int channels = 1; channels <= 3; channels += 2)
+		{
+			Benchmark::Timings dlib_timings;
+			Benchmark::Timings native_timings;
+			double max_difference = 0;
+
+			for(size_t f = 0; f < frames.size(); ++f)
+			{
+				cv::Mat image;
+				cv::resize(frames[f], image, cv::Size(sizes[s], sizes[s]));
+				if(channels == 1 && image.channels() == 3)
+				{
+					cv::cvtColor(image, image, cv::COLOR_BGR2GRAY);
+				}
+				else if(channels == 3 && image.channels() == 1)
+				{
+					cv::cvtColor(image, image, cv::COLOR_GRAY2BGR);
+				}
+
+				cv::Mat_<double> dlib_descriptor;
+				int dlib_rows, dlib_cols;
+				double start = Benchmark::Now();
+				FaceAnalysis::Extract_FHOG_descriptor_dlib(dlib_descriptor, image, dlib_rows, dlib_cols);
+				dlib_timings.Add(Benchmark::Now() - start);
+
+				cv::Mat_<float> native_descriptor;
+				int native_rows, native_cols;
+				start = Benchmark::Now();
+				FaceAnalysis::Extract_FHOG_descriptor_native(native_descriptor, image, native_rows, native_cols);
+				native_timings.Add(Benchmark::Now() - start);
+
+				if(dlib_rows != native_rows || dlib_cols != native_cols || dlib_descriptor.cols != native_descriptor.cols)
+				{
+					cout << "Frame " << f << ": " << dlib_rows << "x" << dlib_cols << " dlib cells, " << native_rows << "x" << native_cols << " native ones" << endl;
+					failures++;
+					continue;
+				}
+
+				cv::Mat_<double> native_double;
+				native_descriptor.convertTo(native_double, CV_64F);
+				double difference = dlib_descriptor.empty() ? 0 : cv::norm(dlib_descriptor, native_double, cv::NORM_INF);
+				max_difference = max(max_difference, difference);
+				if(difference > tolerance)
+				{
+					failures++;
+				}
+			}
+
+			cout << sizes[s] << "x" << sizes[s] << (channels == 1 ? " gray" : " colour") << ": largest difference " << max_difference << endl;
+			dlib_timings.Report("  dlib");
+			native_timings.Report("  native");
+		}
+	}
+
+	cout << failures << " descriptors outside of the tolerance " << tolerance << endl;
+	return failures == 0 ? 0 : 1;
+#endif
+}
@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Compares the synchronous fitting of the blocks with the pipelined one (FramePipeline) on a video replayed in real time
+//
+//  bench_frame_pipeline <video or image sequence> [fps = 30] [latency budget in ms = 0, keep latest]
+//
+//  Reports how long each call (what the EyesWeb scheduler waits for) takes, and the latency of the published results, from the
+//  time the frame was due to the end of the call that publishes its result. In the synchronous mode a slow fit delays the
+//  following frames, which adds to their latency. Run from the OpenFace directory (the model is read from
+//  model/main_clnf_general.txt).
+
+#include <LandmarkCoreIncludes.h>
+#include <FramePipeline.h>
+
+#include <BenchmarkUtils.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+	struct FitResult
+	{
+		cv::Mat_<double> landmarks;
+		bool success;
+	};
+
+	void WaitUntil(double time)
+	{
+		double wait = time - Benchmark::Now();
+		if(wait > 0)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds((long long)(wait * 1e6)));
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "Usage: bench_frame_pipeline <video or image sequence> [fps = 30] [latency budget in ms = 0, keep latest]" << endl;
+		return 2;
+	}
+
+	double fps = argc > 2 ? atof(argv[2]) : 30;
+	double latency_budget = (argc > 3 ? atof(argv[3]) : 0) / 1000.0;
+
+	vector<cv::Mat> frames;
+	if(!Benchmark::LoadFrames(argv[1], frames))
+	{
+		return 2;
+	}
+
+	vector<cv::Mat_<uchar> > grayscale_frames;
+	Benchmark::ToGrayscale(frames, grayscale_frames);
+
+	LandmarkDetector::FaceModelParameters params;
+	LandmarkDetector::CLNF clnf_model(params.model_location);
+	if(clnf_model.pdm.NumberOfPoints() == 0)
+	{
+		return 2;
+	}
+
+	const double frame_period = 1.0 / fps;
+
+	// Synchronous, a frame can only be handled once the call of the previous one returned
+	Benchmark::Timings sync_calls;
+	Benchmark::Timings sync_latencies;
+	double start = Benchmark::Now();
+	for(size_t f = 0; f < grayscale_frames.size(); ++f)
+	{
+		double due = start + f * frame_period;
+		WaitUntil(due);
+
+		double call_start = Benchmark::Now();
+		LandmarkDetector::DetectLandmarksInVideo(grayscale_frames[f], clnf_model, params);
+		double call_end = Benchmark::Now();
+
+		sync_calls.Add(call_end - call_start);
+		sync_latencies.Add(call_end - due);
+	}
+
+	// Pipelined, the call pushes the frame and publishes the newest result
+	clnf_model.Reset();
+
+	LandmarkDetector::FramePipeline<double, FitResult> pipeline;
+	pipeline.Start([&](const cv::Mat& frame, const double&, FitResult& o_result)
+	{
+		o_result.success = LandmarkDetector::DetectLandmarksInVideo(frame, clnf_model, params);
+		o_result.landmarks = clnf_model.detected_landmarks.clone();
+	}, latency_budget > 0 ? LandmarkDetector::FramePipeline<double, FitResult>::KEEP_WITHIN_BUDGET : LandmarkDetector::FramePipeline<double, FitResult>::KEEP_LATEST,
+		8, latency_budget);
+
+	Benchmark::Timings pipelined_calls;
+	Benchmark::Timings pipelined_latencies;
+	Benchmark::Timings result_ages;
+	int published = 0;
+	start = Benchmark::Now();
+	for(size_t f = 0; f < grayscale_frames.size(); ++f)
+	{
+		double due = start + f * frame_period;
+		WaitUntil(due);
+
+		double call_start = Benchmark::Now();
+		pipeline.Push(grayscale_frames[f], due);
+
+		FitResult result;
+		double result_due, age;
+		bool have_result = pipeline.TakeLatest(result, result_due, age);
+		double call_end = Benchmark::Now();
+
+		pipelined_calls.Add(call_end - call_start);
+		if(have_result)
+		{
+			pipelined_latencies.Add(call_end - result_due);
+			result_ages.Add(age);
+			published++;
+		}
+	}
+	int dropped = pipeline.FramesDropped();
+	pipeline.Stop();
+
+	cout << grayscale_frames.size() << " frames at " << fps << " fps" << endl;
+	sync_calls.Report("Synchronous call");
+	sync_latencies.Report("Synchronous latency");
+	pipelined_calls.Report("Pipelined call");
+	pipelined_latencies.Report("Pipelined latency");
+	result_ages.Report("Pipelined result age");
+	cout << "Pipelined: " << published << " results published, " << dropped << " frames dropped" << endl;
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Checks that DetectHOGParallel finds exactly what the serial dlib detector finds, and times both against the resolution and the
+//  number of cores
+//
+//  bench_hog_detection <video or image sequence> [max frames = 20] [max threads = hardware concurrency]
+//
+//  The frames are resized to 1280x720, 1920x1080 and 3840x2160. At each resolution the serial detector is timed once (it does not
+//  use more cores) and DetectHOGParallel in a TrackerArena of 1, 2, 4, ... threads, up to the maximum. Returns 1 if any of the
+//  detections differ.
+
+#include <LandmarkDetectorUtils.h>
+#include <FaceDetectorCache.h>
+#include <TrackerArena.h>
+
+#include <BenchmarkUtils.h>
+
+#include <dlib/opencv.h>
+
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+	bool SameDetections(const vector<dlib::full_detection>& a, const vector<dlib::full_detection>& b)
+	{
+		if(a.size() != b.size())
+		{
+			return false;
+		}
+		for(size_t i = 0; i < a.size(); ++i)
+		{
+			if(a[i].rect.get_rect() != b[i].rect.get_rect() || a[i].weight_index != b[i].weight_index || a[i].detection_confidence != b[i].detection_confidence)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "Usage: bench_hog_detection <video or image sequence> [max frames = 20] [max threads = hardware concurrency]" << endl;
+		return 2;
+	}
+
+	int max_threads = argc > 3 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+	max_threads = max(1, max_threads);
+
+	vector<cv::Mat> frames;
+	if(!Benchmark::LoadFrames(argv[1], frames, argc > 2 ? atoi(argv[2]) : 20))
+	{
+		return 2;
+	}
+
+	vector<cv::Mat_<uchar> > grayscale_frames;
+	Benchmark::ToGrayscale(frames, grayscale_frames);
+
+	dlib::frontal_face_detector detector = LandmarkDetector::CopyCachedHOGDetector();
+
+	// What the cached filter banks save on every call
+	Benchmark::Timings filter_bank_timings;
+	for(int run = 0; run < 10; ++run)
+	{
+		double start = Benchmark::Now();
+		for(unsigned long i = 0; i < detector.num_detectors(); ++i)
+		{
+			detector.get_scanner().build_fhog_filterbank(detector.get_w(i));
+		}
+		filter_bank_timings.Add(Benchmark::Now() - start);
+	}
+	filter_bank_timings.Report("Building the filter banks");
+
+	// Powers of two up to the largest thread count, and that one
+	vector<int> thread_counts;
+	for(int threads = 1; threads < max_threads; threads *= 2)
+	{
+		thread_counts.push_back(threads);
+	}
+	thread_counts.push_back(max_threads);
+
+	const cv::Size resolutions[] = {cv::Size(1280, 720), cv::Size(1920, 1080), cv::Size(3840, 2160)};
+	int mismatches = 0;
+
+	for(int r = 0; r < 3; ++r)
+	{
+		vector<cv::Mat_<uchar> > resized_frames(grayscale_frames.size());
+		for(size_t i = 0; i < grayscale_frames.size(); ++i)
+		{
+			cv::resize(grayscale_frames[i], resized_frames[i], resolutions[r]);
+		}
+
+		vector<vector<dlib::full_detection> > serial_detections(resized_frames.size());
+		Benchmark::Timings serial_timings;
+		int num_detections = 0;
+		for(size_t i = 0; i < resized_frames.size(); ++i)
+		{
+			dlib::cv_image<uchar> image(resized_frames[i]);
+
+			double start = Benchmark::Now();
+			detector(image, serial_detections[i], -0.2);
+			serial_timings.Add(Benchmark::Now() - start);
+
+			num_detections += (int)serial_detections[i].size();
+		}
+
+		cout << resolutions[r].width << "x" << resolutions[r].height << ", " << resized_frames.size() << " frames, " << num_detections << " detections" << endl;
+		serial_timings.Report("  dlib detector");
+
+		for(size_t t = 0; t < thread_counts.size(); ++t)
+		{
+			LandmarkDetector::TrackerArena arena;
+			arena.Configure(thread_counts[t]);
+
+			Benchmark::Timings parallel_timings;
+			int resolution_mismatches = 0;
+
+			arena.Execute([&]()
+			{
+				// The first call builds the cached filter banks and warms up the arena, it is not part of the timings
+				vector<dlib::full_detection> parallel_detections;
+				LandmarkDetector::DetectHOGParallel(detector, resized_frames[0], parallel_detections, -0.2);
+
+				for(size_t i = 0; i < resized_frames.size(); ++i)
+				{
+					double start = Benchmark::Now();
+					LandmarkDetector::DetectHOGParallel(detector, resized_frames[i], parallel_detections, -0.2);
+					parallel_timings.Add(Benchmark::Now() - start);
+
+					if(!SameDetections(serial_detections[i], parallel_detections))
+					{
+						cout << "Frame " << i << ": " << serial_detections[i].size() << " serial detections, " << parallel_detections.size() << " parallel ones, they differ" << endl;
+						resolution_mismatches++;
+					}
+				}
+			});
+
+			cout << "  " << thread_counts[t] << " threads: dlib median " << serial_timings.Percentile(0.5) * 1000 << " ms, DetectHOGParallel median "
+				<< parallel_timings.Percentile(0.5) * 1000 << " ms, speedup " << serial_timings.Percentile(0.5) / parallel_timings.Percentile(0.5) << "x, "
+				<< resolution_mismatches << " frames with different detections" << endl;
+
+			mismatches += resolution_mismatches;
+		}
+	}
+
+	return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Tracks a video with and without the motion prediction and compares the accuracy and the time of the fits
+//
+//  bench_motion_prediction <video or image sequence> [annotation directory or -] [frame step = 1]
+//
+//  With an annotation directory (68 point .pts files named after the frame, starting at 000001.pts, as in 300-VW) the error is the
+//  RMS landmark distance to the annotations over the distance of the outer eye corners, otherwise it is the same measure to the
+//  landmarks tracked without the prediction. A frame step above 1 skips frames, for faster motion. Run from the OpenFace directory
+//  (the model is read from model/main_clnf_general.txt).
+
+#include <LandmarkCoreIncludes.h>
+
+#include <BenchmarkUtils.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+using namespace std;
+
+namespace
+{
+	// The landmarks of a .pts file as a column of the x coordinates followed by the y ones, empty if it can not be read
+	cv::Mat_<double> ReadPts(const string& location)
+	{
+		ifstream file(location.c_str());
+		string line;
+		int n_points = 0;
+		while(getline(file, line))
+		{
+			if(line.compare(0, 8, "n_points") == 0)
+			{
+				n_points = atoi(line.substr(line.find(':') + 1).c_str());
+			}
+			else if(line.compare(0, 1, "{") == 0)
+			{
+				break;
+			}
+		}
+
+		cv::Mat_<double> landmarks(n_points * 2, 1);
+		for(int i = 0; i < n_points; ++i)
+		{
+			if(!(file >> landmarks(i) >> landmarks(i + n_points)))
+			{
+				return cv::Mat_<double>();
+			}
+		}
+		return landmarks;
+	}
+
+	// RMS landmark distance normalised by the distance of the outer eye corners of the reference (68 point markup)
+	double NormalisedError(const cv::Mat_<double>& landmarks, const cv::Mat_<double>& reference)
+	{
+		int n = reference.rows / 2;
+		double interocular = cv::norm(cv::Point2d(reference(36), reference(36 + n)) - cv::Point2d(reference(45), reference(45 + n)));
+
+		double sum = 0;
+		for(int i = 0; i < n; ++i)
+		{
+			double dx = landmarks(i) - reference(i);
+			double dy = landmarks(i + n) - reference(i + n);
+			sum += dx * dx + dy * dy;
+		}
+		return sqrt(sum / n) / interocular;
+	}
+
+	struct Run
+	{
+		string name;
+		Benchmark::Timings fit_times;
+		Benchmark::Timings errors;
+		vector<cv::Mat_<double> > landmarks;
+		int failures;
+		double iterations;
+	};
+
+	void Track(Run& run, const vector<cv::Mat_<uchar> >& frames, int frame_step, LandmarkDetector::CLNF& clnf_model, LandmarkDetector::FaceModelParameters params)
+	{
+		clnf_model.Reset();
+		run.failures = 0;
+		run.iterations = 0;
+
+		for(size_t f = 0; f < frames.size(); f += frame_step)
+		{
+			double start = Benchmark::Now();
+			bool success = LandmarkDetector::DetectLandmarksInVideo(frames[f], clnf_model, params);
+			run.fit_times.Add(Benchmark::Now() - start);
+
+			if(!success)
+			{
+				run.failures++;
+			}
+			for(size_t scale = 0; scale < clnf_model.fit_stats.iterations.size(); ++scale)
+			{
+				run.iterations += clnf_model.fit_stats.iterations[scale];
+			}
+			run.landmarks.push_back(clnf_model.detected_landmarks.clone());
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "Usage: bench_motion_prediction <video or image sequence> [annotation directory or -] [frame step = 1]" << endl;
+		return 2;
+	}
+
+	string annotations = argc > 2 ? argv[2] : "-";
+	int frame_step = argc > 3 ? max(1, atoi(argv[3])) : 1;
+
+	vector<cv::Mat> frames;
+	if(!Benchmark::LoadFrames(argv[1], frames))
+	{
+		return 2;
+	}
+
+	vector<cv::Mat_<uchar> > grayscale_frames;
+	Benchmark::ToGrayscale(frames, grayscale_frames);
+
+	LandmarkDetector::FaceModelParameters params;
+	LandmarkDetector::CLNF clnf_model(params.model_location);
+	if(clnf_model.pdm.NumberOfPoints() == 0)
+	{
+		return 2;
+	}
+
+	vector<Run> runs(3);
+	runs[0].name = "No prediction";
+	runs[1].name = "Pose prediction";
+	runs[2].name = "Pose and shape prediction";
+
+	params.use_motion_prediction = false;
+	params.predict_shape = false;
+	Track(runs[0], grayscale_frames, frame_step, clnf_model, params);
+
+	params.use_motion_prediction = true;
+	Track(runs[1], grayscale_frames, frame_step, clnf_model, params);
+
+	params.predict_shape = true;
+	Track(runs[2], grayscale_frames, frame_step, clnf_model, params);
+
+	// The references are the annotations if there are any, the tracking without the prediction otherwise
+	vector<cv::Mat_<double> > references;
+	for(size_t f = 0, i = 0; f < grayscale_frames.size(); f += frame_step, ++i)
+	{
+		if(annotations != "-")
+		{
+			char name[32];
+			sprintf(name, "/%06d.pts", (int)f + 1);
+			references.push_back(ReadPts(annotations + name));
+		}
+		else
+		{
+			references.push_back(runs[0].landmarks[i]);
+		}
+	}
+
+	cout << grayscale_frames.size() << " frames, every " << frame_step << (annotations != "-" ? ", errors to the annotations" : ", errors to the tracking without prediction") << endl;
+
+	for(size_t r = 0; r < runs.size(); ++r)
+	{
+		for(size_t i = 0; i < references.size(); ++i)
+		{
+			if(!references[i].empty() && references[i].rows == runs[r].landmarks[i].rows)
+			{
+				runs[r].errors.Add(NormalisedError(runs[r].landmarks[i], references[i]));
+			}
+		}
+
+		cout << runs[r].name << ": " << runs[r].failures << " failed fits, " << runs[r].iterations / runs[r].fit_times.Count() << " iterations per fit, error median "
+			<< runs[r].errors.Percentile(0.5) << ", p95 " << runs[r].errors.Percentile(0.95) << ", mean " << runs[r].errors.Mean() << endl;
+		runs[r].fit_times.Report(runs[r].name + " fit");
+	}
+
+	return 0;
+}
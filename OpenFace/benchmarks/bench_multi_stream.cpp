@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Replays a video into several streams of a MultiStreamEngine in real time and reports the latency and throughput of each
+//
+//  bench_multi_stream <video or image sequence> [streams = 4] [fps = 30] [latency target in ms = 100] [max faces = 1] [passes = 1]
+//
+//  The streams are fed from the same frames (staggered within a frame period, as unsynchronised cameras would be), with the capture
+//  time taken when a frame is pushed. Run from the OpenFace directory (the model is read from model/main_clnf_general.txt).
+
+#include <MultiStreamEngine.h>
+
+#include <BenchmarkUtils.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "Usage: bench_multi_stream <video or image sequence> [streams = 4] [fps = 30] [latency target in ms = 100] [max faces = 1] [passes = 1]" << endl;
+		return 2;
+	}
+
+	int num_streams = argc > 2 ? atoi(argv[2]) : 4;
+	double fps = argc > 3 ? atof(argv[3]) : 30;
+	double latency_target = (argc > 4 ? atof(argv[4]) : 100) / 1000.0;
+	int max_faces = argc > 5 ? atoi(argv[5]) : 1;
+	int passes = argc > 6 ? atoi(argv[6]) : 1;
+
+	vector<cv::Mat> frames;
+	if(!Benchmark::LoadFrames(argv[1], frames))
+	{
+		return 2;
+	}
+
+	vector<cv::Mat_<uchar> > grayscale_frames;
+	Benchmark::ToGrayscale(frames, grayscale_frames);
+
+	LandmarkDetector::FaceModelParameters params;
+	LandmarkDetector::MultiStreamEngine engine;
+	if(!engine.LoadModel(params))
+	{
+		return 2;
+	}
+
+	vector<int> stream_ids;
+	for(int s = 0; s < num_streams; ++s)
+	{
+		stream_ids.push_back(engine.RegisterStream(latency_target, max_faces));
+	}
+
+	// The latencies of all of the results, as they are popped
+	Benchmark::Timings latencies;
+	LandmarkDetector::StreamResult result;
+
+	const double frame_period = 1.0 / fps;
+	const int num_pushes = (int)grayscale_frames.size() * passes;
+	const double start = Benchmark::Now();
+
+	for(int f = 0; f < num_pushes; ++f)
+	{
+		for(int s = 0; s < num_streams; ++s)
+		{
+			double push_time = start + f * frame_period + s * frame_period / num_streams;
+			double wait = push_time - Benchmark::Now();
+			if(wait > 0)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds((long long)(wait * 1e6)));
+			}
+			engine.PushFrame(stream_ids[s], grayscale_frames[f % grayscale_frames.size()], Benchmark::Now());
+		}
+
+		for(int s = 0; s < num_streams; ++s)
+		{
+			while(engine.PopResult(stream_ids[s], result))
+			{
+				latencies.Add(result.latency);
+			}
+		}
+	}
+
+	engine.WaitForIdle();
+	const double duration = Benchmark::Now() - start;
+
+	cout << num_streams << " streams at " << fps << " fps for " << duration << " s, latency target " << latency_target * 1000 << " ms" << endl;
+
+	int total_processed = 0;
+	int total_dropped = 0;
+	for(int s = 0; s < num_streams; ++s)
+	{
+		while(engine.PopResult(stream_ids[s], result))
+		{
+			latencies.Add(result.latency);
+		}
+
+		LandmarkDetector::StreamStats stats;
+		engine.GetStats(stream_ids[s], stats);
+		cout << "Stream " << stream_ids[s] << ": " << stats.frames_pushed << " pushed, " << stats.frames_processed << " processed, " << stats.frames_dropped
+			<< " dropped, " << stats.throughput << " fps, mean latency " << stats.mean_latency * 1000 << " ms, p99 " << stats.p99_latency * 1000 << " ms" << endl;
+
+		total_processed += stats.frames_processed;
+		total_dropped += stats.frames_dropped;
+	}
+
+	cout << "All streams: " << total_processed / duration << " frames/s processed, " << total_dropped << " dropped" << endl;
+	latencies.Report("Latency");
+	cout << "p99 latency " << latencies.Percentile(0.99) * 1000 << " ms" << endl;
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Times fitting the PDM parameters to landmarks (PDM::CalcParams) on the 68 point face model and the 28 point eye model
+//
+//  bench_pdm [fits = 10000]
+//
+//  The landmarks are generated from random (but plausible) parameters with a pixel of noise. Each PDM is fitted with a new workspace
+//  per call and with one workspace reused over the calls, as the landmark detector does, and the parameters of both have to be the
+//  same. Returns 1 if they differ. Run from the OpenFace directory (the PDMs are read from model/).
+
+#include <LandmarkCoreIncludes.h>
+
+#include <BenchmarkUtils.h>
+
+#include <cstdlib>
+
+using namespace std;
+
+namespace
+{
+	// Landmarks of a random shape, with the scale and the position of a face (or an eye) in a video frame
+	void RandomLandmarks(cv::Mat_<double>& landmarks, const LandmarkDetector::PDM& pdm, double scale, cv::RNG& rng)
+	{
+		cv::Mat_<double> params_local(pdm.NumberOfModes(), 1);
+		for(int i = 0; i < pdm.NumberOfModes(); ++i)
+		{
+			params_local(i) = rng.gaussian(0.5 * sqrt(pdm.eigen_values.at<double>(i)));
+		}
+
+		cv::Vec6d params_global(scale * rng.uniform(0.8, 1.2), rng.uniform(-0.3, 0.3), rng.uniform(-0.5, 0.5), rng.uniform(-0.3, 0.3),
+			rng.uniform(200.0, 440.0), rng.uniform(150.0, 330.0));
+
+		pdm.CalcShape2D(landmarks, params_local, params_global);
+		for(int i = 0; i < landmarks.rows; ++i)
+		{
+			landmarks(i) += rng.gaussian(1.0);
+		}
+	}
+
+	// Returns the number of fits of which the two ways differ
+	int Compare(const string& name, const string& location, double scale, int num_fits)
+	{
+		LandmarkDetector::PDM pdm;
+		pdm.Read(location);
+		if(pdm.NumberOfPoints() == 0)
+		{
+			cout << "Couldn't read the PDM " << location << endl;
+			return num_fits;
+		}
+
+		cv::RNG rng(0);
+		vector<cv::Mat_<double> > landmarks(num_fits);
+		for(int f = 0; f < num_fits; ++f)
+		{
+			RandomLandmarks(landmarks[f], pdm, scale, rng);
+		}
+
+		vector<cv::Vec6d> new_globals(num_fits);
+		vector<cv::Mat_<double> > new_locals(num_fits);
+		vector<cv::Vec6d> reused_globals(num_fits);
+		vector<cv::Mat_<double> > reused_locals(num_fits);
+		for(int f = 0; f < num_fits; ++f)
+		{
+			new_locals[f].create(pdm.NumberOfModes(), 1);
+			reused_locals[f].create(pdm.NumberOfModes(), 1);
+		}
+
+		Benchmark::Timings new_workspace;
+		for(int f = 0; f < num_fits; ++f)
+		{
+			double start = Benchmark::Now();
+			pdm.CalcParams(new_globals[f], new_locals[f], landmarks[f]);
+			new_workspace.Add(Benchmark::Now() - start);
+		}
+
+		Benchmark::Timings reused_workspace;
+		LandmarkDetector::PDM::CalcParamsWorkspace workspace;
+		for(int f = 0; f < num_fits; ++f)
+		{
+			double start = Benchmark::Now();
+			pdm.CalcParams(reused_globals[f], reused_locals[f], landmarks[f], cv::Vec3d(0.0), workspace);
+			reused_workspace.Add(Benchmark::Now() - start);
+		}
+
+		int differences = 0;
+		for(int f = 0; f < num_fits; ++f)
+		{
+			if(new_globals[f] != reused_globals[f] || cv::norm(new_locals[f], reused_locals[f], cv::NORM_INF) != 0)
+			{
+				differences++;
+			}
+		}
+
+		cout << name << " (" << pdm.NumberOfPoints() << " points, " << pdm.NumberOfModes() << " modes): " << differences << " fits differ" << endl;
+		new_workspace.Report("  new workspace");
+		reused_workspace.Report("  reused workspace");
+
+		return differences;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int num_fits = argc > 1 ? atoi(argv[1]) : 10000;
+	if(num_fits <= 0)
+	{
+		cout << "Usage: bench_pdm [fits = 10000]" << endl;
+		return 2;
+	}
+
+	int differences = Compare("Face", "model/pdms/In-the-wild_aligned_PDM_68.txt", 3.0, num_fits);
+	differences += Compare("Eye", "model/model_eye/pdms/pdm_28_l_eye_3D_closed.txt", 2.0, num_fits);
+
+	return differences == 0 ? 0 : 1;
+}
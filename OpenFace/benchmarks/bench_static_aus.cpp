@@ -0,0 +1,220 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Measures how FaceAnalyser::PredictStaticAUsBatch scales with the number of cores, in faces per second
+//
+//  bench_static_aus <video or image sequence> [faces per batch = 256] [batches = 10] [max threads = hardware concurrency]
+//
+//  Faces are fitted on up to 8 frames spread over the video, and a batch cycles over them (the work per face does not depend on
+//  which one it is). Each batch is run in a TrackerArena of 1, 2, 4, ... threads, with OpenCV limited to the same number, and the
+//  per face predictions of every thread count are checked against the single threaded ones (returns 1 if they differ). Run from the
+//  OpenFace directory (the models are read from model/ and AU_predictors/).
+
+#include <LandmarkCoreIncludes.h>
+#include <FaceAnalyser.h>
+#include <TrackerArena.h>
+
+#include <BenchmarkUtils.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+	double LargestDifference(const vector<vector<pair<string, double> > >& a, const vector<vector<pair<string, double> > >& b)
+	{
+		double difference = 0;
+		for(size_t i = 0; i < a.size() && i < b.size(); ++i)
+		{
+			for(size_t au = 0; au < a[i].size() && au < b[i].size(); ++au)
+			{
+				difference = max(difference, std::abs(a[i][au].second - b[i][au].second));
+			}
+		}
+		return difference;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "Usage: bench_static_aus <video or image sequence> [faces per batch = 256] [batches = 10] [max threads = hardware concurrency]" << endl;
+		return 2;
+	}
+
+	int batch_size = argc > 2 ? atoi(argv[2]) : 256;
+	int num_batches = argc > 3 ? atoi(argv[3]) : 10;
+	int max_threads = argc > 4 ? atoi(argv[4]) : (int)std::thread::hardware_concurrency();
+	max_threads = max(1, max_threads);
+
+	vector<cv::Mat> frames;
+	if(!Benchmark::LoadFrames(argv[1], frames))
+	{
+		return 2;
+	}
+
+	vector<cv::Mat_<uchar> > grayscale_frames;
+	Benchmark::ToGrayscale(frames, grayscale_frames);
+
+	LandmarkDetector::FaceModelParameters params;
+	LandmarkDetector::CLNF clnf_model(params.model_location);
+	if(clnf_model.pdm.NumberOfPoints() == 0)
+	{
+		return 2;
+	}
+
+	// A copy of the model for each sampled frame, the copies are heavy so only a few are kept
+	const size_t num_samples = min((size_t)8, frames.size());
+	vector<LandmarkDetector::CLNF> fitted_models;
+	vector<cv::Mat> fitted_frames;
+	fitted_models.reserve(num_samples);
+	for(size_t f = 0, next = 0; f < frames.size() && fitted_models.size() < num_samples; ++f)
+	{
+		LandmarkDetector::DetectLandmarksInVideo(grayscale_frames[f], clnf_model, params);
+		if(f >= next && clnf_model.detection_success)
+		{
+			fitted_models.push_back(clnf_model);
+			fitted_frames.push_back(frames[f]);
+			next = f + frames.size() / num_samples;
+		}
+	}
+
+	if(fitted_models.empty())
+	{
+		cout << "No face tracked in " << argv[1] << endl;
+		return 2;
+	}
+
+	vector<cv::Mat> batch_frames(batch_size);
+	vector<const LandmarkDetector::CLNF*> batch_models(batch_size);
+	for(int i = 0; i < batch_size; ++i)
+	{
+		batch_frames[i] = fitted_frames[i % fitted_frames.size()];
+		batch_models[i] = &fitted_models[i % fitted_models.size()];
+	}
+
+	FaceAnalysis::FaceAnalyser face_analyser;
+
+	cout << batch_size << " faces per batch from " << fitted_models.size() << " fitted frames, " << num_batches << " batches" << endl;
+
+	// Powers of two up to the largest thread count, and that one
+	vector<int> thread_counts;
+	for(int threads = 1; threads < max_threads; threads *= 2)
+	{
+		thread_counts.push_back(threads);
+	}
+	thread_counts.push_back(max_threads);
+
+	// The descriptors are predicted in single precision, differently split products can differ in the last bits
+	const double tolerance = 1e-4;
+
+	vector<vector<pair<string, double> > > reference_intensities, reference_occurences;
+	double single_thread_rate = 0;
+	int failures = 0;
+
+	for(size_t t = 0; t < thread_counts.size(); ++t)
+	{
+		const int threads = thread_counts[t];
+		LandmarkDetector::TrackerArena arena;
+		arena.Configure(threads);
+		cv::setNumThreads(threads);
+
+		vector<vector<pair<string, double> > > intensities, occurences;
+		Benchmark::Timings batch_times;
+
+		// One batch first to warm up the arena and the buffers
+		for(int b = 0; b <= num_batches; ++b)
+		{
+			double start = Benchmark::Now();
+			arena.Execute([&]()
+			{
+				face_analyser.PredictStaticAUsBatch(intensities, occurences, batch_frames, batch_models);
+			});
+			if(b > 0)
+			{
+				batch_times.Add(Benchmark::Now() - start);
+			}
+		}
+
+		if(threads == 1)
+		{
+			reference_intensities = intensities;
+			reference_occurences = occurences;
+		}
+		double difference = max(LargestDifference(intensities, reference_intensities), LargestDifference(occurences, reference_occurences));
+		if(difference > tolerance)
+		{
+			failures++;
+		}
+
+		double rate = batch_size / batch_times.Percentile(0.5);
+		if(threads == 1)
+		{
+			single_thread_rate = rate;
+		}
+
+		cout << threads << " threads: " << rate << " faces/s, speed up " << rate / single_thread_rate << ", largest difference to 1 thread " << difference << endl;
+		batch_times.Report("  batch");
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Timing and input helpers shared by the standalone benchmarks
+#ifndef __BENCHMARK_UTILS_h_
+#define __BENCHMARK_UTILS_h_
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+// System includes
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace Benchmark
+{
+
+// Wall clock time in seconds
+inline double Now()
+{
+	return cv::getTickCount() / cv::getTickFrequency();
+}
+
+// CPU time of the process (all of its threads) in seconds
+inline double CpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER kernel_time, user_time;
+	kernel_time.LowPart = kernel.dwLowDateTime;
+	kernel_time.HighPart = kernel.dwHighDateTime;
+	user_time.LowPart = user.dwLowDateTime;
+	user_time.HighPart = user.dwHighDateTime;
+	return (kernel_time.QuadPart + user_time.QuadPart) * 1e-7;
+#else
+	return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// The durations (in seconds) of repeated runs of something
+class Timings
+{
+
+public:
+
+	void Add(double seconds) { samples.push_back(seconds); }
+
+	size_t Count() const { return samples.size(); }
+
+	double Mean() const
+	{
+		double sum = 0;
+		for(size_t i = 0; i < samples.size(); ++i)
+		{
+			sum += samples[i];
+		}
+		return samples.empty() ? 0 : sum / samples.size();
+	}
+
+	// p in [0, 1], 0.5 is the median
+	double Percentile(double p) const
+	{
+		if(samples.empty())
+		{
+			return 0;
+		}
+		vector<double> sorted(samples);
+		std::sort(sorted.begin(), sorted.end());
+		size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+		return sorted[index];
+	}
+
+	// Median, 95th percentile and mean in milliseconds
+	void Report(const string& name) const
+	{
+		cout << name << ": median " << Percentile(0.5) * 1000 << " ms, p95 " << Percentile(0.95) * 1000 << " ms, mean " << Mean() * 1000
+			<< " ms (" << Count() << " runs)" << endl;
+	}
+
+private:
+
+	vector<double> samples;
+};
+
+// Reads up to max_frames frames (all of them if max_frames <= 0) of a video file or of an image sequence (e.g. "frames/%04d.png")
+inline bool LoadFrames(const string& location, vector<cv::Mat>& frames, int max_frames = 0)
+{
+	cv::VideoCapture capture(location);
+	if(!capture.isOpened())
+	{
+		cout << "Couldn't open " << location << endl;
+		return false;
+	}
+
+	cv::Mat frame;
+	while((max_frames <= 0 || (int)frames.size() < max_frames) && capture.read(frame))
+	{
+		frames.push_back(frame.clone());
+	}
+
+	if(frames.empty())
+	{
+		cout << "No frames in " << location << endl;
+		return false;
+	}
+	return true;
+}
+
+// Grayscale versions of the frames, as the landmark detector uses
+inline void ToGrayscale(const vector<cv::Mat>& frames, vector<cv::Mat_<uchar> >& grayscale_frames)
+{
+	grayscale_frames.resize(frames.size());
+	for(size_t i = 0; i < frames.size(); ++i)
+	{
+		if(frames[i].channels() == 3)
+		{
+			cv::cvtColor(frames[i], grayscale_frames[i], cv::COLOR_BGR2GRAY);
+		}
+		else
+		{
+			grayscale_frames[i] = frames[i].clone();
+		}
+	}
+}
+
+}
+#endif
@@ -0,0 +1,11 @@
+// stdafx.h of the standalone benchmarks, the core sources include it as "../stdafx.h" (found through the common directory)
+// instead of the one of the DLL, which pulls in the EyesWeb SDK
+
+#pragma once
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN		// Exclude rarely-used stuff from Windows headers
+#define NOMINMAX
+
+#include <windows.h>
+#endif
@@ -0,0 +1,160 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AUHISTORY_h_
+#define __AUHISTORY_h_
+
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <functional>
+
+namespace FaceAnalysis
+{
+
+// A run of consecutive frames of the history, column by column
+struct AUHistoryChunk
+{
+	// The index of the first frame since the history was cleared
+	size_t first_frame;
+	int num_frames;
+
+	std::vector<double> timestamps;
+	std::vector<double> confidences;
+	std::vector<char> successes;
+
+	// The predictions, num_frames values of the first column followed by those of the second one and so on
+	std::vector<double> values;
+
+	const double* Column(int column) const
+	{
+		return values.data() + (size_t)column * num_frames;
+	}
+};
+
+// The per frame AU predictions (and their timestamps, confidences and successes) in fixed index columns, instead of looking every
+// AU up by its name. The frames are kept in memory, either all of them or, for long running online use, only the most recent ones
+// in a ring buffer. The complete history can also be appended to a binary file, a chunk of frames at a time with each column
+// contiguous, from which it is streamed back, so that the memory use stays flat however long the history gets.
+class AUHistory{
+
+public:
+
+	AUHistory() : num_columns(0), requested_capacity(0), capacity(0), num_frames(0), pending_frames(0)
+	{}
+
+	// The number of prediction columns, this clears the history
+	void Initialise(int columns);
+
+	// How many of the most recent frames to keep in memory (0 to keep all of them) and the file to append the history to (none if
+	// empty), this clears the history. With a file at most chunk_frames frames are kept in memory if no capacity is given.
+	void SetLimits(int capacity_frames, const std::string& spill_location);
+
+	// Forget all the frames (and start the file anew)
+	void Clear();
+
+	void Append(double timestamp, double confidence, bool success, const std::vector<double>& values);
+
+	// Replace the predictions of a frame that was already appended
+	void Overwrite(size_t frame, const std::vector<double>& values);
+
+	// All the frames since clearing, if there is no file the ones that are still in memory
+	size_t NumFrames() const
+	{
+		return num_frames;
+	}
+
+	// Hand the history over to the consumer in chunks of consecutive frames, in order, from the file if there is one
+	void Stream(const std::function<void(const AUHistoryChunk&)>& consumer);
+
+private:
+
+	int num_columns;
+
+	// The frames in memory, a ring buffer if there is a capacity (the slot of a frame is its index modulo the capacity). The
+	// capacity is the requested one, or chunk_frames if that is 0 and the history goes to a file
+	int requested_capacity;
+	int capacity;
+	size_t num_frames;
+	std::vector<double> timestamps;
+	std::vector<double> confidences;
+	std::vector<char> successes;
+	std::vector<std::vector<double> > value_columns;
+
+	// The file, the frames not written to it yet and the overwrites of the frames that were
+	std::string spill_location;
+	std::ofstream spill_stream;
+	AUHistoryChunk pending;
+	int pending_frames;
+	std::map<size_t, std::vector<double> > spilled_overwrites;
+
+	// The frames written at once
+	static const int chunk_frames = 1024;
+
+	size_t FirstFrameInMemory() const;
+
+	void FlushPending();
+
+	void StreamMemory(const std::function<void(const AUHistoryChunk&)>& consumer);
+	void StreamFile(const std::function<void(const AUHistoryChunk&)>& consumer);
+
+};
+  //===========================================================================
+}
+#endif
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AULINPREDICTORS_h_
+#define __AULINPREDICTORS_h_
+
+#include <vector>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+#include "SVR_static_lin_regressors.h"
+#include "SVR_dynamic_lin_regressors.h"
+#include "SVM_static_lin.h"
+#include "SVM_dynamic_lin.h"
+
+namespace FaceAnalysis
+{
+
+// All the linear AU regressors and classifiers packed into one single precision matrix, so that the AUs of a frame are predicted in
+// one pass over the descriptor. The means are folded into the biases, (x - means) * W + b = x * W + (b - means * W), so the static
+// predictors are applied to the descriptor and the dynamic ones to the descriptor minus its running median.
+class AU_lin_predictors{
+
+public:
+
+	AU_lin_predictors() : num_reg(0), num_class(0), num_static_cols(0)
+	{}
+
+	// Pack the predictors once they are read
+	void Pack(const SVR_static_lin_regressors& svr_static, const SVR_dynamic_lin_regressors& svr_dynamic, const SVM_static_lin& svm_static, const SVM_dynamic_lin& svm_dynamic);
+
+	bool Empty() const
+	{
+		return weights.empty();
+	}
+
+	// Predict all the AUs into a fixed index array, the intensities of the static and then the dynamic regressors followed by the
+	// presence of the static and then the dynamic classifiers (the order of the names from FaceAnalyser)
+	void Predict(std::vector<double>& predictions, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params, const cv::Mat_<double>& running_median, const cv::Mat_<double>& running_median_geom);
+
+	// The same for many frames at once with the same running median, as matrix products over blocks of frames (the blocks in
+	// parallel), a row of predictions per frame
+	void PredictBatch(cv::Mat_<double>& predictions, const std::vector<cv::Mat_<double> >& fhog_descriptors, const std::vector<cv::Mat_<double> >& geom_params, const cv::Mat_<double>& running_median, const cv::Mat_<double>& running_median_geom);
+
+	int NumReg() const
+	{
+		return num_reg;
+	}
+
+	int NumClass() const
+	{
+		return num_class;
+	}
+
+private:
+
+	int num_reg;
+	int num_class;
+
+	// The weights of every predictor, a row per descriptor dimension and a column per predictor. The columns of the static
+	// predictors come first (padded to a multiple of 4), followed by the dynamic ones
+	cv::Mat_<float> weights;
+	cv::Mat_<float> biases;
+	int num_static_cols;
+
+	// Where the prediction of each column goes, -1 for the padding
+	std::vector<int> column_output;
+
+	// For the classifiers the predictions for a positive and a negative decision value, indexed by prediction
+	std::vector<double> pos_classes;
+	std::vector<double> neg_classes;
+
+	// The decision values of the current frame
+	cv::Mat_<float> decisions;
+
+	// The frames multiplied at once by PredictBatch (to bound the memory of the single precision copies of the descriptors)
+	static const int batch_frames = 512;
+
+};
+  //===========================================================================
+}
+#endif
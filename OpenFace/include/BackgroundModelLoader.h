@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Loading a landmark detector model on a worker thread while the current one keeps tracking
+#ifndef __BACKGROUND_MODEL_LOADER_h_
+#define __BACKGROUND_MODEL_LOADER_h_
+
+// Local includes
+#include "LandmarkDetectorModel.h"
+
+// System includes
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+namespace LandmarkDetector
+{
+
+// Load reads the model on a worker thread and returns immediately, the caller keeps tracking with its current model and picks
+// the new one up with TakeLoaded (typically at the start of its next frame). If Load is called again while a model is being
+// read, only the newest location is loaded once the current read finishes. A model that fails to load is never handed over.
+class BackgroundModelLoader
+{
+
+public:
+
+	BackgroundModelLoader() : worker_active(false), has_pending(false)
+	{
+	}
+
+	// Waits for the model that is being read (the pending one is not read)
+	~BackgroundModelLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			has_pending = false;
+		}
+		if(worker.joinable())
+		{
+			worker.join();
+		}
+	}
+
+	void Load(const string& location)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		pending_location = location;
+		has_pending = true;
+
+		if(!worker_active)
+		{
+			// The previous worker has run out of work (or was never started)
+			if(worker.joinable())
+			{
+				worker.join();
+			}
+			worker_active = true;
+			worker = std::thread(&BackgroundModelLoader::Run, this);
+		}
+	}
+
+	// Is there a loaded model that was not taken yet
+	bool Loaded()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return loaded != nullptr;
+	}
+
+	// Replaces o_model with the newest loaded model if there is one that was not taken yet
+	bool TakeLoaded(CLNF& o_model, string& o_location)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if(!loaded)
+		{
+			return false;
+		}
+
+		o_model = std::move(*loaded);
+		o_location = loaded_location;
+		loaded.reset();
+
+		return true;
+	}
+
+private:
+
+	std::thread worker;
+	std::mutex mutex;
+	bool worker_active;
+
+	string pending_location;
+	bool has_pending;
+
+	unique_ptr<CLNF> loaded;
+	string loaded_location;
+
+	void Run()
+	{
+		while(true)
+		{
+			string location;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(!has_pending)
+				{
+					worker_active = false;
+					return;
+				}
+				location = pending_location;
+				has_pending = false;
+			}
+
+			unique_ptr<CLNF> model(new CLNF(location));
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				// Only hand over the newest model, and only if it was read (the reading does not throw on a missing file)
+				if(!has_pending && model->pdm.NumberOfPoints() > 0)
+				{
+					loaded = std::move(model);
+					loaded_location = location;
+				}
+			}
+		}
+	}
+
+	BackgroundModelLoader(const BackgroundModelLoader&);
+	BackgroundModelLoader& operator= (const BackgroundModelLoader&);
+};
+
+}
+#endif
@@ -63,6 +63,10 @@
 #include "SVR_static_lin_regressors.h"
 #include "SVM_static_lin.h"
 #include "SVM_dynamic_lin.h"
+#include "HistogramMedian.h"
+#include "AU_lin_predictors.h"
+#include "AU_history.h"
+#include "FaceAligner.h"
 
 #include <string>
 #include <vector>
@@ -103,6 +107,10 @@ public:
 	// This call is useful for detecting action units in images
 	std::pair<std::vector<std::pair<string, double>>, std::vector<std::pair<string, double>>> PredictStaticAUs(const cv::Mat& frame, const LandmarkDetector::CLNF& clnf, bool visualise = true);
 
+	// The same for many images at once, each with the model fitted on it. The faces are aligned and their descriptors extracted in
+	// parallel and all the AUs are predicted as matrix products over the faces, an intensity and a presence vector per face
+	void PredictStaticAUsBatch(vector<vector<pair<string, double>>>& intensities, vector<vector<pair<string, double>>>& occurences, const vector<cv::Mat>& frames, const vector<const LandmarkDetector::CLNF*>& clnf_models);
+
 	void Reset();
 
 	void GetLatestHOG(cv::Mat_<double>& hog_descriptor, int& num_rows, int& num_cols);
@@ -130,6 +138,11 @@ public:
 	void ExtractAllPredictionsOfflineReg(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps, bool dynamic);
 	void ExtractAllPredictionsOfflineClass(vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps, bool dynamic);
 
+	// By default the predictions of every frame are kept in memory for the offline extraction. For long running use keep only the
+	// most recent capacity_frames frames in memory, and optionally append the complete history to a file (from which the offline
+	// extraction streams it back). This clears the history.
+	void SetHistoryLimits(int capacity_frames, const std::string& spill_location = "");
+
 private:
 
 	// Where the predictions are kept
@@ -138,12 +151,14 @@ private:
 
 	std::vector<std::pair<std::string, double>> AU_predictions_combined;
 
-	// Keeping track of AU predictions over time (useful for post-processing)
-	vector<double> timestamps;
-	std::map<std::string, vector<double>> AU_predictions_reg_all_hist;
-	std::map<std::string, vector<double>> AU_predictions_class_all_hist;
-	std::vector<double> confidences;
-	std::vector<bool> valid_preds;
+	// Keeping track of AU predictions over time (useful for post-processing), the intensities followed by the presence
+	AUHistory AU_history;
+	vector<double> AU_history_row;
+
+	void AppendToHistory(double timestamp, double confidence, bool success);
+
+	// The history of the AUs starting at first_column (in the order of their names)
+	void ReadHistory(int first_column, const vector<string>& au_names, vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps);
 
 	int frames_tracking;
 
@@ -152,6 +167,9 @@ private:
 	cv::Mat aligned_face;
 	cv::Mat hog_descriptor_visualisation;
 
+	// Aligns into aligned_face, keeping its buffers and the face mask from frame to frame
+	FaceAligner face_aligner;
+
 	// Private members to be used for predictions
 	// The HOG descriptor of the last frame
 	cv::Mat_<double> hog_desc_frame;
@@ -164,26 +182,23 @@ private:
 
 	// Use histograms for quick (but approximate) median computation
 	// Use the same for
-	vector<cv::Mat_<unsigned int> > hog_desc_hist;
+	vector<HistogramMedian> hog_desc_hist;
 
 	// This is not being used at the moment as it is a bit slow
-	vector<cv::Mat_<unsigned int> > face_image_hist;
-	vector<int> face_image_hist_sum;
+	vector<HistogramMedian> face_image_hist;
 
 	vector<cv::Vec3d> head_orientations;
 
 	int num_bins_hog;
 	double min_val_hog;
 	double max_val_hog;
-	vector<int> hog_hist_sum;
 	int view_used;
 
 	// The geometry descriptor (rigid followed by non-rigid shape parameters from CLNF)
 	cv::Mat_<double> geom_descriptor_frame;
 	cv::Mat_<double> geom_descriptor_median;
 	
-	int geom_hist_sum;
-	cv::Mat_<unsigned int> geom_desc_hist;
+	HistogramMedian geom_desc_hist;
 	int num_bins_geom;
 	double min_val_geom;
 	double max_val_geom;
@@ -195,6 +210,10 @@ private:
 	std::vector<std::pair<std::string, double>> PredictCurrentAUs(int view);
 	std::vector<std::pair<std::string, double>> PredictCurrentAUsClass(int view);
 
+	// Both the intensities and the presence from a single pass of the packed predictors, the values are written in place if the
+	// vectors already hold the AUs
+	void PredictCurrentAUsAll(int view, std::vector<std::pair<std::string, double>>& predictions_reg, std::vector<std::pair<std::string, double>>& predictions_class);
+
 	// special step for online (rather than offline AU prediction)
 	std::vector<pair<string, double>> CorrectOnlineAUs(std::vector<std::pair<std::string, double>> predictions_orig, int view, bool dyn_shift = false, bool dyn_scale = false, bool update_track = true, bool clip_values = false);
 
@@ -205,8 +224,8 @@ private:
 	// A utility function for keeping track of approximate running medians used for AU and emotion inference using a set of histograms (the histograms are evenly spaced from min_val to max_val)
 	// Descriptor has to be a row vector
 	// TODO this duplicates some other code
-	void UpdateRunningMedian(cv::Mat_<unsigned int>& histogram, int& hist_sum, cv::Mat_<double>& median, const cv::Mat_<double>& descriptor, bool update, int num_bins, double min_val, double max_val);
-	void ExtractMedian(cv::Mat_<unsigned int>& histogram, int hist_count, cv::Mat_<double>& median, int num_bins, double min_val, double max_val);
+	void UpdateRunningMedian(HistogramMedian& histogram, cv::Mat_<double>& median, const cv::Mat_<double>& descriptor, bool update, int num_bins, double min_val, double max_val);
+	void ExtractMedian(const HistogramMedian& histogram_median, cv::Mat_<double>& median, int num_bins, double min_val, double max_val);
 	
 	// The linear SVR regressors
 	SVR_static_lin_regressors AU_SVR_static_appearance_lin_regressors;
@@ -216,6 +235,10 @@ private:
 	SVM_static_lin AU_SVM_static_appearance_lin;
 	SVM_dynamic_lin AU_SVM_dynamic_appearance_lin;
 
+	// All of the above packed together (after reading), and their predictions for the current frame
+	AU_lin_predictors AU_lin_packed;
+	vector<double> AU_predictions_packed;
+
 	// The AUs predicted by the model are not always 0 calibrated to a person. That is they don't always predict 0 for a neutral expression
 	// Keeping track of the predictions we can correct for this, by assuming that at least "ratio" of frames are neutral and subtract that value of prediction, only perform the correction after min_frames
 	void UpdatePredictionTrack(cv::Mat_<unsigned int>& prediction_corr_histogram, int& prediction_correction_count, vector<double>& correction, const vector<pair<string, double>>& predictions, double ratio=0.25, int num_bins = 200, double min_val = -3, double max_val = 5, int min_frames = 10);
@@ -248,6 +271,7 @@ private:
 	vector<cv::Mat_<double>> hog_desc_frames_init;
 	vector<cv::Mat_<double>> geom_descriptor_frames_init;
 	vector<int> views;
+	vector<size_t> frames_init;
 	bool postprocessed = false;
 	int frames_tracking_succ = 0;
 
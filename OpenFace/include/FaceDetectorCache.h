@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  A process wide cache of the face detectors used for (re)initialisation
+#ifndef __FACE_DETECTOR_CACHE_h_
+#define __FACE_DETECTOR_CACHE_h_
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect.hpp>
+
+// dlib dependencies for face detection
+#include <dlib/image_processing/frontal_face_detector.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace LandmarkDetector
+{
+	// The default location of the Haar cascade used when no classifier is provided
+	const string default_haar_location = "./classifiers/haarcascade_frontalface_alt.xml";
+
+	//===========================================================================
+	// Loading the detectors (reading the cascade from disk or deserialising the HOG SVM) is much more expensive than
+	// a single detection on a small image, so they are loaded once per process. Neither detector can be used concurrently
+	// so the cache keeps a pool of clones, a caller borrows one for as long as the handle lives and it is returned to the
+	// pool afterwards (a new clone is only made when all of the existing ones are in use)
+	//===========================================================================
+
+	// A borrowed Haar cascade classifier
+	class CachedHaarDetector
+	{
+	public:
+
+		CachedHaarDetector(const string& location = default_haar_location);
+		~CachedHaarDetector();
+
+		// The classifier will be empty if the cascade could not be loaded
+		cv::CascadeClassifier& Get() { return *detector; }
+		bool Empty() const { return detector->empty(); }
+
+	private:
+
+		string location;
+		cv::CascadeClassifier* detector;
+
+		// The handle owns the borrowed detector, so it can not be copied
+		CachedHaarDetector(const CachedHaarDetector&);
+		CachedHaarDetector& operator= (const CachedHaarDetector&);
+	};
+
+	// A borrowed HOG SVM face detector
+	class CachedHOGDetector
+	{
+	public:
+
+		CachedHOGDetector();
+		~CachedHOGDetector();
+
+		dlib::frontal_face_detector& Get() { return *detector; }
+
+	private:
+
+		dlib::frontal_face_detector* detector;
+
+		// The handle owns the borrowed detector, so it can not be copied
+		CachedHOGDetector(const CachedHOGDetector&);
+		CachedHOGDetector& operator= (const CachedHOGDetector&);
+	};
+
+	// A private copy of the HOG SVM detector (copying the cached one is cheaper than dlib::get_frontal_face_detector)
+	dlib::frontal_face_detector CopyCachedHOGDetector();
+
+	// The fhog filter banks of a HOG SVM detector (one for each of its views) and their thresholds, as used by DetectHOGParallel
+	struct HOGFilterBanks
+	{
+		// The weights the filter banks were built from
+		vector<dlib::matrix<double,0,1> > weights;
+
+		vector<dlib::frontal_face_detector::image_scanner_type::fhog_filterbank> filters;
+		vector<double> thresholds;
+	};
+
+	// Building the filter banks takes an FFT of every filter, they only depend on the detector weights so they are built once for
+	// every distinct set of weights (the cached detectors and their copies all share one) and kept for the lifetime of the process
+	const HOGFilterBanks& GetHOGFilterBanks(const dlib::frontal_face_detector& detector);
+
+}
+#endif
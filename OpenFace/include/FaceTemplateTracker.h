@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Template based tracking of fast moving faces in video
+#ifndef __FACE_TEMPLATE_TRACKER_h_
+#define __FACE_TEMPLATE_TRACKER_h_
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// System includes
+#include <map>
+
+using namespace std;
+
+namespace LandmarkDetector
+{
+
+// The template is stored once at a canonical scale (where the model scale equals the template scale parameter), the search
+// window is resampled to the same canonical scale every frame so the template spectrum can be cached across frames
+class FaceTemplateTracker
+{
+
+public:
+
+	// Time taken (in seconds) by the last Track and Update calls
+	double last_track_time;
+	double last_update_time;
+
+	// Appearance drift (1 - normalised cross-correlation) between the template and the face at the last Update
+	double last_drift;
+
+	FaceTemplateTracker();
+
+	// Is there a template to track with
+	bool Empty() const { return face_template.empty(); }
+
+	// Forget the template
+	void Reset();
+
+	// Compute the shift of the face (in image coordinates) from face_box, by matching the template in a window twice the size of the face
+	// model_scale is the current scale of the model (params_global[0])
+	bool Track(cv::Point2d& o_shift, const cv::Mat_<uchar>& grayscale_image, const cv::Rect& face_box, double model_scale, double template_scale);
+
+	// Called after a successful landmark detection, the template is only replaced if there is none yet or if the appearance
+	// of the face drifted from it by more than drift_threshold
+	void Update(const cv::Mat_<uchar>& grayscale_image, const cv::Rect& face_box, double model_scale, double template_scale, double drift_threshold);
+
+private:
+
+	// The template at the canonical scale
+	cv::Mat_<float> face_template;
+
+	// Precomputed template DFTs (as used by matchTemplate_m)
+	map<int, cv::Mat_<double> > template_dfts;
+
+	// Reused buffers for the resampled search window and the matching response
+	cv::Mat_<uchar> window_buffer;
+	cv::Mat_<float> window_float;
+	cv::Mat_<float> response;
+
+	// Resample a region of size (size / scaling) centred at centre into a buffer of the given size
+	void ResampleRegion(cv::Mat_<uchar>& o_region, const cv::Mat_<uchar>& grayscale_image, const cv::Point2d& centre, double scaling, const cv::Size& size) const;
+};
+
+}
+#endif
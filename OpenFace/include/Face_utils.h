@@ -64,6 +64,13 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "SimdSupport.h"
+
+// Define OPENFACE_NATIVE_FHOG as 1 (in the project settings) to have Extract_FHOG_descriptor use the native extraction instead of dlib
+#ifndef OPENFACE_NATIVE_FHOG
+#define OPENFACE_NATIVE_FHOG 0
+#endif
+
 namespace FaceAnalysis
 {
 	//===========================================================================	
@@ -73,7 +80,16 @@ namespace FaceAnalysis
 	void AlignFace(cv::Mat& aligned_face, const cv::Mat& frame, const LandmarkDetector::CLNF& clnf_model, bool rigid = true, double scale = 0.6, int width = 96, int height = 96);
 	void AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const LandmarkDetector::CLNF& clnf_model, const cv::Mat_<int>& triangulation, bool rigid = true, double scale = 0.6, int width = 96, int height = 96);
 
+	// Felzenszwalb HOG features (31 per cell) of the cells away from the border, row by row. Extracted with dlib unless
+	// OPENFACE_NATIVE_FHOG is set and the native extraction is available
 	void Extract_FHOG_descriptor(cv::Mat_<double>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size = 8);
+	void Extract_FHOG_descriptor_dlib(cv::Mat_<double>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size = 8);
+
+#if OPENFACE_SIMD128
+	// The same features computed natively in single precision (needs OpenCV 3.2 or newer), benchmarks/bench_fhog compares it with
+	// the dlib extraction
+	void Extract_FHOG_descriptor_native(cv::Mat_<float>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size = 8);
+#endif
 
 	void Visualise_FHOG(const cv::Mat_<double>& descriptor, int num_rows, int num_cols, cv::Mat& visualisation);
 
@@ -0,0 +1,306 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Fitting the frames of a video on a worker thread with latest-result semantics
+#ifndef __FRAME_PIPELINE_h_
+#define __FRAME_PIPELINE_h_
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// System includes
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace LandmarkDetector
+{
+
+// Push copies the frame into a ring buffer and returns immediately, a worker thread fits the frames in order and keeps the newest
+// result, which the caller picks up with TakeLatest (typically at its next frame). Each frame carries a Tag (e.g. the creation
+// time of the source frame and the camera parameters) that is handed to the fitting function and returned with its result.
+// With KEEP_LATEST only the newest frame waits, a frame that arrives while another is waiting replaces it. With KEEP_WITHIN_BUDGET
+// up to capacity frames wait and all of them are fitted, except for those that waited longer than the latency budget when a newer
+// one is available (and the oldest when the ring is full).
+// The fitting function runs on the worker thread, the result it fills in must not share buffers with the state of the fitting
+// (clone the matrices), as it is handed over to the caller thread. A frame of which the fitting throws is dropped.
+template<typename Tag, typename Result>
+class FramePipeline
+{
+
+public:
+
+	enum DropPolicy{KEEP_LATEST, KEEP_WITHIN_BUDGET};
+
+	typedef std::function<void(const cv::Mat& frame, const Tag& tag, Result& o_result)> FitFunction;
+
+	FramePipeline() : running(false), stopping(false), head(0), count(0), has_result(false), frames_dropped(0)
+	{
+	}
+
+	~FramePipeline()
+	{
+		Stop();
+	}
+
+	// Start the worker thread, latency_budget is in seconds
+	void Start(const FitFunction& fit_function, DropPolicy policy, int capacity, double latency_budget)
+	{
+		Stop();
+
+		fit = fit_function;
+		drop_policy = policy;
+		budget_ticks = (int64)(latency_budget * cv::getTickFrequency());
+
+		slots.clear();
+		slots.resize(policy == KEEP_LATEST ? 1 : max(1, capacity));
+		head = 0;
+		count = 0;
+		has_result = false;
+		frames_dropped = 0;
+
+		stopping = false;
+		running = true;
+		worker = std::thread(&FramePipeline::Run, this);
+	}
+
+	// Stop the worker thread once it finishes the current frame, the waiting frames are discarded
+	void Stop()
+	{
+		if(!running)
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(frames_mutex);
+			stopping = true;
+		}
+		frames_ready.notify_one();
+		worker.join();
+
+		running = false;
+	}
+
+	bool Running() const { return running; }
+
+	// Queue a copy of the frame, returns false if a waiting frame had to be dropped to make room for it
+	bool Push(const cv::Mat& frame, const Tag& tag)
+	{
+		bool dropped = false;
+		{
+			std::lock_guard<std::mutex> lock(frames_mutex);
+
+			if(count == (int)slots.size())
+			{
+				// Replace the newest waiting frame with KEEP_LATEST (there is only one), otherwise drop the oldest
+				if(drop_policy == KEEP_LATEST)
+				{
+					count--;
+				}
+				else
+				{
+					head = (head + 1) % slots.size();
+					count--;
+				}
+				frames_dropped++;
+				dropped = true;
+			}
+
+			Slot& slot = slots[(head + count) % slots.size()];
+
+			// Reuses the buffer of the slot when the frame size does not change
+			frame.copyTo(slot.frame);
+			slot.tag = tag;
+			slot.push_ticks = cv::getTickCount();
+			count++;
+		}
+		frames_ready.notify_one();
+
+		return !dropped;
+	}
+
+	// The newest result that was not taken yet, with the tag of its frame and the time (in seconds) since the frame was pushed
+	bool TakeLatest(Result& o_result, Tag& o_tag, double& o_age)
+	{
+		std::lock_guard<std::mutex> lock(result_mutex);
+
+		if(!has_result)
+		{
+			return false;
+		}
+
+		o_result = latest_result;
+		o_tag = latest_tag;
+		o_age = (cv::getTickCount() - latest_push_ticks) / cv::getTickFrequency();
+		has_result = false;
+
+		return true;
+	}
+
+	int FramesDropped()
+	{
+		std::lock_guard<std::mutex> lock(frames_mutex);
+		return frames_dropped;
+	}
+
+private:
+
+	struct Slot
+	{
+		cv::Mat frame;
+		Tag tag;
+		int64 push_ticks;
+	};
+
+	FitFunction fit;
+	DropPolicy drop_policy;
+	int64 budget_ticks;
+
+	std::thread worker;
+	bool running;
+
+	// The ring buffer of the waiting frames
+	std::mutex frames_mutex;
+	std::condition_variable frames_ready;
+	vector<Slot> slots;
+	int head;
+	int count;
+	bool stopping;
+	int frames_dropped;
+
+	// The newest result
+	std::mutex result_mutex;
+	Result latest_result;
+	Tag latest_tag;
+	int64 latest_push_ticks;
+	bool has_result;
+
+	void Run()
+	{
+		// The frame being fitted, its buffer is swapped with the one of the slot it came from
+		cv::Mat frame;
+		Tag tag;
+		int64 push_ticks;
+
+		while(true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(frames_mutex);
+				while(!stopping && count == 0)
+				{
+					frames_ready.wait(lock);
+				}
+
+				if(stopping)
+				{
+					return;
+				}
+
+				// Skip the frames that are already too late if a newer one is waiting
+				int64 now = cv::getTickCount();
+				while(drop_policy == KEEP_WITHIN_BUDGET && count > 1 && now - slots[head].push_ticks > budget_ticks)
+				{
+					head = (head + 1) % slots.size();
+					count--;
+					frames_dropped++;
+				}
+
+				Slot& slot = slots[head];
+				cv::swap(frame, slot.frame);
+				tag = slot.tag;
+				push_ticks = slot.push_ticks;
+
+				head = (head + 1) % slots.size();
+				count--;
+			}
+
+			// A failed fit (e.g. an OpenCV exception) drops its frame, an exception must not leave the worker thread
+			Result result;
+			try
+			{
+				fit(frame, tag, result);
+			}
+			catch(...)
+			{
+				std::lock_guard<std::mutex> lock(frames_mutex);
+				frames_dropped++;
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(result_mutex);
+				latest_result = result;
+				latest_tag = tag;
+				latest_push_ticks = push_ticks;
+				has_result = true;
+			}
+		}
+	}
+
+	FramePipeline(const FramePipeline&);
+	FramePipeline& operator= (const FramePipeline&);
+};
+
+}
+#endif
@@ -66,6 +66,34 @@ namespace FaceAnalysis
 {
 
 	void EstimateGaze(const LandmarkDetector::CLNF& clnf_model, cv::Point3f& gaze_absolute, float fx, float fy, float cx, float cy, bool left_eye);
+
+	// The hierarchical parts of a model the gaze is estimated from, found once when the model is loaded (-1 if missing)
+	struct GazeParts
+	{
+		int left_eye;
+		int right_eye;
+
+		bool Valid() const { return left_eye >= 0 && right_eye >= 0; }
+	};
+
+	GazeParts FindGazeParts(const LandmarkDetector::CLNF& clnf_model);
+
+	// The gaze of both eyes, the pupils (in camera space) and their projection on the image with the end points of 50mm long gaze
+	// lines. Fixed size so that it can be filled in every frame without allocating
+	struct BinocularGaze
+	{
+		cv::Point3f gaze_left, gaze_right;
+		cv::Point3f pupil_left, pupil_right;
+
+		cv::Point2d pupil_left_image, pupil_right_image;
+		cv::Point2d gaze_left_end_image, gaze_right_end_image;
+	};
+
+	// Computes the head rotation, the face 3D points and both eye shapes once for the two eyes (EstimateGaze computes them per
+	// eye). Only the landmarks the gaze needs are lifted to 3D, without allocating. If estimate_direction is false (e.g. the
+	// detection failed) the gaze vectors are set to (0, 0, -1) and only the pupils are computed.
+	void EstimateBinocularGaze(const LandmarkDetector::CLNF& clnf_model, const GazeParts& parts, float fx, float fy, float cx, float cy,
+		bool estimate_direction, BinocularGaze& o_gaze);
 	void DrawGaze(cv::Mat img, const LandmarkDetector::CLNF& clnf_model, cv::Point3f gazeVecAxisLeft, cv::Point3f gazeVecAxisRight, float fx, float fy, float cx, float cy);
 
 }
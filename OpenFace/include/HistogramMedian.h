@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __HISTOGRAMMEDIAN_h_
+#define __HISTOGRAMMEDIAN_h_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace FaceAnalysis
+{
+
+// A running median of every dimension of a descriptor, approximated by a histogram per dimension (evenly spaced bins from min_val
+// to max_val). Instead of rescanning the cumulative sums for every median, the median bin of each dimension and the number of
+// samples below it are kept and moved after every sample, which takes a step or two as the median of a descriptor changes slowly.
+// The median bin is the one the rescanning would find, the first bin at which the cumulative sum reaches (count + 1) / 2.
+class HistogramMedian{
+
+public:
+
+	HistogramMedian() : count(0)
+	{}
+
+	// Clears the samples, with no dimensions the histogram is empty
+	void Reset(int dimensions, int num_bins);
+
+	bool Empty() const
+	{
+		return histogram.empty();
+	}
+
+	int Dimensions() const
+	{
+		return histogram.rows;
+	}
+
+	int Count() const
+	{
+		return count;
+	}
+
+	// Add a sample, the descriptor has to be a row vector with a value per dimension (values outside of min_val to max_val are
+	// counted in the first or the last bin)
+	void Add(const cv::Mat_<double>& descriptor, double min_val, double max_val);
+
+	// The bin in which the median of a dimension falls (the first bin if there are no samples)
+	int MedianBin(int dimension) const
+	{
+		return median_bins[dimension];
+	}
+
+	// The sample counts, a row of bins per dimension
+	const cv::Mat_<unsigned int>& Histogram() const
+	{
+		return histogram;
+	}
+
+private:
+
+	// Sample counts, a row of bins per dimension
+	cv::Mat_<unsigned int> histogram;
+	int count;
+
+	// Per dimension, the median bin and the number of samples in the bins before it
+	std::vector<unsigned short> median_bins;
+	std::vector<unsigned int> below_median;
+
+	// The bin of each dimension of the sample being added
+	cv::Mat_<double> converted_descriptor;
+	std::vector<int> sample_bins;
+
+};
+  //===========================================================================
+}
+#endif
@@ -84,6 +84,15 @@ namespace LandmarkDetector
 	bool DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params);
 	bool DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> &depth_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params);
 
+	//================================================================================================================
+	// Refitting only the eye models (left_eye_28 and right_eye_28) of a tracked face, for tracking the gaze at a high rate in
+	// between the full fits of DetectLandmarksInVideo. The eye models start from where they were fit in the previous frame and the
+	// eye landmarks of the face are updated from them (its shape parameters are not refit until the next full fit).
+	// The eye models are the hierarchical models left_eye_part and right_eye_part (found once, e.g. with FaceAnalysis::FindGazeParts).
+	// Returns false, without fitting, if the face is not being tracked, either part is missing (-1) or the face is too small for them
+	//================================================================================================================
+	bool DetectEyesInVideo(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model, FaceModelParameters& params, int left_eye_part, int right_eye_part);
+
 	//================================================================================================================
 	// Landmark detection in image, need to provide an image and optionally CLNF model together with parameters (default values work well)
 	// Optionally can provide a bounding box in which detection is performed (this is useful if multiple faces are to be detected in images)
@@ -71,12 +71,54 @@
 #include "Patch_experts.h"
 #include "LandmarkDetectionValidator.h"
 #include "LandmarkDetectorParameters.h"
+#include "FaceTemplateTracker.h"
+#include "TrackerArena.h"
+#include "MotionPredictor.h"
 
 using namespace std;
 
 namespace LandmarkDetector
 {
 
+// Bookkeeping of the staged face re-detection, the first stage searches a window around the last tracked face
+// and the second stage the full frame (times are in seconds)
+struct RedetectionStats
+{
+	int roi_attempts = 0;
+	int roi_hits = 0;
+	double roi_time = 0;
+
+	int full_attempts = 0;
+	int full_hits = 0;
+	double full_time = 0;
+
+	double RoiHitRate() const { return roi_attempts > 0 ? (double)roi_hits / roi_attempts : 0; }
+	double FullHitRate() const { return full_attempts > 0 ? (double)full_hits / full_attempts : 0; }
+
+	void Reset() { *this = RedetectionStats(); }
+};
+
+// Wall clock times (in seconds) of the stages of the last CLNF::DetectLandmarks call, the hierarchical parts and the validation
+// run concurrently after the main fit so the critical path is fit + max(parts, validation)
+struct LandmarkDetectionTimes
+{
+	double fit = 0;
+	double parts = 0;
+	double validation = 0;
+	double total = 0;
+
+	double CriticalPath() const { return fit + max(parts, validation); }
+};
+
+// The search windows and the NU-RLMS iterations (rigid and non-rigid) of every scale in the last fit (0 for the scales that were
+// skipped), and how far the landmarks moved from where the fit started when tracking with motion prediction
+struct LandmarkFitStats
+{
+	vector<int> window_sizes;
+	vector<int> iterations;
+	double prediction_residual = 0;
+};
+
 // A main class containing all the modules required for landmark detection
 // Face shape model
 // Patch experts
@@ -150,11 +192,26 @@ public:
 	int failures_in_a_row;
 
 	// A template of a face that last succeeded with tracking (useful for large motions in video)
-	cv::Mat_<uchar> face_template;
+	FaceTemplateTracker face_template_tracker;
 
 	// Useful when resetting or initialising the model closer to a specific location (when multiple faces are present)
 	cv::Point_<double> preference_det;
 
+	// Hit rates and timings of the face re-detection stages (not cleared by Reset)
+	RedetectionStats redetection_stats;
+
+	// Timings of the last landmark detection
+	LandmarkDetectionTimes detection_times;
+
+	// Search windows and iterations of the last fit
+	LandmarkFitStats fit_stats;
+
+	// Predicts where the face is in the next frame of a video (used if FaceModelParameters::use_motion_prediction)
+	MotionPredictor motion_predictor;
+
+	// The TBB arena the detection and tracking of this model is run in (configured from the parameters, not copied with the model)
+	TrackerArena arena;
+
 	// A default constructor
 	CLNF();
 
@@ -192,6 +249,13 @@ public:
 	// Reset the model, choosing the face nearest (x,y) where x and y are between 0 and 1.
 	void Reset(double x, double y);
 
+	// Move the tracked face by (dx, dy) pixels, when the origin of the images it is tracked in moves (e.g. a region of interest
+	// that is moved around), so that the tracking carries on from the same place in the scene
+	void Translate(double dx, double dy);
+
+	// Drop the precalculated KDE responses, they depend on parameters.sigma and are recomputed on the next fit
+	void InvalidateResponseCaches() { kde_resp_precalc.clear(); }
+
 	// Reading the model in
 	void Read(string name);
 
@@ -203,6 +267,9 @@ private:
 	// the speedup of RLMS using precalculated KDE responses (described in Saragih 2011 RLMS paper)
 	map<int, cv::Mat_<float> >		kde_resp_precalc;
 
+	// The buffers of fitting the PDM parameters to the landmarks (not copied with the model)
+	PDM::CalcParamsWorkspace		calc_params_workspace;
+
 	// The model fitting: patch response computation and optimisation steps
 	bool Fit(const cv::Mat_<uchar>& intensity_image, const cv::Mat_<float>& depth_image, const std::vector<int>& window_sizes, const FaceModelParameters& parameters);
 
@@ -211,7 +278,8 @@ private:
 
 	// The actual model optimisation (update step), returns the model likelihood
 	double NU_RLMS(cv::Vec6d& final_global, cv::Mat_<double>& final_local, const vector<cv::Mat_<float> >& patch_expert_responses, const cv::Vec6d& initial_global, const cv::Mat_<double>& initial_local,
-				  const cv::Mat_<double>& base_shape, const cv::Matx22d& sim_img_to_ref, const cv::Matx22f& sim_ref_to_img, int resp_size, int view_idx, bool rigid, int scale, cv::Mat_<double>& landmark_lhoods, const FaceModelParameters& parameters);
+				  const cv::Mat_<double>& base_shape, const cv::Matx22d& sim_img_to_ref, const cv::Matx22f& sim_ref_to_img, int resp_size, int view_idx, bool rigid, int scale, cv::Mat_<double>& landmark_lhoods, const FaceModelParameters& parameters,
+				  int& o_iterations);
 
 	// Removing background image from the depth
 	bool RemoveBackground(cv::Mat_<float>& out_depth_image, const cv::Mat_<float>& depth_image);
@@ -90,11 +90,21 @@ struct FaceModelParameters
 	
 	// Used for the current frame
 	vector<int> window_sizes_current;
+
+	// When tracking, start the fit from the parameters a constant velocity model predicts for the frame rather than from the previous
+	// ones, and widen the small windows only when the previous fit landed further from its prediction than they reach (see MotionPredictor)
+	bool use_motion_prediction;
+
+	// Also predict the shape (local) parameters, not only the pose
+	bool predict_shape;
 	
 	// How big is the tracking template that helps with large motions
 	double face_template_scale;	
 	bool use_face_template;
 
+	// The tracking template is only replaced when the face appearance drifts from it by more than this (1 - normalised cross-correlation)
+	double face_template_drift;
+
 	// Where to load the model from
 	string model_location;
 	
@@ -110,6 +120,16 @@ struct FaceModelParameters
 	// How often should face detection be used to attempt reinitialisation, every n frames (set to negative not to reinit)
 	int reinit_video_every;
 
+	// Staged reinitialisation, first look for the face in a window around the last tracked location on a downsampled image
+	// and only search the full frame if that fails
+	bool use_staged_redetection;
+
+	// Size of the re-detection window relative to the last face bounding box
+	double redetection_roi_scale;
+
+	// The re-detection window is downsampled so that the last face is roughly this many pixels across (never upsampled)
+	double redetection_face_width;
+
 	// Determining which face detector to use for (re)initialisation, HAAR is quicker but provides more false positives and is not goot for in-the-wild conditions
 	// Also HAAR detector can detect smaller faces while HOG SVM is only capable of detecting faces at least 70px across
 	enum FaceDetector{HAAR_DETECTOR, HOG_SVM_DETECTOR};
@@ -129,6 +149,16 @@ struct FaceModelParameters
 	// Using the brand new and experimental gaze tracker
 	bool track_gaze;
 
+	// The facial features the caller needs in this call, hierarchical part models that only refine features outside of the mask are skipped
+	// (the main model is always fit as it drives the tracking)
+	enum FaceFeature{FEATURE_CONTOUR = 1, FEATURE_MOUTH = 2, FEATURE_BROWS = 4, FEATURE_EYES = 8, FEATURE_GAZE = 16, FEATURE_ALL = 31};
+	int feature_mask;
+
+	// The number of TBB threads a single tracker may use (0 or less shares the global pool), and the first core to pin them to
+	// (negative not to pin), see TrackerArena
+	int max_concurrency;
+	int pin_first_core;
+
 	FaceModelParameters();
 
 	FaceModelParameters(vector<string> &arguments);
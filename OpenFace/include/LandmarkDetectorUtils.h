@@ -142,18 +142,30 @@ namespace LandmarkDetector
 	// Face detection helpers
 	//============================================================================
 
-	// Face detection using Haar cascade classifier
+	// Face detection using Haar cascade classifier (the overloads without a classifier use the process wide detector cache)
 	bool DetectFaces(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity);
-	bool DetectFaces(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity, cv::CascadeClassifier& classifier);
+	bool DetectFaces(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity, cv::CascadeClassifier& classifier, const cv::Size& min_size = cv::Size(50, 50), const cv::Size& max_size = cv::Size());
 	// The preference point allows for disambiguation if multiple faces are present (pick the closest one), if it is not set the biggest face is chosen
 	bool DetectSingleFace(cv::Rect_<double>& o_region, const cv::Mat_<uchar>& intensity, cv::CascadeClassifier& classifier, const cv::Point preference = cv::Point(-1,-1));
 
+	// Runs the HOG-SVM detector with the pyramid levels scanned in parallel, the output is identical to detector(image, detections, adjust_threshold)
+	void DetectHOGParallel(const dlib::frontal_face_detector& detector, const cv::Mat_<uchar>& intensity, std::vector<dlib::full_detection>& o_detections, double adjust_threshold);
+
 	// Face detection using HOG-SVM classifier
 	bool DetectFacesHOG(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity, std::vector<double>& confidences);
 	bool DetectFacesHOG(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity, dlib::frontal_face_detector& classifier, std::vector<double>& confidences);
 	// The preference point allows for disambiguation if multiple faces are present (pick the closest one), if it is not set the biggest face is chosen
 	bool DetectSingleFaceHOG(cv::Rect_<double>& o_region, const cv::Mat_<uchar>& intensity, dlib::frontal_face_detector& classifier, double& confidence, const cv::Point preference = cv::Point(-1,-1));
 
+	// Batch face detection over a list of images using the TBB thread pool and the detector cache
+	void DetectFacesBatch(vector<vector<cv::Rect_<double> > >& o_regions, const vector<cv::Mat_<uchar> >& intensities);
+	void DetectFacesHOGBatch(vector<vector<cv::Rect_<double> > >& o_regions, const vector<cv::Mat_<uchar> >& intensities, vector<vector<double> >& o_confidences);
+
+	// Staged re-detection helpers, only search a window around a previously tracked face (prev_box scaled by roi_scale)
+	// after downsampling it so that the previous face is roughly face_width pixels across, the output region is in full image coordinates
+	bool DetectSingleFaceROI(cv::Rect_<double>& o_region, const cv::Mat_<uchar>& intensity, cv::CascadeClassifier& classifier, const cv::Rect_<double>& prev_box, double roi_scale, double face_width);
+	bool DetectSingleFaceHOGROI(cv::Rect_<double>& o_region, const cv::Mat_<uchar>& intensity, dlib::frontal_face_detector& classifier, double& confidence, const cv::Rect_<double>& prev_box, double roi_scale, double face_width);
+
 	//============================================================================
 	// Matrix reading functionality
 	//============================================================================
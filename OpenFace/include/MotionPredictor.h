@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Predicting the model parameters of the next video frame to start the tracking fit from
+#ifndef __MOTION_PREDICTOR_h_
+#define __MOTION_PREDICTOR_h_
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// Local includes
+#include "LandmarkDetectorParameters.h"
+
+// System includes
+#include <vector>
+
+using namespace std;
+
+namespace LandmarkDetector
+{
+
+// A constant velocity model of the global (and optionally the local) parameters, filtered as an alpha-beta filter (the steady state
+// of a Kalman filter of the position and velocity of every parameter, with one frame as the time step). The tracking fit starts from
+// the predicted parameters instead of the previous ones, so that a face moving steadily lands close to where the fit starts.
+// How far the fits land from the predictions (the residual) decides how large the search windows of the next frame need to be
+class MotionPredictor
+{
+
+public:
+
+	// How much of the difference between the fit and the prediction goes into the position and into the velocity (alpha of 1 starts
+	// every prediction from the last fit, lower beta smooths the velocity more)
+	double alpha;
+	double beta;
+
+	// The search window must reach this many times the residual of the last fit
+	double window_margin;
+
+	MotionPredictor();
+
+	// Forget the motion (when the tracking fails or is reinitialised)
+	void Reset();
+
+	// Move the predicted position (the velocity stays), when the origin of the images moves
+	void Translate(double dx, double dy);
+
+	// Has there been a fit to predict from
+	bool Initialised() const { return updates > 0; }
+
+	// Move the parameters to where they are expected in the next frame, the local ones only if predict_local
+	void Predict(cv::Vec6d& io_global, cv::Mat_<double>& io_local, bool predict_local) const;
+
+	// Correct the motion with the parameters fit in the frame, residual is the RMS distance (in pixels) between the landmarks the fit
+	// started from and the fitted ones
+	void Update(const cv::Vec6d& global, const cv::Mat_<double>& local, double residual);
+
+	// The RMS distance between the landmarks the last fit started from and the fitted ones
+	double Residual() const { return residual; }
+
+	// The search window of every scale: the small windows while the coarsest of them reaches far enough to cover the residual (at the
+	// current face scale), otherwise the initialisation window for every scale whose small one falls short (bringing back the scales
+	// the small windows skip)
+	void ChooseWindows(const FaceModelParameters& params, const vector<double>& patch_scaling, double face_scale, vector<int>& o_window_sizes) const;
+
+private:
+
+	int updates;
+
+	cv::Vec6d global;
+	cv::Vec6d global_velocity;
+
+	cv::Mat_<double> local;
+	cv::Mat_<double> local_velocity;
+
+	double residual;
+};
+
+}
+#endif
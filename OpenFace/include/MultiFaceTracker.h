@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Tracking several faces in video with a pool of per-face landmark detectors
+#ifndef __MULTI_FACE_TRACKER_h_
+#define __MULTI_FACE_TRACKER_h_
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// Local includes
+#include "LandmarkDetectorModel.h"
+#include "LandmarkDetectorParameters.h"
+
+// System includes
+#include <vector>
+
+using namespace std;
+
+namespace LandmarkDetector
+{
+
+// Face detection is run periodically on the whole frame, the detections are associated with the tracked faces by their
+// bounding box overlap and by how many of the tracked landmarks fall inside of them, unmatched detections spawn new trackers
+// (or, when max_faces are tracked, replace the failing faces that no detection matched) and trackers that keep failing are retired. All of the tracked faces are fitted in parallel.
+// The trackers are copies of a single template model, retired ones are kept in an idle pool and reused when a new face
+// appears (the patch experts fill in their DFT caches lazily while fitting, so the trackers can not share one instance)
+class MultiFaceTracker
+{
+
+public:
+
+	// The maximum number of faces tracked at once
+	int max_faces;
+
+	// Run the face detector every n frames (always when no face is tracked), as long as fewer than max_faces are tracked or one of
+	// them failed in the last frame
+	int detection_interval;
+
+	// A detection belongs to a tracked face if their boxes overlap (intersection over union) by at least association_iou,
+	// or if at least association_landmark_overlap of the tracked landmarks are inside of the detection
+	double association_iou;
+	double association_landmark_overlap;
+
+	// A face is dropped after failing the landmark detection in this many frames in a row
+	int max_track_failures;
+
+	// Time taken (in seconds) by the face detection (0 if not run) and by the landmark fitting in the last frame
+	double last_detection_time;
+	double last_fit_time;
+
+	MultiFaceTracker();
+	~MultiFaceTracker();
+
+	// The model all of the face trackers are copied from (drops all of the tracked faces)
+	void SetModel(const CLNF& model);
+
+	// Is there a model to track with
+	bool Empty() const { return face_model.pdm.NumberOfPoints() == 0; }
+
+	// Forget all of the tracked faces
+	void Reset();
+
+	// Move all of the tracked faces (see CLNF::Translate)
+	void Translate(double dx, double dy);
+
+	// Drop the sigma dependent caches of the template and of every tracker (see CLNF::InvalidateResponseCaches)
+	void InvalidateResponseCaches();
+
+	// Detect and track the faces in the next frame, returns true if at least one face is tracked
+	bool Track(const cv::Mat_<uchar>& grayscale_image, const cv::Mat_<float>& depth_image, FaceModelParameters& params);
+	bool Track(const cv::Mat_<uchar>& grayscale_image, FaceModelParameters& params);
+
+	// The currently tracked faces, the ids are unique for the life of the tracker
+	size_t NumFaces() const { return faces.size(); }
+	int FaceID(size_t face) const { return faces[face].id; }
+	const CLNF& Face(size_t face) const { return *faces[face].model; }
+
+private:
+
+	struct FaceTrack
+	{
+		int id;
+		CLNF* model;
+
+		// Set for newly spawned (or re-associated) faces, the model is initialised from it on the next fit
+		cv::Rect_<double> init_box;
+	};
+
+	CLNF face_model;
+
+	vector<FaceTrack> faces;
+	vector<CLNF*> idle_models;
+
+	int next_id;
+	int frame_count;
+
+	void DetectAndAssociate(const cv::Mat_<uchar>& grayscale_image, const FaceModelParameters& params);
+	void Spawn(const cv::Rect_<double>& bounding_box);
+	void Retire(size_t face);
+
+	// The trackers own their models
+	MultiFaceTracker(const MultiFaceTracker&);
+	MultiFaceTracker& operator= (const MultiFaceTracker&);
+};
+
+}
+#endif
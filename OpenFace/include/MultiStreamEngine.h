@@ -0,0 +1,232 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//  Tracking the faces in several camera streams within one process
+#ifndef __MULTI_STREAM_ENGINE_h_
+#define __MULTI_STREAM_ENGINE_h_
+
+// OpenCV includes
+#include <opencv2/core/core.hpp>
+
+// TBB includes
+#include <tbb/concurrent_queue.h>
+#include <tbb/task_arena.h>
+#include <tbb/spin_mutex.h>
+
+// Local includes
+#include "LandmarkDetectorModel.h"
+#include "LandmarkDetectorParameters.h"
+#include "MultiFaceTracker.h"
+
+// System includes
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace LandmarkDetector
+{
+
+// The result of tracking one frame of a stream
+struct StreamResult
+{
+	int stream_id;
+
+	// The number of the frame within the stream (counting the dropped ones) and the time it was pushed with (in seconds)
+	int frame_number;
+	double capture_time;
+
+	// Time (in seconds) from the capture time to the end of the fitting
+	double latency;
+
+	// The ids (unique within the stream), the landmarks (as in CLNF::detected_landmarks) and the detection certainties of the tracked faces
+	vector<int> face_ids;
+	vector<cv::Mat_<double> > landmarks;
+	vector<double> certainties;
+};
+
+// Throughput and latency (in seconds) of a stream over the last latency_history frames
+struct StreamStats
+{
+	int frames_pushed;
+	int frames_processed;
+	int frames_dropped; // Including the frames of which the fit failed with an exception
+
+	double throughput;
+	double mean_latency;
+	double p99_latency;
+};
+
+// Frames are pushed into per-stream queues and fitted on a single TBB arena shared by all of the streams. Whenever
+// a frame arrives a task is enqueued on the arena, the task picks the idle stream with the earliest deadline (the time its
+// oldest frame has been waiting plus the latency target of the stream) and fits one frame of it, so that a busy stream can
+// not starve the others. The faces within a frame are fitted in parallel on the same arena, idle workers steal them.
+// Only one frame of a stream is fitted at a time (the face tracking depends on the previous frame), if a stream falls
+// behind its latency target the late frames are dropped in favour of the newest one.
+// The model is loaded once and the per-face trackers of every stream are copied from it (see MultiFaceTracker)
+class MultiStreamEngine
+{
+
+public:
+
+	// How many latencies per stream are kept for the statistics
+	static const int latency_history = 1024;
+
+	MultiStreamEngine();
+
+	// Waits for the frames that are being fitted
+	~MultiStreamEngine();
+
+	// Load the shared model from params.model_location, the parameters are used by all of the streams
+	// params.max_concurrency limits the number of threads of the whole engine
+	bool LoadModel(const FaceModelParameters& params);
+
+	// Add a stream, returns its id (or -1 if no model is loaded)
+	// latency_target is in seconds, at most queue_capacity frames wait in the queue of the stream (older ones are dropped)
+	int RegisterStream(double latency_target, int max_faces = 1, int queue_capacity = 4);
+
+	// Remove a stream, waiting for its frame to be fitted if one is
+	void UnregisterStream(int stream_id);
+
+	// Queue a frame of a stream (the image is copied), capture_time in seconds as cv::getTickCount() / cv::getTickFrequency()
+	bool PushFrame(int stream_id, const cv::Mat_<uchar>& grayscale_image, double capture_time);
+
+	// Take the oldest result of a stream that has not been taken yet
+	bool PopResult(int stream_id, StreamResult& o_result);
+
+	bool GetStats(int stream_id, StreamStats& o_stats);
+
+	// Block until all of the queued frames are fitted
+	void WaitForIdle();
+
+private:
+
+	struct Frame
+	{
+		cv::Mat_<uchar> image;
+		double capture_time;
+		int number;
+	};
+
+	struct Stream
+	{
+		int id;
+		double latency_target;
+		int queue_capacity;
+
+		// The waiting frames, oldest first
+		tbb::spin_mutex frames_mutex;
+		deque<Frame> frames;
+
+		// The size of the queue, so that the scheduler does not need to take the lock
+		std::atomic<int> queued;
+		std::atomic<int> pushed;
+		std::atomic<int> dropped;
+
+		// The capture time of the frame at the front of the queue
+		std::atomic<double> waiting_since;
+
+		// Set while a task is fitting a frame of the stream, or when the stream is being removed
+		bool busy;
+		bool closed;
+
+		FaceModelParameters params;
+		MultiFaceTracker tracker;
+
+		tbb::concurrent_queue<StreamResult> results;
+
+		// Statistics
+		tbb::spin_mutex stats_mutex;
+		vector<double> latencies;
+		int processed;
+		double first_capture_time;
+		double last_done_time;
+	};
+
+	CLNF face_model;
+	FaceModelParameters model_params;
+
+	unique_ptr<tbb::task_arena> arena;
+
+	// Guards the stream registry, the busy flags and the number of tasks in flight, state_changed is notified whenever a stream
+	// stops being busy or the last task finishes
+	std::mutex streams_mutex;
+	std::condition_variable state_changed;
+	map<int, shared_ptr<Stream> > streams;
+	int next_stream_id;
+
+	int tasks_in_flight;
+
+	shared_ptr<Stream> FindStream(int stream_id);
+
+	void Schedule();
+	void RunNext();
+	void Process(Stream& stream);
+
+	// The engine owns the trackers of its streams
+	MultiStreamEngine(const MultiStreamEngine&);
+	MultiStreamEngine& operator= (const MultiStreamEngine&);
+};
+
+}
+#endif
@@ -62,6 +62,8 @@
 // OpenCV includes
 #include <opencv2/core/core.hpp>
 
+#include <vector>
+
 #include "LandmarkDetectorParameters.h"
 
 namespace LandmarkDetector
@@ -107,8 +109,35 @@ class PDM{
 		// provided the bounding box of a face and the local parameters (with optional rotation), generates the global parameters that can generate the face with the provided bounding box
 		void CalcParams(cv::Vec6d& out_params_global, const cv::Rect_<double>& bounding_box, const cv::Mat_<double>& params_local, const cv::Vec3d rotation = cv::Vec3d(0.0));
 
+		// The buffers of fitting the parameters to landmarks, kept between the calls so that fitting does not allocate once their
+		// sizes settle (a workspace should only be used by one fit at a time)
+		struct CalcParamsWorkspace
+		{
+			// The original indices of the visible points
+			std::vector<int> visible;
+
+			// The mean shape, principal components and landmark locations of the visible points
+			cv::Mat_<double> mean_shape;
+			cv::Mat_<double> princ_comp;
+			cv::Mat_<double> landmark_locations;
+
+			// The current 3D shape and the parameters being fitted
+			cv::Mat_<double> shape_3D;
+			cv::Mat_<float> params_local;
+
+			// The Gauss-Newton system, accumulated from the Jacobian rows of a point at a time, and its regularisation
+			cv::Mat_<float> Hessian;
+			cv::Mat_<float> J_w_t_m;
+			cv::Mat_<float> regularisation;
+			cv::Mat_<float> J_x;
+			cv::Mat_<float> J_y;
+		};
+
 		// Provided the landmark location compute global and local parameters best fitting it (can provide optional rotation for potentially better results)
-		void CalcParams(cv::Vec6d& out_params_global, const cv::Mat_<double>& out_params_local, const cv::Mat_<double>& landmark_locations, const cv::Vec3d rotation = cv::Vec3d(0.0));
+		// This does not modify the PDM so can be called concurrently on a shared model, each fit with its own workspace (the first
+		// version allocates a new one on every call)
+		void CalcParams(cv::Vec6d& out_params_global, const cv::Mat_<double>& out_params_local, const cv::Mat_<double>& landmark_locations, const cv::Vec3d rotation = cv::Vec3d(0.0)) const;
+		void CalcParams(cv::Vec6d& out_params_global, const cv::Mat_<double>& out_params_local, const cv::Mat_<double>& landmark_locations, const cv::Vec3d rotation, CalcParamsWorkspace& workspace) const;
 
 		// provided the model parameters, compute the bounding box of a face
 		void CalcBoundingBox(cv::Rect& out_bounding_box, const cv::Vec6d& params_global, const cv::Mat_<double>& params_local);
@@ -118,7 +147,7 @@ class PDM{
 		void ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6d& params_global, cv::Mat_<float> &Jacobian, const cv::Mat_<float> W, cv::Mat_<float> &Jacob_t_w);
 
 		// Given the current parameters, and the computed delta_p compute the updated parameters
-		void UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>& params_local, cv::Vec6d& params_global);
+		void UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>& params_local, cv::Vec6d& params_global) const;
 
   };
   //===========================================================================
@@ -89,6 +89,33 @@ public:
 		return AU_names;
 	}
 
+	// The model, a column of support vectors (and a bias) per AU, applied to the descriptor minus the means
+	const cv::Mat_<double>& GetMeans() const
+	{
+		return means;
+	}
+
+	const cv::Mat_<double>& GetSupportVectors() const
+	{
+		return support_vectors;
+	}
+
+	const cv::Mat_<double>& GetBiases() const
+	{
+		return biases;
+	}
+
+	// The predictions for a positive and a negative decision value
+	const std::vector<double>& GetPosClasses() const
+	{
+		return pos_classes;
+	}
+
+	const std::vector<double>& GetNegClasses() const
+	{
+		return neg_classes;
+	}
+
 private:
 
 	// The names of Action Units this model is responsible for
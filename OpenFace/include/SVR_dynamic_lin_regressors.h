@@ -89,6 +89,22 @@ public:
 		return AU_names;
 	}
 
+	// The model, a column of support vectors (and a bias) per AU, applied to the descriptor minus the means
+	const cv::Mat_<double>& GetMeans() const
+	{
+		return means;
+	}
+
+	const cv::Mat_<double>& GetSupportVectors() const
+	{
+		return support_vectors;
+	}
+
+	const cv::Mat_<double>& GetBiases() const
+	{
+		return biases;
+	}
+
 	std::vector<double> GetCutoffs() const
 	{
 		return cutoffs;		
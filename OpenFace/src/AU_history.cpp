@@ -0,0 +1,333 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "AU_history.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace FaceAnalysis;
+
+using namespace std;
+
+void AUHistory::Initialise(int columns)
+{
+	num_columns = columns;
+	Clear();
+}
+
+void AUHistory::SetLimits(int capacity_frames, const string& location)
+{
+	requested_capacity = max(capacity_frames, 0);
+	spill_location = location;
+	Clear();
+}
+
+void AUHistory::Clear()
+{
+	num_frames = 0;
+
+	pending_frames = 0;
+	pending.first_frame = 0;
+	pending.num_frames = 0;
+	spilled_overwrites.clear();
+
+	if(spill_stream.is_open())
+	{
+		spill_stream.close();
+	}
+	if(!spill_location.empty())
+	{
+		spill_stream.open(spill_location.c_str(), ios::out | ios::binary | ios::trunc);
+		if(!spill_stream.is_open())
+		{
+			cout << "Could not open the AU history file " << spill_location << ", only the frames in memory are kept" << endl;
+		}
+	}
+
+	// The complete history is in the file, so the memory is bounded even if no capacity was asked for
+	capacity = requested_capacity;
+	if(capacity == 0 && spill_stream.is_open())
+	{
+		capacity = chunk_frames;
+	}
+
+	timestamps.clear();
+	confidences.clear();
+	successes.clear();
+	value_columns.assign(num_columns, vector<double>());
+
+	if(capacity > 0)
+	{
+		timestamps.resize(capacity);
+		confidences.resize(capacity);
+		successes.resize(capacity);
+		for(int c = 0; c < num_columns; ++c)
+		{
+			value_columns[c].resize(capacity);
+		}
+	}
+}
+
+size_t AUHistory::FirstFrameInMemory() const
+{
+	if(capacity > 0 && num_frames > (size_t)capacity)
+	{
+		return num_frames - capacity;
+	}
+	return 0;
+}
+
+void AUHistory::Append(double timestamp, double confidence, bool success, const vector<double>& values)
+{
+	if(capacity > 0)
+	{
+		size_t slot = num_frames % capacity;
+		timestamps[slot] = timestamp;
+		confidences[slot] = confidence;
+		successes[slot] = success;
+		for(int c = 0; c < num_columns; ++c)
+		{
+			value_columns[c][slot] = values[c];
+		}
+	}
+	else
+	{
+		timestamps.push_back(timestamp);
+		confidences.push_back(confidence);
+		successes.push_back(success);
+		for(int c = 0; c < num_columns; ++c)
+		{
+			value_columns[c].push_back(values[c]);
+		}
+	}
+
+	if(spill_stream.is_open())
+	{
+		// Collect a chunk of frames before writing it, the columns are only contiguous in the file within a chunk
+		if(pending_frames == 0)
+		{
+			pending.first_frame = num_frames;
+			pending.timestamps.resize(chunk_frames);
+			pending.confidences.resize(chunk_frames);
+			pending.successes.resize(chunk_frames);
+			pending.values.resize((size_t)num_columns * chunk_frames);
+		}
+
+		pending.timestamps[pending_frames] = timestamp;
+		pending.confidences[pending_frames] = confidence;
+		pending.successes[pending_frames] = success;
+		for(int c = 0; c < num_columns; ++c)
+		{
+			pending.values[(size_t)c * chunk_frames + pending_frames] = values[c];
+		}
+		pending_frames++;
+
+		if(pending_frames == chunk_frames)
+		{
+			FlushPending();
+		}
+	}
+
+	num_frames++;
+}
+
+void AUHistory::Overwrite(size_t frame, const vector<double>& values)
+{
+	if(frame >= num_frames)
+	{
+		return;
+	}
+
+	if(frame >= FirstFrameInMemory())
+	{
+		size_t slot = capacity > 0 ? frame % capacity : frame;
+		for(int c = 0; c < num_columns; ++c)
+		{
+			value_columns[c][slot] = values[c];
+		}
+	}
+
+	if(spill_stream.is_open())
+	{
+		if(pending_frames > 0 && frame >= pending.first_frame)
+		{
+			for(int c = 0; c < num_columns; ++c)
+			{
+				pending.values[(size_t)c * chunk_frames + (frame - pending.first_frame)] = values[c];
+			}
+		}
+		else
+		{
+			// The file is append only, the overwrite is applied when streaming it back
+			spilled_overwrites[frame] = values;
+		}
+	}
+}
+
+void AUHistory::FlushPending()
+{
+	if(pending_frames == 0)
+	{
+		return;
+	}
+
+	int frames = pending_frames;
+	spill_stream.write((const char*)&frames, 4);
+	spill_stream.write((const char*)&num_columns, 4);
+	spill_stream.write((const char*)pending.timestamps.data(), frames * sizeof(double));
+	spill_stream.write((const char*)pending.confidences.data(), frames * sizeof(double));
+	spill_stream.write((const char*)pending.successes.data(), frames);
+	for(int c = 0; c < num_columns; ++c)
+	{
+		spill_stream.write((const char*)(pending.values.data() + (size_t)c * chunk_frames), frames * sizeof(double));
+	}
+	spill_stream.flush();
+
+	pending_frames = 0;
+}
+
+void AUHistory::Stream(const function<void(const AUHistoryChunk&)>& consumer)
+{
+	if(spill_stream.is_open())
+	{
+		StreamFile(consumer);
+	}
+	else
+	{
+		StreamMemory(consumer);
+	}
+}
+
+void AUHistory::StreamMemory(const function<void(const AUHistoryChunk&)>& consumer)
+{
+	AUHistoryChunk chunk;
+
+	for(size_t first = FirstFrameInMemory(); first < num_frames; first += chunk_frames)
+	{
+		chunk.first_frame = first;
+		chunk.num_frames = (int)min((size_t)chunk_frames, num_frames - first);
+		chunk.timestamps.resize(chunk.num_frames);
+		chunk.confidences.resize(chunk.num_frames);
+		chunk.successes.resize(chunk.num_frames);
+		chunk.values.resize((size_t)num_columns * chunk.num_frames);
+
+		for(int f = 0; f < chunk.num_frames; ++f)
+		{
+			size_t slot = capacity > 0 ? (first + f) % capacity : first + f;
+			chunk.timestamps[f] = timestamps[slot];
+			chunk.confidences[f] = confidences[slot];
+			chunk.successes[f] = successes[slot];
+			for(int c = 0; c < num_columns; ++c)
+			{
+				chunk.values[(size_t)c * chunk.num_frames + f] = value_columns[c][slot];
+			}
+		}
+
+		consumer(chunk);
+	}
+}
+
+void AUHistory::StreamFile(const function<void(const AUHistoryChunk&)>& consumer)
+{
+	FlushPending();
+
+	ifstream stream(spill_location.c_str(), ios::in | ios::binary);
+	if(!stream.is_open())
+	{
+		cout << "Could not read the AU history file " << spill_location << endl;
+		return;
+	}
+
+	AUHistoryChunk chunk;
+	chunk.first_frame = 0;
+
+	int frames, columns;
+	while(stream.read((char*)&frames, 4) && stream.read((char*)&columns, 4))
+	{
+		chunk.num_frames = frames;
+		chunk.timestamps.resize(frames);
+		chunk.confidences.resize(frames);
+		chunk.successes.resize(frames);
+		chunk.values.resize((size_t)columns * frames);
+
+		stream.read((char*)chunk.timestamps.data(), frames * sizeof(double));
+		stream.read((char*)chunk.confidences.data(), frames * sizeof(double));
+		stream.read((char*)chunk.successes.data(), frames);
+		stream.read((char*)chunk.values.data(), (size_t)columns * frames * sizeof(double));
+
+		if(!stream)
+		{
+			cout << "The AU history file " << spill_location << " is truncated" << endl;
+			break;
+		}
+
+		// Apply the overwrites of the frames in this chunk
+		for(auto overwrite = spilled_overwrites.lower_bound(chunk.first_frame); overwrite != spilled_overwrites.end() && overwrite->first < chunk.first_frame + frames; ++overwrite)
+		{
+			for(int c = 0; c < columns; ++c)
+			{
+				chunk.values[(size_t)c * frames + (overwrite->first - chunk.first_frame)] = overwrite->second[c];
+			}
+		}
+
+		consumer(chunk);
+
+		chunk.first_frame += frames;
+	}
+}
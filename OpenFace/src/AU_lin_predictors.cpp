@@ -0,0 +1,342 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "AU_lin_predictors.h"
+#include "SimdSupport.h"
+
+#include <tbb/tbb.h>
+
+#include <algorithm>
+
+using namespace FaceAnalysis;
+
+namespace
+{
+	// The columns of a predictor with the means folded into its biases, the weights of the dimensions it does not use are 0
+	void PackPredictor(cv::Mat_<float>& weights, cv::Mat_<float>& biases, int first_col, const cv::Mat_<double>& means, const cv::Mat_<double>& support_vectors, const cv::Mat_<double>& predictor_biases)
+	{
+		if(support_vectors.empty())
+		{
+			return;
+		}
+
+		cv::Mat_<double> folded_biases = predictor_biases - means * support_vectors;
+
+		support_vectors.convertTo(weights(cv::Rect(first_col, 0, support_vectors.cols, support_vectors.rows)), CV_32F);
+		folded_biases.convertTo(biases(cv::Rect(first_col, 0, folded_biases.cols, 1)), CV_32F);
+	}
+
+	int RoundUp4(int value)
+	{
+		return (value + 3) / 4 * 4;
+	}
+}
+
+void AU_lin_predictors::Pack(const SVR_static_lin_regressors& svr_static, const SVR_dynamic_lin_regressors& svr_dynamic, const SVM_static_lin& svm_static, const SVM_dynamic_lin& svm_dynamic)
+{
+	const int num_svr_static = svr_static.GetSupportVectors().cols;
+	const int num_svr_dynamic = svr_dynamic.GetSupportVectors().cols;
+	const int num_svm_static = svm_static.GetSupportVectors().cols;
+	const int num_svm_dynamic = svm_dynamic.GetSupportVectors().cols;
+
+	num_reg = num_svr_static + num_svr_dynamic;
+	num_class = num_svm_static + num_svm_dynamic;
+
+	// Some predictors might only use the HOG descriptor, they get zero weights for the geometry
+	int num_inputs = std::max(std::max(svr_static.GetSupportVectors().rows, svr_dynamic.GetSupportVectors().rows), std::max(svm_static.GetSupportVectors().rows, svm_dynamic.GetSupportVectors().rows));
+
+	if(num_reg + num_class == 0 || num_inputs == 0)
+	{
+		weights = cv::Mat_<float>();
+		return;
+	}
+
+	num_static_cols = RoundUp4(num_svr_static + num_svm_static);
+	const int num_cols = num_static_cols + RoundUp4(num_svr_dynamic + num_svm_dynamic);
+
+	weights = cv::Mat_<float>(num_inputs, num_cols, 0.0f);
+	biases = cv::Mat_<float>(1, num_cols, 0.0f);
+	column_output.assign(num_cols, -1);
+
+	// Static columns (regressors and then classifiers), followed by the dynamic ones
+	const int svm_static_col = num_svr_static;
+	const int svr_dynamic_col = num_static_cols;
+	const int svm_dynamic_col = num_static_cols + num_svr_dynamic;
+
+	PackPredictor(weights, biases, 0, svr_static.GetMeans(), svr_static.GetSupportVectors(), svr_static.GetBiases());
+	PackPredictor(weights, biases, svm_static_col, svm_static.GetMeans(), svm_static.GetSupportVectors(), svm_static.GetBiases());
+	PackPredictor(weights, biases, svr_dynamic_col, svr_dynamic.GetMeans(), svr_dynamic.GetSupportVectors(), svr_dynamic.GetBiases());
+	PackPredictor(weights, biases, svm_dynamic_col, svm_dynamic.GetMeans(), svm_dynamic.GetSupportVectors(), svm_dynamic.GetBiases());
+
+	for(int i = 0; i < num_svr_static; ++i)
+	{
+		column_output[i] = i;
+	}
+	for(int i = 0; i < num_svr_dynamic; ++i)
+	{
+		column_output[svr_dynamic_col + i] = num_svr_static + i;
+	}
+	for(int i = 0; i < num_svm_static; ++i)
+	{
+		column_output[svm_static_col + i] = num_reg + i;
+	}
+	for(int i = 0; i < num_svm_dynamic; ++i)
+	{
+		column_output[svm_dynamic_col + i] = num_reg + num_svm_static + i;
+	}
+
+	pos_classes.assign(num_reg, 0.0);
+	neg_classes.assign(num_reg, 0.0);
+	pos_classes.insert(pos_classes.end(), svm_static.GetPosClasses().begin(), svm_static.GetPosClasses().end());
+	pos_classes.insert(pos_classes.end(), svm_dynamic.GetPosClasses().begin(), svm_dynamic.GetPosClasses().end());
+	neg_classes.insert(neg_classes.end(), svm_static.GetNegClasses().begin(), svm_static.GetNegClasses().end());
+	neg_classes.insert(neg_classes.end(), svm_dynamic.GetNegClasses().begin(), svm_dynamic.GetNegClasses().end());
+
+	decisions.create(1, num_cols);
+}
+
+void AU_lin_predictors::Predict(std::vector<double>& predictions, const cv::Mat_<double>& fhog_descriptor, const cv::Mat_<double>& geom_params, const cv::Mat_<double>& running_median, const cv::Mat_<double>& running_median_geom)
+{
+	predictions.resize(num_reg + num_class);
+
+	if(weights.empty() || fhog_descriptor.empty())
+	{
+		return;
+	}
+
+	const int num_inputs = weights.rows;
+	const int num_cols = weights.cols;
+
+	biases.copyTo(decisions);
+	float* decisions_ptr = decisions.ptr<float>(0);
+
+	// The descriptor is the HOG followed by the geometry, without a running median yet the dynamic predictors see the descriptor
+	const int num_hog = std::min(fhog_descriptor.cols, num_inputs);
+	const int num_geom = std::min(geom_params.cols, num_inputs - num_hog);
+
+	for(int i = 0; i < num_hog + num_geom; ++i)
+	{
+		double value, median;
+		if(i < num_hog)
+		{
+			value = fhog_descriptor.at<double>(i);
+			median = running_median.empty() ? 0 : running_median.at<double>(i);
+		}
+		else
+		{
+			value = geom_params.at<double>(i - num_hog);
+			median = running_median_geom.empty() ? 0 : running_median_geom.at<double>(i - num_hog);
+		}
+
+		const float* weights_row = weights.ptr<float>(i);
+
+		// A row of the weights is scaled by the descriptor value for the static predictors and by the value minus its median for
+		// the dynamic ones, accumulating the decision values of all the predictors at once
+#if OPENFACE_SIMD128
+		const cv::v_float32x4 v_value = cv::v_setall_f32((float)value);
+		const cv::v_float32x4 v_dynamic_value = cv::v_setall_f32((float)(value - median));
+
+		int col = 0;
+		for(; col < num_static_cols; col += 4)
+		{
+			cv::v_store(decisions_ptr + col, cv::v_load(decisions_ptr + col) + cv::v_load(weights_row + col) * v_value);
+		}
+		for(; col < num_cols; col += 4)
+		{
+			cv::v_store(decisions_ptr + col, cv::v_load(decisions_ptr + col) + cv::v_load(weights_row + col) * v_dynamic_value);
+		}
+#else
+		const float static_value = (float)value;
+		const float dynamic_value = (float)(value - median);
+
+		int col = 0;
+		for(; col < num_static_cols; ++col)
+		{
+			decisions_ptr[col] += weights_row[col] * static_value;
+		}
+		for(; col < num_cols; ++col)
+		{
+			decisions_ptr[col] += weights_row[col] * dynamic_value;
+		}
+#endif
+	}
+
+	for(int col = 0; col < num_cols; ++col)
+	{
+		const int output = column_output[col];
+		if(output < 0)
+		{
+			continue;
+		}
+
+		if(output < num_reg)
+		{
+			predictions[output] = decisions_ptr[col];
+		}
+		else
+		{
+			predictions[output] = decisions_ptr[col] > 0 ? pos_classes[output] : neg_classes[output];
+		}
+	}
+}
+
+void AU_lin_predictors::PredictBatch(cv::Mat_<double>& predictions, const std::vector<cv::Mat_<double> >& fhog_descriptors, const std::vector<cv::Mat_<double> >& geom_params, const cv::Mat_<double>& running_median, const cv::Mat_<double>& running_median_geom)
+{
+	const int num_frames = (int)fhog_descriptors.size();
+	predictions = cv::Mat_<double>(num_frames, num_reg + num_class, 0.0);
+
+	if(weights.empty() || num_frames == 0)
+	{
+		return;
+	}
+
+	const int num_inputs = weights.rows;
+	const int num_cols = weights.cols;
+
+	// The running median the dynamic predictors subtract, the same for every frame
+	cv::Mat_<float> median(1, num_inputs, 0.0f);
+	const int num_median_hog = running_median.empty() ? 0 : std::min(running_median.cols, num_inputs);
+	const int num_median_geom = running_median_geom.empty() ? 0 : std::min(running_median_geom.cols, num_inputs - num_median_hog);
+	if(num_median_hog > 0)
+	{
+		running_median.colRange(0, num_median_hog).convertTo(median.colRange(0, num_median_hog), CV_32F);
+	}
+	if(num_median_geom > 0)
+	{
+		running_median_geom.colRange(0, num_median_geom).convertTo(median.colRange(num_median_hog, num_median_hog + num_median_geom), CV_32F);
+	}
+
+	const cv::Mat_<float> static_weights = weights.colRange(0, num_static_cols);
+	const cv::Mat_<float> dynamic_weights = weights.colRange(num_static_cols, num_cols);
+
+	// The blocks of frames are independent, so are multiplied in parallel, each with its own buffers (a local copy of the block
+	// size, as std::min takes it by reference and the class constant has no definition outside of the class)
+	const int block_frames = batch_frames;
+	const int num_blocks = (num_frames + block_frames - 1) / block_frames;
+	tbb::parallel_for(0, num_blocks, [&](int block)
+	{
+		cv::Mat_<float> inputs, dynamic_inputs, static_decisions, dynamic_decisions;
+
+		const int first = block * block_frames;
+		const int rows = std::min(block_frames, num_frames - first);
+
+		// The descriptors of the frames, the HOG followed by the geometry, and the same minus the running median for the dynamic
+		// predictors (only where the descriptor has values, as in Predict)
+		inputs = cv::Mat_<float>(rows, num_inputs, 0.0f);
+		dynamic_inputs = cv::Mat_<float>(rows, num_inputs, 0.0f);
+		for(int r = 0; r < rows; ++r)
+		{
+			const cv::Mat_<double>& fhog_descriptor = fhog_descriptors[first + r];
+			const int num_hog = std::min(fhog_descriptor.cols, num_inputs);
+			int num_geom = 0;
+
+			if(num_hog > 0)
+			{
+				fhog_descriptor.colRange(0, num_hog).convertTo(inputs.row(r).colRange(0, num_hog), CV_32F);
+			}
+			if(first + r < (int)geom_params.size() && !geom_params[first + r].empty())
+			{
+				num_geom = std::min(geom_params[first + r].cols, num_inputs - num_hog);
+				if(num_geom > 0)
+				{
+					geom_params[first + r].colRange(0, num_geom).convertTo(inputs.row(r).colRange(num_hog, num_hog + num_geom), CV_32F);
+				}
+			}
+			if(num_hog + num_geom > 0)
+			{
+				cv::subtract(inputs.row(r).colRange(0, num_hog + num_geom), median.colRange(0, num_hog + num_geom), dynamic_inputs.row(r).colRange(0, num_hog + num_geom));
+			}
+		}
+
+		// A matrix product for the static and one for the dynamic predictors
+		if(num_static_cols > 0)
+		{
+			cv::gemm(inputs, static_weights, 1.0, cv::repeat(biases.colRange(0, num_static_cols), rows, 1), 1.0, static_decisions);
+		}
+		if(num_cols > num_static_cols)
+		{
+			cv::gemm(dynamic_inputs, dynamic_weights, 1.0, cv::repeat(biases.colRange(num_static_cols, num_cols), rows, 1), 1.0, dynamic_decisions);
+		}
+
+		for(int r = 0; r < rows; ++r)
+		{
+			const float* static_ptr = num_static_cols > 0 ? static_decisions.ptr<float>(r) : 0;
+			const float* dynamic_ptr = num_cols > num_static_cols ? dynamic_decisions.ptr<float>(r) : 0;
+			double* predictions_ptr = predictions.ptr<double>(first + r);
+
+			for(int col = 0; col < num_cols; ++col)
+			{
+				const int output = column_output[col];
+				if(output < 0)
+				{
+					continue;
+				}
+
+				const float decision = col < num_static_cols ? static_ptr[col] : dynamic_ptr[col - num_static_cols];
+				if(output < num_reg)
+				{
+					predictions_ptr[output] = decision;
+				}
+				else
+				{
+					predictions_ptr[output] = decision > 0 ? pos_classes[output] : neg_classes[output];
+				}
+			}
+		}
+	});
+}
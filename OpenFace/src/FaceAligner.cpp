@@ -0,0 +1,280 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FaceAligner.h"
+#include "SimdSupport.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <cmath>
+
+using namespace FaceAnalysis;
+
+namespace
+{
+	// The more rigid points of the 68 point model (some face outline, eyes, and nose), as in extract_rigid_points
+	const int rigid_points[] = {1, 2, 3, 4, 12, 13, 14, 15, 27, 28, 29, 31, 32, 33, 34, 35, 36, 39, 40, 41, 42, 45, 46, 47};
+	const int num_rigid_points = sizeof(rigid_points) / sizeof(rigid_points[0]);
+
+	// The eyebrows and the sides of the face are moved up to include more of upper face
+	const int raised_points[] = {0, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26};
+	const int num_raised_points = sizeof(raised_points) / sizeof(raised_points[0]);
+	const double raise_pixels = 30;
+
+	// Zero the pixels outside of the mask (which is 0 or 1) in place, all the channels of 16 pixels at a time where SIMD is available
+	void ApplyMask(cv::Mat& image, const cv::Mat_<uchar>& pixel_mask)
+	{
+		const int channels = image.channels();
+#if OPENFACE_SIMD128
+		const cv::v_uint8x16 v_zero = cv::v_setzero_u8();
+#endif
+
+		for(int y = 0; y < image.rows; ++y)
+		{
+			uchar* image_ptr = image.ptr<uchar>(y);
+			const uchar* mask_ptr = pixel_mask.ptr<uchar>(y);
+
+			int x = 0;
+#if OPENFACE_SIMD128
+			if(channels == 3)
+			{
+				for(; x <= image.cols - 16; x += 16)
+				{
+					cv::v_uint8x16 b, g, r;
+					cv::v_load_deinterleave(image_ptr + 3 * x, b, g, r);
+					const cv::v_uint8x16 keep = cv::v_load(mask_ptr + x) > v_zero;
+					cv::v_store_interleave(image_ptr + 3 * x, b & keep, g & keep, r & keep);
+				}
+			}
+			else if(channels == 1)
+			{
+				for(; x <= image.cols - 16; x += 16)
+				{
+					const cv::v_uint8x16 keep = cv::v_load(mask_ptr + x) > v_zero;
+					cv::v_store(image_ptr + x, cv::v_load(image_ptr + x) & keep);
+				}
+			}
+#endif
+
+			for(; x < image.cols; ++x)
+			{
+				if(mask_ptr[x] == 0)
+				{
+					for(int c = 0; c < channels; ++c)
+					{
+						image_ptr[x * channels + c] = 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+void FaceAligner::Reset()
+{
+	cached_landmarks = cv::Mat_<double>();
+	cached_triangulation = cv::Mat_<int>();
+	pixel_mask = cv::Mat_<uchar>();
+}
+
+cv::Matx22d FaceAligner::SimilarityTransform(const cv::Mat_<double>& detected_landmarks, const cv::Mat_<double>& mean_shape, double sim_scale, bool rigid)
+{
+	// The landmarks are stored as the x coordinates followed by the y ones (and the z ones for the mean shape)
+	const int num_points = detected_landmarks.rows / 2;
+	const int num_mean_points = mean_shape.rows / 3;
+	const bool use_rigid = rigid && num_points == 68;
+	const int num_used = use_rigid ? num_rigid_points : num_points;
+
+	const double* src = detected_landmarks.ptr<double>(0);
+	const double* dst = mean_shape.ptr<double>(0);
+
+	double mean_src_x = 0, mean_src_y = 0, mean_dst_x = 0, mean_dst_y = 0;
+	for(int p = 0; p < num_used; ++p)
+	{
+		const int i = use_rigid ? rigid_points[p] : p;
+		mean_src_x += src[i];
+		mean_src_y += src[i + num_points];
+		mean_dst_x += dst[i] * sim_scale;
+		mean_dst_y += dst[i + num_mean_points] * sim_scale;
+	}
+	mean_src_x /= num_used;
+	mean_src_y /= num_used;
+	mean_dst_x /= num_used;
+	mean_dst_y /= num_used;
+
+	// The scale is the ratio of the spreads, and the rotation (as Kabsch's algorithm without reflections finds it) in 2D is the one
+	// angle maximising the correlation of the mean normalised points
+	double src_sq = 0, dst_sq = 0, dot = 0, cross = 0;
+	for(int p = 0; p < num_used; ++p)
+	{
+		const int i = use_rigid ? rigid_points[p] : p;
+		const double src_x = src[i] - mean_src_x;
+		const double src_y = src[i + num_points] - mean_src_y;
+		const double dst_x = dst[i] * sim_scale - mean_dst_x;
+		const double dst_y = dst[i + num_mean_points] * sim_scale - mean_dst_y;
+
+		src_sq += src_x * src_x + src_y * src_y;
+		dst_sq += dst_x * dst_x + dst_y * dst_y;
+		dot += src_x * dst_x + src_y * dst_y;
+		cross += src_x * dst_y - src_y * dst_x;
+	}
+
+	const double s = std::sqrt(dst_sq / src_sq);
+	const double angle = std::atan2(cross, dot);
+	const double cos_s = s * std::cos(angle);
+	const double sin_s = s * std::sin(angle);
+
+	return cv::Matx22d(cos_s, -sin_s, sin_s, cos_s);
+}
+
+bool FaceAligner::MaskValid(const cv::Mat_<int>& triangulation, int out_width, int out_height) const
+{
+	if(pixel_mask.cols != out_width || pixel_mask.rows != out_height || cached_landmarks.rows != mask_landmarks.rows)
+	{
+		return false;
+	}
+
+	if(cached_triangulation.rows != triangulation.rows || cached_triangulation.cols != triangulation.cols)
+	{
+		return false;
+	}
+	for(int r = 0; r < triangulation.rows; ++r)
+	{
+		for(int c = 0; c < triangulation.cols; ++c)
+		{
+			if(cached_triangulation(r, c) != triangulation(r, c))
+			{
+				return false;
+			}
+		}
+	}
+
+	// Moving all of the landmarks by less than a pixel changes at most the pixels along the edge of the mask
+	for(int i = 0; i < mask_landmarks.rows; ++i)
+	{
+		if(std::abs(mask_landmarks(i) - cached_landmarks(i)) >= 1.0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void FaceAligner::AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const LandmarkDetector::CLNF& clnf_model, const cv::Mat_<int>& triangulation, bool rigid, double sim_scale, int out_width, int out_height)
+{
+	// Will warp to scaled mean shape
+	cv::Matx22d scale_rot_matrix = SimilarityTransform(clnf_model.detected_landmarks, clnf_model.pdm.mean_shape, sim_scale, rigid);
+	cv::Matx23d warp_matrix;
+
+	warp_matrix(0,0) = scale_rot_matrix(0,0);
+	warp_matrix(0,1) = scale_rot_matrix(0,1);
+	warp_matrix(1,0) = scale_rot_matrix(1,0);
+	warp_matrix(1,1) = scale_rot_matrix(1,1);
+
+	double tx = clnf_model.params_global[4];
+	double ty = clnf_model.params_global[5];
+
+	cv::Vec2d T(tx, ty);
+	T = scale_rot_matrix * T;
+
+	// Make sure centering is correct
+	warp_matrix(0,2) = -T(0) + out_width/2;
+	warp_matrix(1,2) = -T(1) + out_height/2;
+
+	// Writes into the buffer of aligned_face if it already has the output size and type
+	cv::warpAffine(frame, aligned_face, warp_matrix, cv::Size(out_width, out_height), cv::INTER_LINEAR);
+
+	if(aligned_face.depth() != CV_8U)
+	{
+		aligned_face.convertTo(aligned_face, CV_8U);
+	}
+
+	// Move the landmarks there as well
+	const int num_points = clnf_model.detected_landmarks.rows / 2;
+	const double* landmarks_ptr = clnf_model.detected_landmarks.ptr<double>(0);
+
+	mask_landmarks.create(2 * num_points, 1);
+	for(int i = 0; i < num_points; ++i)
+	{
+		const double x = landmarks_ptr[i];
+		const double y = landmarks_ptr[i + num_points];
+		mask_landmarks(i) = warp_matrix(0,0) * x + warp_matrix(0,1) * y + warp_matrix(0,2);
+		mask_landmarks(i + num_points) = warp_matrix(1,0) * x + warp_matrix(1,1) * y + warp_matrix(1,2);
+	}
+
+	for(int p = 0; p < num_raised_points; ++p)
+	{
+		if(raised_points[p] < num_points)
+		{
+			mask_landmarks(raised_points[p] + num_points) -= raise_pixels;
+		}
+	}
+
+	// Rasterise the mask again only if the landmarks moved enough to change it
+	if(!MaskValid(triangulation, aligned_face.cols, aligned_face.rows))
+	{
+		LandmarkDetector::PAW paw(mask_landmarks, triangulation, 0, 0, aligned_face.cols-1, aligned_face.rows-1);
+
+		pixel_mask = paw.pixel_mask;
+		mask_landmarks.copyTo(cached_landmarks);
+		triangulation.copyTo(cached_triangulation);
+	}
+
+	ApplyMask(aligned_face, pixel_mask);
+}
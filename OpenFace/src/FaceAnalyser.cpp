@@ -65,6 +65,8 @@
 // System includes
 #include <stdio.h>
 #include <iostream>
+#include <algorithm>
+#include <stdexcept>
 
 #include <string>
 
@@ -74,6 +76,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+// TBB includes
+#include <tbb/tbb.h>
+
 // Local includes
 #include "LandmarkCoreIncludes.h"
 #include "Face_utils.h"
@@ -113,10 +118,7 @@ FaceAnalyser::FaceAnalyser(vector<cv::Vec3d> orientation_bins, double scale, int
 	{
 		head_orientations = orientation_bins;
 	}
-	hog_hist_sum.resize(head_orientations.size());
-	face_image_hist_sum.resize(head_orientations.size());
 	hog_desc_hist.resize(head_orientations.size());
-	geom_hist_sum = 0;
 	face_image_hist.resize(head_orientations.size());
 
 	au_prediction_correction_count.resize(head_orientations.size(), 0);
@@ -277,8 +279,8 @@ void FaceAnalyser::ExtractCurrentMedians(vector<cv::Mat>& hog_medians, vector<cv
 		cv::Mat_<double> median_face(this->face_image_median.rows, this->face_image_median.cols, 0.0);
 		cv::Mat_<double> median_hog(this->hog_desc_median.rows, this->hog_desc_median.cols, 0.0);
 
-		ExtractMedian(this->face_image_hist[i], this->face_image_hist_sum[i], median_face, 256, 0, 255);		
-		ExtractMedian(this->hog_desc_hist[i], this->hog_hist_sum[i], median_hog, this->num_bins_hog, 0, 1);
+		ExtractMedian(this->face_image_hist[i], median_face, 256, 0, 255);		
+		ExtractMedian(this->hog_desc_hist[i], median_hog, this->num_bins_hog, 0, 1);
 
 		// Add the HOG sample
 		hog_medians.push_back(median_hog.clone());
@@ -306,7 +308,7 @@ std::pair<std::vector<std::pair<string, double>>, std::vector<std::pair<string,
 {
 	
 	// First align the face
-	AlignFaceMask(aligned_face, frame, clnf, triangulation, true, align_scale, align_width, align_height);
+	face_aligner.AlignFaceMask(aligned_face, frame, clnf, triangulation, true, align_scale, align_width, align_height);
 	
 	// Extract HOG descriptor from the frame and convert it to a useable format
 	cv::Mat_<double> hog_descriptor;
@@ -338,8 +340,9 @@ std::pair<std::vector<std::pair<string, double>>, std::vector<std::pair<string,
 	}
 
 	// Perform AU prediction	
-	auto AU_predictions_intensity = PredictCurrentAUs(orientation_to_use);
-	auto AU_predictions_occurence = PredictCurrentAUsClass(orientation_to_use);
+	std::vector<std::pair<std::string, double>> AU_predictions_intensity;
+	std::vector<std::pair<std::string, double>> AU_predictions_occurence;
+	PredictCurrentAUsAll(orientation_to_use, AU_predictions_intensity, AU_predictions_occurence);
 
 	// Make sure intensity is within range (0-5)
 	for (size_t au = 0; au < AU_predictions_intensity.size(); ++au)
@@ -355,6 +358,66 @@ std::pair<std::vector<std::pair<string, double>>, std::vector<std::pair<string,
 
 }
 
+void FaceAnalyser::PredictStaticAUsBatch(vector<vector<pair<string, double>>>& intensities, vector<vector<pair<string, double>>>& occurences, const vector<cv::Mat>& frames, const vector<const LandmarkDetector::CLNF*>& clnf_models)
+{
+	const int num_faces = (int)std::min(frames.size(), clnf_models.size());
+
+	vector<cv::Mat_<double>> hog_descriptors(num_faces);
+	vector<cv::Mat_<double>> geom_descriptors(num_faces);
+	vector<int> hog_rows(num_faces, 0);
+	vector<int> hog_cols(num_faces, 0);
+
+	// Align the faces and extract their descriptors, each face with its own buffers
+	tbb::parallel_for(0, num_faces, [&](int i)
+	{
+		const LandmarkDetector::CLNF& clnf = *clnf_models[i];
+
+		cv::Mat aligned;
+		AlignFaceMask(aligned, frames[i], clnf, triangulation, true, align_scale, align_width, align_height);
+		Extract_FHOG_descriptor(hog_descriptors[i], aligned, hog_rows[i], hog_cols[i]);
+
+		// Stack the actual feature point locations (without mean) with the shape parameters
+		cv::Mat_<double> geom_params = clnf.params_local.t();
+		cv::Mat_<double> locs = clnf.pdm.princ_comp * geom_params.t();
+		cv::hconcat(locs.t(), geom_params, geom_descriptors[i]);
+	});
+
+	if(num_faces > 0)
+	{
+		this->num_hog_rows = hog_rows.back();
+		this->num_hog_cols = hog_cols.back();
+	}
+
+	// Perform AU prediction for all the faces
+	cv::Mat_<double> predictions;
+	AU_lin_packed.PredictBatch(predictions, hog_descriptors, geom_descriptors, this->hog_desc_median, this->geom_descriptor_median);
+
+	const int num_reg = AU_lin_packed.NumReg();
+	const int num_class = AU_lin_packed.NumClass();
+	const vector<string> reg_names = GetAURegNames();
+	const vector<string> class_names = GetAUClassNames();
+
+	intensities.resize(num_faces);
+	occurences.resize(num_faces);
+	for(int i = 0; i < num_faces; ++i)
+	{
+		const double* predictions_ptr = predictions.ptr<double>(i);
+
+		intensities[i].resize(num_reg);
+		for(int au = 0; au < num_reg; ++au)
+		{
+			// Make sure intensity is within range (0-5)
+			intensities[i][au] = pair<string, double>(reg_names[au], std::min(std::max(predictions_ptr[au], 0.0), 5.0));
+		}
+
+		occurences[i].resize(num_class);
+		for(int au = 0; au < num_class; ++au)
+		{
+			occurences[i][au] = pair<string, double>(class_names[au], predictions_ptr[num_reg + au]);
+		}
+	}
+}
+
 void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CLNF& clnf_model, double timestamp_seconds, bool online, bool visualise)
 {
 
@@ -363,11 +426,12 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CL
 	// First align the face if tracking was successfull
 	if(clnf_model.detection_success)
 	{
-		AlignFaceMask(aligned_face, frame, clnf_model, triangulation, true, align_scale, align_width, align_height);
+		face_aligner.AlignFaceMask(aligned_face, frame, clnf_model, triangulation, true, align_scale, align_width, align_height);
 	}
 	else
 	{
-		aligned_face = cv::Mat(align_height, align_width, CV_8UC3);
+		// Reuses the buffer of the last aligned face
+		aligned_face.create(align_height, align_width, CV_8UC3);
 		aligned_face.setTo(0);
 	}
 
@@ -427,7 +491,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CL
 	// A small speedup
 	if(frames_tracking % 2 == 1)
 	{
-		UpdateRunningMedian(this->hog_desc_hist[orientation_to_use], this->hog_hist_sum[orientation_to_use], this->hog_desc_median, hog_descriptor, update_median, this->num_bins_hog, this->min_val_hog, this->max_val_hog);
+		UpdateRunningMedian(this->hog_desc_hist[orientation_to_use], this->hog_desc_median, hog_descriptor, update_median, this->num_bins_hog, this->min_val_hog, this->max_val_hog);
 		this->hog_desc_median.setTo(0, this->hog_desc_median < 0);
 	}	
 
@@ -447,7 +511,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CL
 	// A small speedup
 	if(frames_tracking % 2 == 1)
 	{
-		UpdateRunningMedian(this->geom_desc_hist, this->geom_hist_sum, this->geom_descriptor_median, geom_descriptor_frame, update_median, this->num_bins_geom, this->min_val_geom, this->max_val_geom);
+		UpdateRunningMedian(this->geom_desc_hist, this->geom_descriptor_median, geom_descriptor_frame, update_median, this->num_bins_geom, this->min_val_geom, this->max_val_geom);
 	}
 
 	// First convert the face image to double representation as a row vector
@@ -456,7 +520,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CL
 	aligned_face_cols.convertTo(aligned_face_cols_double, CV_64F);
 	
 	// TODO get rid of this completely as it takes too long?
-	//UpdateRunningMedian(this->face_image_hist[orientation_to_use], this->face_image_hist_sum[orientation_to_use], this->face_image_median, aligned_face_cols_double, update_median, 256, 0, 255);
+	//UpdateRunningMedian(this->face_image_hist[orientation_to_use], this->face_image_median, aligned_face_cols_double, update_median, 256, 0, 255);
 
 	// Visualising the median HOG
 	if(visualise)
@@ -465,7 +529,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CL
 	}
 
 	// Perform AU prediction	
-	AU_predictions_reg = PredictCurrentAUs(orientation_to_use);
+	PredictCurrentAUsAll(orientation_to_use, AU_predictions_reg, AU_predictions_class);
 
 	std::vector<std::pair<std::string, double>> AU_predictions_reg_corrected;
 	if(online)
@@ -473,39 +537,6 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CL
 		AU_predictions_reg_corrected = CorrectOnlineAUs(AU_predictions_reg, orientation_to_use, true, false, clnf_model.detection_success);
 	}
 
-	// Add the reg predictions to the historic data
-	for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
-	{
-
-		// Find the appropriate AU (if not found add it)		
-		// Only add if the detection was successful
-		if(clnf_model.detection_success)
-		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(AU_predictions_reg[au].second);
-		}
-		else
-		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(0);
-		}
-	}
-	
-	AU_predictions_class = PredictCurrentAUsClass(orientation_to_use);
-
-	for (size_t au = 0; au < AU_predictions_class.size(); ++au)
-	{
-
-		// Find the appropriate AU (if not found add it)		
-		// Only add if the detection was successful
-		if(clnf_model.detection_success)
-		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(AU_predictions_class[au].second);
-		}
-		else
-		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(0);
-		}
-	}
-	
 
 	if(online)
 	{
@@ -518,6 +549,7 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CL
 			hog_desc_frames_init.push_back(hog_descriptor);
 			geom_descriptor_frames_init.push_back(geom_descriptor_frame);
 			views.push_back(orientation_to_use);
+			frames_init.push_back(AU_history.NumFrames());
 		}
 	}
 
@@ -525,11 +557,8 @@ void FaceAnalyser::AddNextFrame(const cv::Mat& frame, const LandmarkDetector::CL
 
 	view_used = orientation_to_use;
 			
-	bool success = clnf_model.detection_success;
-
-	confidences.push_back(clnf_model.detection_certainty);
-	valid_preds.push_back(success);
-	timestamps.push_back(timestamp_seconds);
+	// Add the predictions to the historic data
+	AppendToHistory(timestamp_seconds, clnf_model.detection_certainty, clnf_model.detection_success);
 
 
 
@@ -550,7 +579,7 @@ void FaceAnalyser::PredictAUs(const cv::Mat_<double>& hog_features, const cv::Ma
 	int orientation_to_use = GetViewId(this->head_orientations, curr_orient);
 
 	// Perform AU prediction	
-	AU_predictions_reg = PredictCurrentAUs(orientation_to_use);
+	PredictCurrentAUsAll(orientation_to_use, AU_predictions_reg, AU_predictions_class);
 
 	std::vector<std::pair<std::string, double>> AU_predictions_reg_corrected;
 	if(online)
@@ -558,44 +587,12 @@ void FaceAnalyser::PredictAUs(const cv::Mat_<double>& hog_features, const cv::Ma
 		AU_predictions_reg_corrected = CorrectOnlineAUs(AU_predictions_reg, orientation_to_use, true, false, clnf_model.detection_success);
 	}
 
-	// Add the reg predictions to the historic data
-	for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
-	{
-
-		// Find the appropriate AU (if not found add it)		
-		// Only add if the detection was successful
-		if(clnf_model.detection_success)
-		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(AU_predictions_reg[au].second);
-		}
-		else
-		{
-			AU_predictions_reg_all_hist[AU_predictions_reg[au].first].push_back(0.0);
-		}
-	}
-
-	AU_predictions_class = PredictCurrentAUsClass(orientation_to_use);
-
-	for (size_t au = 0; au < AU_predictions_class.size(); ++au)
-	{
-
-		// Find the appropriate AU (if not found add it)		
-		// Only add if the detection was successful
-		if(clnf_model.detection_success)
-		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(AU_predictions_class[au].second);
-		}
-		else
-		{
-			AU_predictions_class_all_hist[AU_predictions_class[au].first].push_back(0.0);
-		}
-	}
-
 	if(online)
 	{
 		AU_predictions_reg = AU_predictions_reg_corrected;
 	}
 
+	AU_predictions_combined.clear();
 	for(size_t i = 0; i < AU_predictions_reg.size(); ++i)
 	{
 		AU_predictions_combined.push_back(AU_predictions_reg[i]);
@@ -607,53 +604,121 @@ void FaceAnalyser::PredictAUs(const cv::Mat_<double>& hog_features, const cv::Ma
 
 	view_used = orientation_to_use;
 
-	bool success = clnf_model.detection_success;
+	// Add the predictions to the historic data
+	AppendToHistory(current_time_seconds, clnf_model.detection_certainty, clnf_model.detection_success);
+}
+
+void FaceAnalyser::AppendToHistory(double timestamp, double confidence, bool success)
+{
+	const int num_columns = AU_lin_packed.NumReg() + AU_lin_packed.NumClass();
 
-	confidences.push_back(clnf_model.detection_certainty);
-	valid_preds.push_back(success);
+	// Only keep the predictions if the detection was successful
+	if(success && (int)AU_predictions_packed.size() == num_columns)
+	{
+		AU_history.Append(timestamp, confidence, success, AU_predictions_packed);
+	}
+	else
+	{
+		AU_history_row.assign(num_columns, 0.0);
+		AU_history.Append(timestamp, confidence, success, AU_history_row);
+	}
 }
 
-// Perform prediction on initial n frames anew as the current neutral face estimate is better now
-void FaceAnalyser::PostprocessPredictions()
+void FaceAnalyser::SetHistoryLimits(int capacity_frames, const std::string& spill_location)
 {
-	if(!postprocessed)
+	AU_history.SetLimits(capacity_frames, spill_location);
+
+	hog_desc_frames_init.clear();
+	geom_descriptor_frames_init.clear();
+	views.clear();
+	frames_init.clear();
+	postprocessed = false;
+}
+
+void FaceAnalyser::ReadHistory(int first_column, const vector<string>& au_names, vector<std::pair<std::string, vector<double>>>& au_predictions, vector<double>& confidences, vector<bool>& successes, vector<double>& timestamps)
+{
+	// In the order of the names
+	vector<int> order(au_names.size());
+	for(size_t i = 0; i < order.size(); ++i)
 	{
-		int success_ind = 0;
-		int all_ind = 0;
-		int all_frames_size = timestamps.size();
-		
-		while(all_ind < all_frames_size && success_ind < max_init_frames)
-		{
-		
-			if(valid_preds[all_ind])
-			{
+		order[i] = (int)i;
+	}
+	std::sort(order.begin(), order.end(), [&au_names](int a, int b) { return au_names[a] < au_names[b]; });
 
-				this->hog_desc_frame = hog_desc_frames_init[success_ind];
-				this->geom_descriptor_frame = geom_descriptor_frames_init[success_ind];
+	au_predictions.clear();
+	for(size_t i = 0; i < order.size(); ++i)
+	{
+		au_predictions.push_back(std::pair<string, vector<double>>(au_names[order[i]], vector<double>()));
+		au_predictions.back().second.reserve(AU_history.NumFrames());
+	}
 
-				// Perform AU prediction	
-				auto AU_predictions_reg = PredictCurrentAUs(views[success_ind]);								
+	timestamps.clear();
+	confidences.clear();
+	successes.clear();
 
-				// Modify the predictions to the historic data
-				for (size_t au = 0; au < AU_predictions_reg.size(); ++au)
-				{
-					// Find the appropriate AU (if not found add it)		
-					AU_predictions_reg_all_hist[AU_predictions_reg[au].first][all_ind] = AU_predictions_reg[au].second;
+	AU_history.Stream([&](const AUHistoryChunk& chunk)
+	{
+		timestamps.insert(timestamps.end(), chunk.timestamps.begin(), chunk.timestamps.end());
+		confidences.insert(confidences.end(), chunk.confidences.begin(), chunk.confidences.end());
+		for(int f = 0; f < chunk.num_frames; ++f)
+		{
+			successes.push_back(chunk.successes[f] != 0);
+		}
 
-				}
+		for(size_t i = 0; i < order.size(); ++i)
+		{
+			const double* column = chunk.Column(first_column + order[i]);
+			au_predictions[i].second.insert(au_predictions[i].second.end(), column, column + chunk.num_frames);
+		}
+	});
+}
 
-				auto AU_predictions_class = PredictCurrentAUsClass(views[success_ind]);
+// A centred moving average of the predictions of an AU (the frames at either end are kept), thresholded at 0.5 for the presence of
+// AUs. The frames are averaged in parallel chunks from a copy of the predictions
+void SmoothPredictions(vector<double>& au_vals, int window_size, bool threshold)
+{
+	const size_t half_window = (window_size - 1) / 2;
+	if(au_vals.size() <= 2 * half_window)
+	{
+		return;
+	}
 
-				for (size_t au = 0; au < AU_predictions_class.size(); ++au)
-				{
-					// Find the appropriate AU (if not found add it)		
-					AU_predictions_class_all_hist[AU_predictions_class[au].first][all_ind] = AU_predictions_class[au].second;
-				}
-		
-				success_ind++;
+	const vector<double> au_vals_tmp = au_vals;
+	tbb::parallel_for(tbb::blocked_range<size_t>(half_window, au_vals.size() - half_window), [&](const tbb::blocked_range<size_t>& frames)
+	{
+		for(size_t i = frames.begin(); i < frames.end(); ++i)
+		{
+			double sum = 0;
+			for(size_t w = i - half_window; w <= i + half_window; ++w)
+			{
+				sum += au_vals_tmp[w];
+			}
+			sum = sum / window_size;
+
+			if(threshold)
+			{
+				sum = sum < 0.5 ? 0 : 1;
 			}
-			all_ind++;
 
+			au_vals[i] = sum;
+		}
+	});
+}
+
+// Perform prediction on initial n frames anew as the current neutral face estimate is better now
+void FaceAnalyser::PostprocessPredictions()
+{
+	if(!postprocessed)
+	{
+		// All the stored frames are predicted with the same (final) running median, so as matrix products over the frames
+		cv::Mat_<double> predictions;
+		AU_lin_packed.PredictBatch(predictions, hog_desc_frames_init, geom_descriptor_frames_init, this->hog_desc_median, this->geom_descriptor_median);
+
+		for(size_t i = 0; i < hog_desc_frames_init.size(); ++i)
+		{
+			// Modify the predictions to the historic data
+			AU_history_row.assign(predictions.ptr<double>((int)i), predictions.ptr<double>((int)i) + predictions.cols);
+			AU_history.Overwrite(frames_init[i], AU_history_row);
 		}
 		postprocessed = true;
 	}
@@ -666,42 +731,22 @@ void FaceAnalyser::ExtractAllPredictionsOfflineReg(vector<std::pair<std::string,
 		PostprocessPredictions();
 	}
 
-	timestamps = this->timestamps;
-	au_predictions.clear();
-	// First extract the valid AU values and put them in a different format
-	vector<vector<double>> aus_valid;
-	vector<double> offsets;
-	confidences = this->confidences;
-	successes = this->valid_preds;
-	
+	// Stream the intensities back from the history
+	ReadHistory(0, GetAURegNames(), au_predictions, confidences, successes, timestamps);
+
 	vector<string> dyn_au_names = AU_SVR_dynamic_appearance_lin_regressors.GetAUNames();
+	const vector<double>& cutoffs = AU_SVR_dynamic_appearance_lin_regressors.GetCutoffs();
 
-	// Allow these AUs to be person calirated based on expected number of neutral frames (learned from the data)
-	for(auto au_iter = AU_predictions_reg_all_hist.begin(); au_iter != AU_predictions_reg_all_hist.end(); ++au_iter)
+	// The AUs are independent of each other, so are corrected and smoothed in parallel
+	tbb::parallel_for(0, (int)au_predictions.size(), [&](int au)
 	{
-		vector<double> au_good;
-		string au_name = au_iter->first;
-		vector<double> au_vals = au_iter->second;
-		
-		au_predictions.push_back(std::pair<string,vector<double>>(au_name, au_vals));
-
-		for(size_t frame = 0; frame < au_vals.size(); ++frame)
-		{
-
-			if(successes[frame])
-			{
-				au_good.push_back(au_vals[frame]);
-			}
-
-		}
+		const string& au_name = au_predictions[au].first;
+		vector<double>& au_vals = au_predictions[au].second;
 
-		if(au_good.empty() || !dynamic)
+		// Allow these AUs to be person calirated based on expected number of neutral frames (learned from the data)
+		double offset = 0;
+		if(dynamic)
 		{
-			offsets.push_back(0.0);
-		}
-		else
-		{
-			std::sort(au_good.begin(), au_good.end());
 			// If it is a dynamic AU regressor we can also do some prediction shifting to make it more accurate
 			// The shifting proportion is learned and is callen cutoff
 
@@ -715,68 +760,51 @@ void FaceAnalyser::ExtractAllPredictionsOfflineReg(vector<std::pair<std::string,
 				}
 			}
 
-			if (au_id != -1 && AU_SVR_dynamic_appearance_lin_regressors.GetCutoffs()[au_id] != -1)
+			if (au_id != -1 && cutoffs[au_id] != -1)
 			{
-				double cutoff = AU_SVR_dynamic_appearance_lin_regressors.GetCutoffs()[au_id];
-				offsets.push_back(au_good.at((int)au_good.size() * cutoff));				
-			}
-			else
-			{
-				offsets.push_back(0);
-			}
-		}
-		
-		aus_valid.push_back(au_good);
-	}
-	
-	// sort each of the aus and adjust the dynamic ones
-	for(size_t au = 0; au < au_predictions.size(); ++au)
-	{
-
-		for(size_t frame = 0; frame < au_predictions[au].second.size(); ++frame)
-		{
-
-			if(successes[frame])
-			{
-				double scaling = 1;
-				
-				au_predictions[au].second[frame] = (au_predictions[au].second[frame] - offsets[au]) * scaling;
-				
-				if(au_predictions[au].second[frame] < 0.0)
-					au_predictions[au].second[frame] = 0;
+				vector<double> au_good;
+				au_good.reserve(au_vals.size());
+				for(size_t frame = 0; frame < au_vals.size(); ++frame)
+				{
+					if(successes[frame])
+					{
+						au_good.push_back(au_vals[frame]);
+					}
+				}
 
-				if(au_predictions[au].second[frame] > 5)
-					au_predictions[au].second[frame] = 5;
-				
-			}
-			else
-			{
-				au_predictions[au].second[frame] = 0;
+				if(!au_good.empty())
+				{
+					// Only the value at the cutoff is needed, not the whole sorted order
+					size_t cutoff_id = (size_t)((int)au_good.size() * cutoffs[au_id]);
+					if(cutoff_id >= au_good.size())
+					{
+						throw std::out_of_range("AU cutoff outside of the valid frames");
+					}
+					std::nth_element(au_good.begin(), au_good.begin() + cutoff_id, au_good.end());
+					offset = au_good[cutoff_id];
+				}
 			}
 		}
-	}
-
-	// Perform some prediction smoothing
-	for (auto au_iter = au_predictions.begin(); au_iter != au_predictions.end(); ++au_iter)
-	{
-		string au_name = au_iter->first;
 
-		// Perform a moving average of 3 frames
-		int window_size = 3;
-		vector<double> au_vals_tmp = au_iter->second;
-		for (size_t i = (window_size - 1) / 2; i < au_iter->second.size() - (window_size - 1) / 2; ++i)
+		// Adjust the dynamic ones and clamp to the intensity range
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, au_vals.size()), [&](const tbb::blocked_range<size_t>& frames)
 		{
-			double sum = 0;
-			for (int w = -(window_size - 1) / 2; w <= (window_size - 1) / 2; ++w)
+			for(size_t frame = frames.begin(); frame < frames.end(); ++frame)
 			{
-				sum += au_vals_tmp[i + w];
+				if(successes[frame])
+				{
+					au_vals[frame] = std::min(std::max(au_vals[frame] - offset, 0.0), 5.0);
+				}
+				else
+				{
+					au_vals[frame] = 0;
+				}
 			}
-			sum = sum / window_size;
+		});
 
-			au_iter->second[i] = sum;
-		}
-
-	}
+		// Perform some prediction smoothing, a moving average of 3 frames
+		SmoothPredictions(au_vals, 3, false);
+	});
 
 }
 
@@ -787,39 +815,14 @@ void FaceAnalyser::ExtractAllPredictionsOfflineClass(vector<std::pair<std::strin
 		PostprocessPredictions();
 	}
 
-	timestamps = this->timestamps;
-	au_predictions.clear();
+	// Stream the presence back from the history
+	ReadHistory(AU_lin_packed.NumReg(), GetAUClassNames(), au_predictions, confidences, successes, timestamps);
 
-	for(auto au_iter = AU_predictions_class_all_hist.begin(); au_iter != AU_predictions_class_all_hist.end(); ++au_iter)
+	// Perform a moving average of 7 frames on classifications, the AUs in parallel
+	tbb::parallel_for(0, (int)au_predictions.size(), [&](int au)
 	{
-		string au_name = au_iter->first;
-		vector<double> au_vals = au_iter->second;
-		
-		// Perform a moving average of 7 frames on classifications
-		int window_size = 7;
-		vector<double> au_vals_tmp = au_vals;
-		for (size_t i = (window_size - 1)/2; i < au_vals.size() - (window_size - 1) / 2; ++i)
-		{
-			double sum = 0;
-			for (int w = -(window_size - 1) / 2; w <= (window_size - 1) / 2; ++w)
-			{
-				sum += au_vals_tmp[i + w];
-			}
-			sum = sum / window_size;
-			if (sum < 0.5)
-				sum = 0;
-			else
-				sum = 1;
-
-			au_vals[i] = sum;
-		}
-
-		au_predictions.push_back(std::pair<string,vector<double>>(au_name, au_vals));
-
-	}
-
-	confidences = this->confidences;
-	successes = this->valid_preds;
+		SmoothPredictions(au_predictions[au].second, 7, true);
+	});
 }
 
 // Reset the models
@@ -832,12 +835,9 @@ void FaceAnalyser::Reset()
 
 	for( size_t i = 0; i < hog_desc_hist.size(); ++i)
 	{
-		this->hog_desc_hist[i] = cv::Mat_<unsigned int>(hog_desc_hist[i].rows, hog_desc_hist[i].cols, (unsigned int)0);
-		this->hog_hist_sum[i] = 0;
+		this->hog_desc_hist[i].Reset(hog_desc_hist[i].Dimensions(), num_bins_hog);
 
-
-		this->face_image_hist[i] = cv::Mat_<unsigned int>(face_image_hist[i].rows, face_image_hist[i].cols, (unsigned int)0);
-		this->face_image_hist_sum[i] = 0;
+		this->face_image_hist[i].Reset(face_image_hist[i].Dimensions(), 256);
 
 		// 0 callibration predictions
 		this->au_prediction_correction_count[i] = 0;
@@ -845,8 +845,7 @@ void FaceAnalyser::Reset()
 	}
 
 	this->geom_descriptor_median.setTo(cv::Scalar(0));
-	this->geom_desc_hist = cv::Mat_<unsigned int>(geom_desc_hist.rows, geom_desc_hist.cols, (unsigned int)0);
-	geom_hist_sum = 0;
+	this->geom_desc_hist.Reset(geom_desc_hist.Dimensions(), num_bins_geom);
 
 	// Reset the predictions
 	AU_prediction_track = cv::Mat_<double>(AU_prediction_track.rows, AU_prediction_track.cols, 0.0);
@@ -858,20 +857,18 @@ void FaceAnalyser::Reset()
 	AU_predictions_reg.clear();
 	AU_predictions_class.clear();
 	AU_predictions_combined.clear();
-	timestamps.clear();
-	AU_predictions_reg_all_hist.clear();
-	AU_predictions_class_all_hist.clear();
-	confidences.clear();
-	valid_preds.clear();
+	AU_history.Clear();
 
 	// Clean up the postprocessing data as well
 	hog_desc_frames_init.clear();
 	geom_descriptor_frames_init.clear();
+	views.clear();
+	frames_init.clear();
 	postprocessed = false;
 	frames_tracking_succ = 0;
 }
 
-void FaceAnalyser::UpdateRunningMedian(cv::Mat_<unsigned int>& histogram, int& hist_count, cv::Mat_<double>& median, const cv::Mat_<double>& descriptor, bool update, int num_bins, double min_val, double max_val)
+void FaceAnalyser::UpdateRunningMedian(HistogramMedian& histogram, cv::Mat_<double>& median, const cv::Mat_<double>& descriptor, bool update, int num_bins, double min_val, double max_val)
 {
 
 	double length = max_val - min_val;
@@ -879,61 +876,42 @@ void FaceAnalyser::UpdateRunningMedian(cv::Mat_<unsigned int>& histogram, int& h
 		length = -length;
 
 	// The median update
-	if(histogram.empty())
+	if(histogram.Empty())
 	{
-		histogram = cv::Mat_<unsigned int>(descriptor.cols, num_bins, (unsigned int)0);
+		histogram.Reset(descriptor.cols, num_bins);
 		median = descriptor.clone();
 	}
 
 	if(update)
 	{
-		// Find the bins corresponding to the current descriptor
-		cv::Mat_<double> converted_descriptor = (descriptor - min_val)*((double)num_bins)/(length);
-
-		// Capping the top and bottom values
-		converted_descriptor.setTo(cv::Scalar(num_bins-1), converted_descriptor > num_bins - 1);
-		converted_descriptor.setTo(cv::Scalar(0), converted_descriptor < 0);
-
-		for(int i = 0; i < histogram.rows; ++i)
-		{
-			int index = (int)converted_descriptor.at<double>(i);
-			histogram.at<unsigned int>(i, index)++;
-		}
-
-		// Update the histogram count
-		hist_count++;
+		// Adds the descriptor to the histograms and moves the median bins
+		histogram.Add(descriptor, min_val, max_val);
 	}
 
-	if(hist_count == 1)
+	if(histogram.Count() == 1)
 	{
 		median = descriptor.clone();
 	}
 	else
 	{
-		// Recompute the median
-		int cutoff_point = (hist_count + 1)/2;
-
-		// For each dimension
-		for(int i = 0; i < histogram.rows; ++i)
+		// The median is the centre of the median bin of each dimension
+		const double bin_width = length/((double)num_bins);
+		const double bin_centre = (0.5*(length)/ ((double)num_bins));
+		const int dimensions = histogram.Dimensions();
+		for(int i = 0; i < dimensions; ++i)
 		{
-			int cummulative_sum = 0;
-			for(int j = 0; j < histogram.cols; ++j)
-			{
-				cummulative_sum += histogram.at<unsigned int>(i, j);
-				if(cummulative_sum >= cutoff_point)
-				{
-					median.at<double>(i) = min_val + ((double)j) * (length/((double)num_bins)) + (0.5*(length)/ ((double)num_bins));
-					break;
-				}
-			}
+			median.at<double>(i) = min_val + ((double)histogram.MedianBin(i)) * bin_width + bin_centre;
 		}
 	}
 }
 
 
-void FaceAnalyser::ExtractMedian(cv::Mat_<unsigned int>& histogram, int hist_count, cv::Mat_<double>& median, int num_bins, double min_val, double max_val)
+void FaceAnalyser::ExtractMedian(const HistogramMedian& histogram_median, cv::Mat_<double>& median, int num_bins, double min_val, double max_val)
 {
 
+	const cv::Mat_<unsigned int>& histogram = histogram_median.Histogram();
+	int hist_count = histogram_median.Count();
+
 	double length = max_val - min_val;
 	if(length < 0)
 		length = -length;
@@ -972,34 +950,57 @@ void FaceAnalyser::ExtractMedian(cv::Mat_<unsigned int>& histogram, int hist_cou
 // Apply the current predictors to the currently stored descriptors
 vector<pair<string, double>> FaceAnalyser::PredictCurrentAUs(int view)
 {
+	vector<pair<string, double>> predictions_reg;
+	vector<pair<string, double>> predictions_class;
+	PredictCurrentAUsAll(view, predictions_reg, predictions_class);
 
-	vector<pair<string, double>> predictions;
+	return predictions_reg;
+}
 
-	if(!hog_desc_frame.empty())
+void FaceAnalyser::PredictCurrentAUsAll(int view, vector<pair<string, double>>& predictions_reg, vector<pair<string, double>>& predictions_class)
+{
+
+	if(hog_desc_frame.empty())
 	{
-		vector<string> svr_lin_stat_aus;
-		vector<double> svr_lin_stat_preds;
+		predictions_reg.clear();
+		predictions_class.clear();
+		return;
+	}
+
+	// The regressors and the classifiers in one pass over the descriptors
+	AU_lin_packed.Predict(AU_predictions_packed, hog_desc_frame, geom_descriptor_frame, this->hog_desc_median, this->geom_descriptor_median);
 
-		AU_SVR_static_appearance_lin_regressors.Predict(svr_lin_stat_preds, svr_lin_stat_aus, hog_desc_frame, geom_descriptor_frame);
+	const int num_reg = AU_lin_packed.NumReg();
+	const int num_class = AU_lin_packed.NumClass();
 
-		for(size_t i = 0; i < svr_lin_stat_preds.size(); ++i)
+	// Only set the names when the vectors do not hold the AUs yet
+	if((int)predictions_reg.size() != num_reg)
+	{
+		vector<string> names = GetAURegNames();
+		predictions_reg.clear();
+		for(int i = 0; i < num_reg; ++i)
 		{
-			predictions.push_back(pair<string, double>(svr_lin_stat_aus[i], svr_lin_stat_preds[i]));
+			predictions_reg.push_back(pair<string, double>(names[i], 0.0));
 		}
-
-		vector<string> svr_lin_dyn_aus;
-		vector<double> svr_lin_dyn_preds;
-
-		AU_SVR_dynamic_appearance_lin_regressors.Predict(svr_lin_dyn_preds, svr_lin_dyn_aus, hog_desc_frame, geom_descriptor_frame,  this->hog_desc_median, this->geom_descriptor_median);
-
-		for(size_t i = 0; i < svr_lin_dyn_preds.size(); ++i)
+	}
+	if((int)predictions_class.size() != num_class)
+	{
+		vector<string> names = GetAUClassNames();
+		predictions_class.clear();
+		for(int i = 0; i < num_class; ++i)
 		{
-			predictions.push_back(pair<string, double>(svr_lin_dyn_aus[i], svr_lin_dyn_preds[i]));
+			predictions_class.push_back(pair<string, double>(names[i], 0.0));
 		}
-
 	}
 
-	return predictions;
+	for(int i = 0; i < num_reg; ++i)
+	{
+		predictions_reg[i].second = AU_predictions_packed[i];
+	}
+	for(int i = 0; i < num_class; ++i)
+	{
+		predictions_class[i].second = AU_predictions_packed[num_reg + i];
+	}
 }
 
 vector<pair<string, double>> FaceAnalyser::CorrectOnlineAUs(std::vector<std::pair<std::string, double>> predictions_orig, int view, bool dyn_shift, bool dyn_scale, bool update_track, bool clip_values)
@@ -1067,34 +1068,11 @@ vector<pair<string, double>> FaceAnalyser::CorrectOnlineAUs(std::vector<std::pai
 // Apply the current predictors to the currently stored descriptors (classification)
 vector<pair<string, double>> FaceAnalyser::PredictCurrentAUsClass(int view)
 {
+	vector<pair<string, double>> predictions_reg;
+	vector<pair<string, double>> predictions_class;
+	PredictCurrentAUsAll(view, predictions_reg, predictions_class);
 
-	vector<pair<string, double>> predictions;
-
-	if(!hog_desc_frame.empty())
-	{
-		vector<string> svm_lin_stat_aus;
-		vector<double> svm_lin_stat_preds;
-		
-		AU_SVM_static_appearance_lin.Predict(svm_lin_stat_preds, svm_lin_stat_aus, hog_desc_frame, geom_descriptor_frame);
-
-		for(size_t i = 0; i < svm_lin_stat_aus.size(); ++i)
-		{
-			predictions.push_back(pair<string, double>(svm_lin_stat_aus[i], svm_lin_stat_preds[i]));
-		}
-
-		vector<string> svm_lin_dyn_aus;
-		vector<double> svm_lin_dyn_preds;
-
-		AU_SVM_dynamic_appearance_lin.Predict(svm_lin_dyn_preds, svm_lin_dyn_aus, hog_desc_frame, geom_descriptor_frame, this->hog_desc_median, this->geom_descriptor_median);
-
-		for(size_t i = 0; i < svm_lin_dyn_aus.size(); ++i)
-		{
-			predictions.push_back(pair<string, double>(svm_lin_dyn_aus[i], svm_lin_dyn_preds[i]));
-		}
-		
-	}
-
-	return predictions;
+	return predictions_class;
 }
 
 
@@ -1178,6 +1156,12 @@ void FaceAnalyser::ReadAU(std::string au_model_location)
 				
 		ReadRegressor(location, au_names);
 	}
+
+	// Pack the predictors for predicting all of them at once
+	AU_lin_packed.Pack(AU_SVR_static_appearance_lin_regressors, AU_SVR_dynamic_appearance_lin_regressors, AU_SVM_static_appearance_lin, AU_SVM_dynamic_appearance_lin);
+
+	// With a history column for each of them
+	AU_history.Initialise(AU_lin_packed.NumReg() + AU_lin_packed.NumClass());
   
 }
 
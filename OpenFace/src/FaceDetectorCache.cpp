@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../stdafx.h"
+
+#include <FaceDetectorCache.h>
+
+// TBB includes
+#include <tbb/tbb.h>
+
+// System includes
+#include <map>
+#include <iostream>
+
+using namespace LandmarkDetector;
+
+namespace
+{
+	// Guards the creation of the pools and of the master HOG detector
+	tbb::mutex cache_mutex;
+
+	// Idle Haar classifiers, one pool per cascade location
+	map<string, tbb::concurrent_queue<cv::CascadeClassifier*>* > haar_pools;
+
+	// Idle HOG detectors
+	tbb::concurrent_queue<dlib::frontal_face_detector*> hog_pool;
+
+	// The HOG detector is only deserialised once, the rest of the instances are copies
+	dlib::frontal_face_detector* hog_master = 0;
+
+	// The filter banks of every distinct HOG detector seen so far
+	vector<HOGFilterBanks*> hog_filter_banks;
+
+	tbb::concurrent_queue<cv::CascadeClassifier*>& GetHaarPool(const string& location)
+	{
+		tbb::mutex::scoped_lock lock(cache_mutex);
+
+		map<string, tbb::concurrent_queue<cv::CascadeClassifier*>* >::iterator it = haar_pools.find(location);
+		if(it == haar_pools.end())
+		{
+			it = haar_pools.insert(make_pair(location, new tbb::concurrent_queue<cv::CascadeClassifier*>())).first;
+		}
+		return *it->second;
+	}
+
+	const dlib::frontal_face_detector& GetHOGMaster()
+	{
+		tbb::mutex::scoped_lock lock(cache_mutex);
+
+		if(hog_master == 0)
+		{
+			hog_master = new dlib::frontal_face_detector(dlib::get_frontal_face_detector());
+		}
+		return *hog_master;
+	}
+}
+
+CachedHaarDetector::CachedHaarDetector(const string& location) : location(location), detector(0)
+{
+	if(!GetHaarPool(location).try_pop(detector))
+	{
+		// The cascade classifier does not have a proper copy constructor so clones are read from disk
+		detector = new cv::CascadeClassifier();
+		if(!detector->load(location))
+		{
+			cout << "Couldn't load the Haar cascade classifier from " << location << endl;
+		}
+	}
+}
+
+CachedHaarDetector::~CachedHaarDetector()
+{
+	// Failed loads are not cached, so that a later attempt can pick up a fixed location
+	if(detector->empty())
+	{
+		delete detector;
+	}
+	else
+	{
+		GetHaarPool(location).push(detector);
+	}
+}
+
+CachedHOGDetector::CachedHOGDetector() : detector(0)
+{
+	if(!hog_pool.try_pop(detector))
+	{
+		detector = new dlib::frontal_face_detector(GetHOGMaster());
+	}
+}
+
+CachedHOGDetector::~CachedHOGDetector()
+{
+	hog_pool.push(detector);
+}
+
+dlib::frontal_face_detector LandmarkDetector::CopyCachedHOGDetector()
+{
+	return GetHOGMaster();
+}
+
+const HOGFilterBanks& LandmarkDetector::GetHOGFilterBanks(const dlib::frontal_face_detector& detector)
+{
+	tbb::mutex::scoped_lock lock(cache_mutex);
+
+	const unsigned long num_filters = detector.num_detectors();
+
+	for(size_t b = 0; b < hog_filter_banks.size(); ++b)
+	{
+		const HOGFilterBanks& banks = *hog_filter_banks[b];
+		bool same = banks.weights.size() == num_filters;
+		for(unsigned long i = 0; same && i < num_filters; ++i)
+		{
+			same = banks.weights[i].size() == detector.get_w(i).size() && banks.weights[i] == detector.get_w(i);
+		}
+		if(same)
+		{
+			return banks;
+		}
+	}
+
+	const dlib::frontal_face_detector::image_scanner_type& scanner = detector.get_scanner();
+
+	HOGFilterBanks* banks = new HOGFilterBanks();
+	banks->weights.resize(num_filters);
+	banks->filters.resize(num_filters);
+	banks->thresholds.resize(num_filters);
+	for(unsigned long i = 0; i < num_filters; ++i)
+	{
+		banks->weights[i] = detector.get_w(i);
+		banks->filters[i] = scanner.build_fhog_filterbank(detector.get_w(i));
+		banks->thresholds[i] = detector.get_w(i)(scanner.get_num_dimensions());
+	}
+	hog_filter_banks.push_back(banks);
+
+	return *banks;
+}
@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../stdafx.h"
+
+#include <FaceTemplateTracker.h>
+
+// OpenCV includes
+#include <opencv2/imgproc.hpp>
+
+// Local includes
+#include <LandmarkDetectorUtils.h>
+
+using namespace LandmarkDetector;
+
+FaceTemplateTracker::FaceTemplateTracker()
+{
+	Reset();
+}
+
+void FaceTemplateTracker::Reset()
+{
+	face_template = cv::Mat_<float>();
+	template_dfts.clear();
+	response = cv::Mat_<float>();
+
+	last_track_time = 0;
+	last_update_time = 0;
+	last_drift = 0;
+}
+
+void FaceTemplateTracker::ResampleRegion(cv::Mat_<uchar>& o_region, const cv::Mat_<uchar>& grayscale_image, const cv::Point2d& centre, double scaling, const cv::Size& size) const
+{
+	// Maps the image so that centre ends up in the middle of the output, scaling and cropping in one pass (replicating the border when
+	// the region goes outside of the image, so the output size and hence the DFT size stays constant)
+	cv::Matx23d warp(scaling, 0, size.width / 2.0 - scaling * centre.x,
+					 0, scaling, size.height / 2.0 - scaling * centre.y);
+
+	cv::warpAffine(grayscale_image, o_region, warp, size, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+}
+
+bool FaceTemplateTracker::Track(cv::Point2d& o_shift, const cv::Mat_<uchar>& grayscale_image, const cv::Rect& face_box, double model_scale, double template_scale)
+{
+	int64 start = cv::getTickCount();
+
+	o_shift = cv::Point2d(0, 0);
+
+	if(face_template.empty() || model_scale <= 0)
+	{
+		return false;
+	}
+
+	double scaling = template_scale / model_scale;
+	cv::Point2d centre(face_box.x + face_box.width / 2.0, face_box.y + face_box.height / 2.0);
+
+	// The search window is twice the size of the template
+	cv::Size window_size(face_template.cols * 2, face_template.rows * 2);
+
+	ResampleRegion(window_buffer, grayscale_image, centre, scaling, window_size);
+	window_buffer.convertTo(window_float, CV_32F);
+
+	// The window DFT and the integral images change every frame, the template DFT is cached
+	cv::Mat_<double> window_dft;
+	cv::Mat integral_img, integral_img_sq;
+	LandmarkDetector::matchTemplate_m(window_float, window_dft, integral_img, integral_img_sq, face_template, template_dfts, response, CV_TM_CCOEFF_NORMED);
+
+	cv::Point max_loc;
+	cv::minMaxLoc(response, NULL, NULL, NULL, &max_loc);
+
+	// Without motion the template would be found in the middle of the window
+	o_shift.x = (max_loc.x - face_template.cols / 2.0) / scaling;
+	o_shift.y = (max_loc.y - face_template.rows / 2.0) / scaling;
+
+	last_track_time = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+	return true;
+}
+
+void FaceTemplateTracker::Update(const cv::Mat_<uchar>& grayscale_image, const cv::Rect& face_box, double model_scale, double template_scale, double drift_threshold)
+{
+	int64 start = cv::getTickCount();
+
+	if(model_scale <= 0 || face_box.width <= 0 || face_box.height <= 0)
+	{
+		return;
+	}
+
+	double scaling = template_scale / model_scale;
+	cv::Point2d centre(face_box.x + face_box.width / 2.0, face_box.y + face_box.height / 2.0);
+
+	cv::Mat_<uchar> face;
+
+	if(face_template.empty())
+	{
+		cv::Size size(max(1, cvRound(face_box.width * scaling)), max(1, cvRound(face_box.height * scaling)));
+		ResampleRegion(face, grayscale_image, centre, scaling, size);
+		last_drift = 0;
+	}
+	else
+	{
+		// Compare the current appearance of the face with the template at the same canonical scale
+		ResampleRegion(face, grayscale_image, centre, scaling, face_template.size());
+
+		cv::Mat_<float> face_float;
+		face.convertTo(face_float, CV_32F);
+
+		cv::Mat_<float> similarity;
+		cv::matchTemplate(face_float, face_template, similarity, CV_TM_CCOEFF_NORMED);
+
+		last_drift = 1.0 - similarity(0, 0);
+
+		if(last_drift <= drift_threshold)
+		{
+			last_update_time = (cv::getTickCount() - start) / cv::getTickFrequency();
+			return;
+		}
+	}
+
+	// Replace the template, the cached spectrum (and the response size) is no longer valid
+	face.convertTo(face_template, CV_32F);
+	template_dfts.clear();
+	response = cv::Mat_<float>();
+
+	last_update_time = (cv::getTickCount() - start) / cv::getTickFrequency();
+}
@@ -57,6 +57,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <Face_utils.h>
+#include <FaceAligner.h>
 
 // OpenCV includes
 #include <opencv2/core/core.hpp>
@@ -65,6 +66,8 @@
 // For FHOG visualisation
 #include <dlib/opencv.h>
 
+#include <algorithm>
+
 using namespace std;
 
 namespace FaceAnalysis
@@ -177,118 +180,295 @@ namespace FaceAnalysis
 	// Aligning a face to a common reference frame
 	void AlignFaceMask(cv::Mat& aligned_face, const cv::Mat& frame, const LandmarkDetector::CLNF& clnf_model, const cv::Mat_<int>& triangulation, bool rigid, double sim_scale, int out_width, int out_height)
 	{
-		// Will warp to scaled mean shape
-		cv::Mat_<double> similarity_normalised_shape = clnf_model.pdm.mean_shape * sim_scale;
-	
-		// Discard the z component
-		similarity_normalised_shape = similarity_normalised_shape(cv::Rect(0, 0, 1, 2*similarity_normalised_shape.rows/3)).clone();
+		// A one off alignment, use a FaceAligner to keep the buffers and the mask across frames
+		FaceAligner aligner;
+		aligner.AlignFaceMask(aligned_face, frame, clnf_model, triangulation, rigid, sim_scale, out_width, out_height);
+	}
 
-		cv::Mat_<double> source_landmarks = clnf_model.detected_landmarks.reshape(1, 2).t();
-		cv::Mat_<double> destination_landmarks = similarity_normalised_shape.reshape(1, 2).t();
 
-		// Aligning only the more rigid points
-		if(rigid)
+	void Visualise_FHOG(const cv::Mat_<double>& descriptor, int num_rows, int num_cols, cv::Mat& visualisation)
+	{
+
+		// First convert to dlib format
+		dlib::array2d<dlib::matrix<float,31,1> > hog(num_rows, num_cols);
+		
+		cv::MatConstIterator_<double> descriptor_it = descriptor.begin();
+		for(int y = 0; y < num_cols; ++y)
 		{
-			extract_rigid_points(source_landmarks, destination_landmarks);
+			for(int x = 0; x < num_rows; ++x)
+			{
+				for(unsigned int o = 0; o < 31; ++o)
+				{
+					hog[y][x](o) = *descriptor_it++;
+				}
+			}
 		}
 
-		cv::Matx22d scale_rot_matrix = LandmarkDetector::AlignShapesWithScale(source_landmarks, destination_landmarks);
-		cv::Matx23d warp_matrix;
-
-		warp_matrix(0,0) = scale_rot_matrix(0,0);
-		warp_matrix(0,1) = scale_rot_matrix(0,1);
-		warp_matrix(1,0) = scale_rot_matrix(1,0);
-		warp_matrix(1,1) = scale_rot_matrix(1,1);
+		// Draw the FHOG to OpenCV format
+		auto fhog_vis = dlib::draw_fhog(hog);
+		visualisation = dlib::toMat(fhog_vis).clone();
+	}
 
-		double tx = clnf_model.params_global[4];
-		double ty = clnf_model.params_global[5];
+#if OPENFACE_SIMD128
+	// The unit vectors of the 9 contrast insensitive orientations (their opposites are the other 9 contrast sensitive ones), as in dlib
+	static const float fhog_direction_x[9] = {1.0000f, 0.9397f, 0.7660f, 0.500f, 0.1736f, -0.1736f, -0.5000f, -0.7660f, -0.9397f};
+	static const float fhog_direction_y[9] = {0.0000f, 0.3420f, 0.6428f, 0.8660f, 0.9848f, 0.9848f, 0.8660f, 0.6428f, 0.3420f};
 
-		cv::Vec2d T(tx, ty);
-		T = scale_rot_matrix * T;
+	// Create a row vector Felzenszwalb HOG descriptor from a given image, the same features as dlib::extract_fhog_features (31 per
+	// cell, row by row) computed in single precision. The gradients, orientations and normalisation are computed four at a time,
+	// only the votes into the cell histograms are scalar.
+	void Extract_FHOG_descriptor_native(cv::Mat_<float>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size)
+	{
 
-		// Make sure centering is correct
-		warp_matrix(0,2) = -T(0) + out_width/2;
-		warp_matrix(1,2) = -T(1) + out_height/2;
+		const int cells_nr = (int)((double)image.rows/(double)cell_size + 0.5);
+		const int cells_nc = (int)((double)image.cols/(double)cell_size + 0.5);
 
-		cv::warpAffine(frame, aligned_face, warp_matrix, cv::Size(out_width, out_height), cv::INTER_LINEAR);
+		// The cells on the border are only used for normalisation
+		num_rows = std::max(cells_nr - 2, 0);
+		num_cols = std::max(cells_nc - 2, 0);
 
-		// Move the destination landmarks there as well
-		cv::Matx22d warp_matrix_2d(warp_matrix(0,0), warp_matrix(0,1), warp_matrix(1,0), warp_matrix(1,1));
-		
-		destination_landmarks = cv::Mat(clnf_model.detected_landmarks.reshape(1, 2).t()) * cv::Mat(warp_matrix_2d).t();
+		if(num_rows == 0 || num_cols == 0)
+		{
+			num_rows = 0;
+			num_cols = 0;
+			descriptor = cv::Mat_<float>(1, 0);
+			return;
+		}
 
-		destination_landmarks.col(0) = destination_landmarks.col(0) + warp_matrix(0,2);
-		destination_landmarks.col(1) = destination_landmarks.col(1) + warp_matrix(1,2);
-		
-		// Move the eyebrows up to include more of upper face
-		destination_landmarks.at<double>(0,1) -= 30; 
-		destination_landmarks.at<double>(16,1) -= 30;
-
-		destination_landmarks.at<double>(17,1) -= 30;
-		destination_landmarks.at<double>(18,1) -= 30;
-		destination_landmarks.at<double>(19,1) -= 30;
-		destination_landmarks.at<double>(20,1) -= 30;
-		destination_landmarks.at<double>(21,1) -= 30;
-		destination_landmarks.at<double>(22,1) -= 30;
-		destination_landmarks.at<double>(23,1) -= 30;
-		destination_landmarks.at<double>(24,1) -= 30;
-		destination_landmarks.at<double>(25,1) -= 30;
-		destination_landmarks.at<double>(26,1) -= 30;
-
-		destination_landmarks = cv::Mat(destination_landmarks.t()).reshape(1, 1).t();
-
-		LandmarkDetector::PAW paw(destination_landmarks, triangulation, 0, 0, aligned_face.cols-1, aligned_face.rows-1);
-		
-		// Mask each of the channels (a bit of a roundabout way, but OpenCV 3.1 in debug mode doesn't seem to be able to handle a more direct way using split and merge)
-		vector<cv::Mat> aligned_face_channels(aligned_face.channels());
-		
-		for (int c = 0; c < aligned_face.channels(); ++c)
+		// The intensity planes, for colour images the channel with the largest gradient is used (red, green and then blue on ties)
+		vector<cv::Mat> planes;
+		if(image.channels() == 1)
+		{
+			planes.resize(1);
+			image.convertTo(planes[0], CV_32F);
+		}
+		else
 		{
-			cv::extractChannel(aligned_face, aligned_face_channels[c], c);
+			cv::Mat image_float;
+			image.convertTo(image_float, CV_32F);
+			cv::split(image_float, planes);
+			std::swap(planes[0], planes[2]);
 		}
+		const int num_planes = (int)planes.size();
 
-		for(size_t i = 0; i < aligned_face_channels.size(); ++i)
+		// The orientation histograms of the cells, with a cell of padding all the way around so that the votes need no boundary checks
+		const int hist_nc = cells_nc + 2;
+		cv::AutoBuffer<float> hist_buffer((cells_nr + 2) * hist_nc * 18);
+		float* hist = hist_buffer;
+		std::fill(hist, hist + (cells_nr + 2) * hist_nc * 18, 0.0f);
+
+		const int visible_nr = std::min(cells_nr * cell_size, image.rows) - 1;
+		const int visible_nc = std::min(cells_nc * cell_size, image.cols) - 1;
+
+		// The (padded) cells each column votes into and the bilinear weights of the votes, the same for every row
+		cv::AutoBuffer<int> column_cell(visible_nc + 1);
+		cv::AutoBuffer<float> column_weight(visible_nc + 1);
+		for(int x = 1; x < visible_nc; ++x)
 		{
-			cv::multiply(aligned_face_channels[i], paw.pixel_mask, aligned_face_channels[i], 1.0, CV_8U);
+			const float xp = ((float)x + 0.5f)/(float)cell_size + 0.5f;
+			column_cell[x] = (int)xp;
+			column_weight[x] = xp - column_cell[x];
 		}
 
-		if(aligned_face.channels() == 3)
+		// The gradient magnitude and the orientation bin of each column of a row
+		cv::AutoBuffer<float> magnitude(visible_nc + 1);
+		cv::AutoBuffer<float> orientation(visible_nc + 1);
+
+		const cv::v_float32x4 v_zero = cv::v_setzero_f32();
+
+		for(int y = 1; y < visible_nr; ++y)
 		{
-			cv::Mat planes[] = { aligned_face_channels[0], aligned_face_channels[1], aligned_face_channels[2] };
-			cv::merge(planes, 3, aligned_face);
+			int x = 1;
+			for(; x + 4 <= visible_nc; x += 4)
+			{
+				cv::v_float32x4 grad_x, grad_y, length;
+				for(int p = 0; p < num_planes; ++p)
+				{
+					const float* row = planes[p].ptr<float>(y);
+					const float* row_above = planes[p].ptr<float>(y - 1);
+					const float* row_below = planes[p].ptr<float>(y + 1);
+
+					cv::v_float32x4 plane_grad_x = cv::v_load(row + x + 1) - cv::v_load(row + x - 1);
+					cv::v_float32x4 plane_grad_y = cv::v_load(row_below + x) - cv::v_load(row_above + x);
+					cv::v_float32x4 plane_length = plane_grad_x * plane_grad_x + plane_grad_y * plane_grad_y;
+
+					if(p == 0)
+					{
+						grad_x = plane_grad_x;
+						grad_y = plane_grad_y;
+						length = plane_length;
+					}
+					else
+					{
+						cv::v_float32x4 larger = plane_length > length;
+						grad_x = cv::v_select(larger, plane_grad_x, grad_x);
+						grad_y = cv::v_select(larger, plane_grad_y, grad_y);
+						length = cv::v_select(larger, plane_length, length);
+					}
+				}
+
+				// Snap the gradient to one of the 18 contrast sensitive orientations
+				cv::v_float32x4 best_dot = v_zero;
+				cv::v_float32x4 best_o = v_zero;
+				for(int o = 0; o < 9; ++o)
+				{
+					cv::v_float32x4 dot = grad_x * cv::v_setall_f32(fhog_direction_x[o]) + grad_y * cv::v_setall_f32(fhog_direction_y[o]);
+					cv::v_float32x4 better = dot > best_dot;
+					best_dot = cv::v_select(better, dot, best_dot);
+					best_o = cv::v_select(better, cv::v_setall_f32((float)o), best_o);
+
+					dot = v_zero - dot;
+					better = dot > best_dot;
+					best_dot = cv::v_select(better, dot, best_dot);
+					best_o = cv::v_select(better, cv::v_setall_f32((float)(o + 9)), best_o);
+				}
+
+				cv::v_store(magnitude + x, cv::v_sqrt(length));
+				cv::v_store(orientation + x, best_o);
+			}
+
+			// The columns that do not fill a register
+			for(; x < visible_nc; ++x)
+			{
+				float grad_x = 0, grad_y = 0, length = 0;
+				for(int p = 0; p < num_planes; ++p)
+				{
+					const float plane_grad_x = planes[p].at<float>(y, x + 1) - planes[p].at<float>(y, x - 1);
+					const float plane_grad_y = planes[p].at<float>(y + 1, x) - planes[p].at<float>(y - 1, x);
+					const float plane_length = plane_grad_x * plane_grad_x + plane_grad_y * plane_grad_y;
+					if(p == 0 || plane_length > length)
+					{
+						grad_x = plane_grad_x;
+						grad_y = plane_grad_y;
+						length = plane_length;
+					}
+				}
+
+				float best_dot = 0;
+				int best_o = 0;
+				for(int o = 0; o < 9; ++o)
+				{
+					const float dot = grad_x * fhog_direction_x[o] + grad_y * fhog_direction_y[o];
+					if(dot > best_dot)
+					{
+						best_dot = dot;
+						best_o = o;
+					}
+					else if(-dot > best_dot)
+					{
+						best_dot = -dot;
+						best_o = o + 9;
+					}
+				}
+
+				magnitude[x] = std::sqrt(length);
+				orientation[x] = (float)best_o;
+			}
+
+			// Add to the 4 histograms around the pixel using bilinear interpolation
+			const double yp = ((double)y + 0.5)/(double)cell_size + 0.5;
+			const int iyp = (int)yp;
+			const float vy0 = (float)(yp - iyp);
+			const float vy1 = 1.0f - vy0;
+
+			float* hist_row = hist + iyp * hist_nc * 18;
+			float* hist_row_below = hist_row + hist_nc * 18;
+			for(x = 1; x < visible_nc; ++x)
+			{
+				const int bin = column_cell[x] * 18 + (int)orientation[x];
+				const float vx0 = column_weight[x];
+				const float vx1 = 1.0f - vx0;
+				const float v = magnitude[x];
+
+				hist_row[bin] += vy1*vx1*v;
+				hist_row_below[bin] += vy0*vx1*v;
+				hist_row[bin + 18] += vy1*vx0*v;
+				hist_row_below[bin + 18] += vy0*vx0*v;
+			}
 		}
-		else
+
+		// The energy of each cell, summed over the contrast insensitive orientations
+		cv::AutoBuffer<float> norm_buffer(cells_nr * cells_nc);
+		float* norm = norm_buffer;
+		for(int r = 0; r < cells_nr; ++r)
 		{
-			aligned_face = aligned_face_channels[0];
+			for(int c = 0; c < cells_nc; ++c)
+			{
+				const float* cell_hist = hist + ((r + 1) * hist_nc + c + 1) * 18;
+				float energy = 0;
+				for(int o = 0; o < 9; ++o)
+				{
+					const float insensitive = cell_hist[o] + cell_hist[o + 9];
+					energy += insensitive * insensitive;
+				}
+				norm[r * cells_nc + c] = energy;
+			}
 		}
-	}
 
+		descriptor.create(1, num_rows * num_cols * 31);
+		float* descriptor_ptr = descriptor.ptr<float>(0);
 
-	void Visualise_FHOG(const cv::Mat_<double>& descriptor, int num_rows, int num_cols, cv::Mat& visualisation)
-	{
+		const cv::v_float32x4 v_eps = cv::v_setall_f32(0.0001f);
+		const cv::v_float32x4 v_truncation = cv::v_setall_f32(0.2f);
+		const cv::v_float32x4 v_scaling = cv::v_setall_f32(0.1f);
+		const cv::v_float32x4 v_texture_scaling = cv::v_setall_f32((float)(2*0.2357));
 
-		// First convert to dlib format
-		dlib::array2d<dlib::matrix<float,31,1> > hog(num_rows, num_cols);
-		
-		cv::MatConstIterator_<double> descriptor_it = descriptor.begin();
-		for(int y = 0; y < num_cols; ++y)
+		for(int y = 0; y < num_rows; ++y)
 		{
-			for(int x = 0; x < num_rows; ++x)
+			const float* norm_0 = norm + y * cells_nc;
+			const float* norm_1 = norm_0 + cells_nc;
+			const float* norm_2 = norm_1 + cells_nc;
+
+			for(int x = 0; x < num_cols; ++x)
 			{
-				for(unsigned int o = 0; o < 31; ++o)
+				// The energies of the four 2x2 blocks of cells around the cell, a lane each
+				const cv::v_float32x4 z1(norm_1[x+1], norm_0[x+1], norm_1[x], norm_0[x]);
+				const cv::v_float32x4 z2(norm_1[x+2], norm_0[x+2], norm_1[x+1], norm_0[x+1]);
+				const cv::v_float32x4 z3(norm_2[x+1], norm_1[x+1], norm_2[x], norm_1[x]);
+				const cv::v_float32x4 z4(norm_2[x+2], norm_1[x+2], norm_2[x+1], norm_1[x+1]);
+				const cv::v_float32x4 nn = v_truncation * cv::v_sqrt(z1 + z2 + z3 + z4 + v_eps);
+				const cv::v_float32x4 n = v_scaling / nn;
+
+				const float* cell_hist = hist + ((y + 2) * hist_nc + x + 2) * 18;
+
+				// Contrast sensitive features
+				cv::v_float32x4 texture = v_zero;
+				for(int o = 0; o < 18; ++o)
 				{
-					hog[y][x](o) = *descriptor_it++;
+					const cv::v_float32x4 h = cv::v_min(cv::v_setall_f32(cell_hist[o]), nn) * n;
+					descriptor_ptr[o] = cv::v_reduce_sum(h);
+					texture = texture + h;
+				}
+
+				// Contrast insensitive features
+				for(int o = 0; o < 9; ++o)
+				{
+					const cv::v_float32x4 h = cv::v_min(cv::v_setall_f32(cell_hist[o] + cell_hist[o + 9]), nn) * n;
+					descriptor_ptr[18 + o] = cv::v_reduce_sum(h);
 				}
+
+				// Texture features
+				cv::v_store(descriptor_ptr + 27, texture * v_texture_scaling);
+
+				descriptor_ptr += 31;
 			}
 		}
-
-		// Draw the FHOG to OpenCV format
-		auto fhog_vis = dlib::draw_fhog(hog);
-		visualisation = dlib::toMat(fhog_vis).clone();
 	}
 
-	// Create a row vector Felzenszwalb HOG descriptor from a given image
+#endif
+
 	void Extract_FHOG_descriptor(cv::Mat_<double>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size)
+	{
+#if OPENFACE_NATIVE_FHOG && OPENFACE_SIMD128
+		cv::Mat_<float> descriptor_float;
+		Extract_FHOG_descriptor_native(descriptor_float, image, num_rows, num_cols, cell_size);
+		descriptor_float.convertTo(descriptor, CV_64F);
+#else
+		Extract_FHOG_descriptor_dlib(descriptor, image, num_rows, num_cols, cell_size);
+#endif
+	}
+
+	void Extract_FHOG_descriptor_dlib(cv::Mat_<double>& descriptor, const cv::Mat& image, int& num_rows, int& num_cols, int cell_size)
 	{
 		
 		dlib::array2d<dlib::matrix<float,31,1> > hog;
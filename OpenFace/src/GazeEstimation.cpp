@@ -158,6 +158,113 @@ void FaceAnalysis::EstimateGaze(const LandmarkDetector::CLNF& clnf_model, cv::Po
 }
 
 
+GazeParts FaceAnalysis::FindGazeParts(const LandmarkDetector::CLNF& clnf_model)
+{
+	GazeParts parts;
+	parts.left_eye = -1;
+	parts.right_eye = -1;
+
+	for (size_t i = 0; i < clnf_model.hierarchical_models.size(); ++i)
+	{
+		if (clnf_model.hierarchical_model_names[i].compare("left_eye_28") == 0)
+		{
+			parts.left_eye = i;
+		}
+		if (clnf_model.hierarchical_model_names[i].compare("right_eye_28") == 0)
+		{
+			parts.right_eye = i;
+		}
+	}
+
+	return parts;
+}
+
+namespace
+{
+	// One landmark of a model in camera space, as CLNF::GetShape computes it for all of them
+	cv::Point3d LandmarkInCamera(const LandmarkDetector::CLNF& model, const cv::Matx33d& rotation, int i, double fx, double fy, double cx, double cy)
+	{
+		const LandmarkDetector::PDM& pdm = model.pdm;
+		int n = pdm.NumberOfPoints();
+		int m = pdm.NumberOfModes();
+
+		// The point of the 3D shape (mean shape plus the principal components weighted by the local parameters)
+		cv::Vec3d point(pdm.mean_shape.at<double>(i), pdm.mean_shape.at<double>(i + n), pdm.mean_shape.at<double>(i + 2 * n));
+		for (int c = 0; c < 3; ++c)
+		{
+			const double* components = pdm.princ_comp.ptr<double>(i + c * n);
+			for (int j = 0; j < m; ++j)
+			{
+				point[c] += components[j] * model.params_local.at<double>(j);
+			}
+		}
+
+		// Only the depth of the rotated point is needed, x and y come from the detected landmark
+		double Z = fx / model.params_global[0] + rotation(2, 0) * point[0] + rotation(2, 1) * point[1] + rotation(2, 2) * point[2];
+
+		double X = Z * ((model.detected_landmarks.at<double>(i) - cx) / fx);
+		double Y = Z * ((model.detected_landmarks.at<double>(i + n) - cy) / fy);
+
+		return cv::Point3d(X, Y, Z);
+	}
+
+	// The mean of the iris landmarks of an eye model in camera space, as GetPupilPosition
+	cv::Point3f PupilInCamera(const LandmarkDetector::CLNF& eye_model, double fx, double fy, double cx, double cy)
+	{
+		cv::Matx33d rotation = LandmarkDetector::Euler2RotationMatrix(cv::Vec3d(eye_model.params_global[1], eye_model.params_global[2], eye_model.params_global[3]));
+
+		cv::Point3d pupil(0, 0, 0);
+		for (int i = 0; i < 8; ++i)
+		{
+			pupil += LandmarkInCamera(eye_model, rotation, i, fx, fy, cx, cy);
+		}
+
+		return cv::Point3f(pupil * (1.0 / 8.0));
+	}
+
+	cv::Point2d ProjectPoint(const cv::Point3f& point, double fx, double fy, double cx, double cy)
+	{
+		// As LandmarkDetector::Project
+		if (point.z != 0)
+		{
+			return cv::Point2d(point.x * fx / point.z + cx, point.y * fy / point.z + cy);
+		}
+		return cv::Point2d(point.x, point.y);
+	}
+}
+
+void FaceAnalysis::EstimateBinocularGaze(const LandmarkDetector::CLNF& clnf_model, const GazeParts& parts, float fx, float fy, float cx, float cy,
+	bool estimate_direction, BinocularGaze& o_gaze)
+{
+	o_gaze.pupil_left = PupilInCamera(clnf_model.hierarchical_models[parts.left_eye], fx, fy, cx, cy);
+	o_gaze.pupil_right = PupilInCamera(clnf_model.hierarchical_models[parts.right_eye], fx, fy, cx, cy);
+
+	o_gaze.gaze_left = cv::Point3f(0, 0, -1);
+	o_gaze.gaze_right = cv::Point3f(0, 0, -1);
+
+	if (estimate_direction)
+	{
+		// The head rotation of the camera pose (see GetPoseCamera)
+		cv::Matx33d rotation = LandmarkDetector::Euler2RotationMatrix(cv::Vec3d(clnf_model.params_global[1], clnf_model.params_global[2], clnf_model.params_global[3]));
+		cv::Vec3d offset = rotation * cv::Vec3d(0, -3.50, 0);
+
+		// The eyeball centres are behind the middle of the eye corners
+		cv::Point3d left_centre = (LandmarkInCamera(clnf_model, rotation, 36, fx, fy, cx, cy) + LandmarkInCamera(clnf_model, rotation, 39, fx, fy, cx, cy)) * 0.5 + cv::Point3d(offset);
+		cv::Point3d right_centre = (LandmarkInCamera(clnf_model, rotation, 42, fx, fy, cx, cy) + LandmarkInCamera(clnf_model, rotation, 45, fx, fy, cx, cy)) * 0.5 + cv::Point3d(offset);
+
+		cv::Point3f left_axis = RaySphereIntersect(cv::Point3f(0, 0, 0), o_gaze.pupil_left / norm(o_gaze.pupil_left), cv::Point3f(left_centre), 12) - cv::Point3f(left_centre);
+		cv::Point3f right_axis = RaySphereIntersect(cv::Point3f(0, 0, 0), o_gaze.pupil_right / norm(o_gaze.pupil_right), cv::Point3f(right_centre), 12) - cv::Point3f(right_centre);
+
+		o_gaze.gaze_left = left_axis / norm(left_axis);
+		o_gaze.gaze_right = right_axis / norm(right_axis);
+	}
+
+	o_gaze.pupil_left_image = ProjectPoint(o_gaze.pupil_left, fx, fy, cx, cy);
+	o_gaze.pupil_right_image = ProjectPoint(o_gaze.pupil_right, fx, fy, cx, cy);
+	o_gaze.gaze_left_end_image = ProjectPoint(o_gaze.pupil_left + o_gaze.gaze_left * 50.0f, fx, fy, cx, cy);
+	o_gaze.gaze_right_end_image = ProjectPoint(o_gaze.pupil_right + o_gaze.gaze_right * 50.0f, fx, fy, cx, cy);
+}
+
 void FaceAnalysis::DrawGaze(cv::Mat img, const LandmarkDetector::CLNF& clnf_model, cv::Point3f gazeVecAxisLeft, cv::Point3f gazeVecAxisRight, float fx, float fy, float cx, float cy)
 {
 
@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "HistogramMedian.h"
+#include "SimdSupport.h"
+
+using namespace FaceAnalysis;
+
+void HistogramMedian::Reset(int dimensions, int num_bins)
+{
+	// The median bins are stored compactly
+	CV_Assert(num_bins <= 65536);
+
+	histogram = cv::Mat_<unsigned int>(dimensions, num_bins, (unsigned int)0);
+	count = 0;
+
+	median_bins.assign(dimensions, 0);
+	below_median.assign(dimensions, 0);
+	sample_bins.resize(dimensions);
+}
+
+void HistogramMedian::Add(const cv::Mat_<double>& descriptor, double min_val, double max_val)
+{
+	double length = max_val - min_val;
+	if(length < 0)
+		length = -length;
+
+	const int num_bins = histogram.cols;
+	const int dimensions = histogram.rows;
+
+	// Find the bins corresponding to the descriptor, this is what (descriptor - min_val)*((double)num_bins)/(length) evaluates to
+	descriptor.convertTo(converted_descriptor, CV_64F, ((double)num_bins) * (1./length), (-min_val * num_bins) * (1./length));
+
+	// Capping the top and bottom values and truncating to the bin index, two dimensions at a time
+	const double* converted_ptr = converted_descriptor.ptr<double>(0);
+	int* bins_ptr = sample_bins.data();
+	const double top = num_bins - 1;
+	int i = 0;
+#if OPENFACE_SIMD128_64F
+	const cv::v_float64x2 v_top = cv::v_setall_f64(top);
+	const cv::v_float64x2 v_zero = cv::v_setzero_f64();
+	for(; i <= dimensions - 2; i += 2)
+	{
+		const cv::v_float64x2 converted = cv::v_max(cv::v_min(cv::v_load(converted_ptr + i), v_top), v_zero);
+		cv::v_store_low(bins_ptr + i, cv::v_trunc(converted));
+	}
+#endif
+	for(; i < dimensions; ++i)
+	{
+		double converted = converted_ptr[i];
+		converted = converted > top ? top : converted;
+		converted = converted < 0 ? 0 : converted;
+		bins_ptr[i] = (int)converted;
+	}
+
+	count++;
+	const unsigned int cutoff_point = (count + 1)/2;
+
+	for(int i = 0; i < dimensions; ++i)
+	{
+		unsigned int* bins = histogram[i];
+		int bin = bins_ptr[i];
+		bins[bin]++;
+
+		int median_bin = median_bins[i];
+		unsigned int below = below_median[i];
+		if(bin < median_bin)
+		{
+			below++;
+		}
+
+		// Move down while the bins before the median already reach the cut-off, and up while the median bin does not
+		while(below >= cutoff_point)
+		{
+			median_bin--;
+			below -= bins[median_bin];
+		}
+		while(below + bins[median_bin] < cutoff_point)
+		{
+			below += bins[median_bin];
+			median_bin++;
+		}
+
+		median_bins[i] = (unsigned short)median_bin;
+		below_median[i] = below;
+	}
+}
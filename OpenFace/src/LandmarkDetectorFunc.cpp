@@ -65,6 +65,9 @@
 #include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc.hpp>
 
+// TBB includes
+#include <tbb/tbb.h>
+
 // System includes
 #include <vector>
 
@@ -227,15 +230,13 @@ cv::Vec6d LandmarkDetector::GetCorrectedPoseCamera(const CLNF& clnf_model, doubl
 	}
 }
 
-// If landmark detection in video succeeded create a template for use in simple tracking
-void UpdateTemplate(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model)
+// If landmark detection in video succeeded create a template for use in simple tracking (or refresh it if the appearance changed)
+void UpdateTemplate(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model, const FaceModelParameters& params)
 {
 	cv::Rect bounding_box;
 	clnf_model.pdm.CalcBoundingBox(bounding_box, clnf_model.params_global, clnf_model.params_local);
-	// Make sure the box is not out of bounds
-	bounding_box = bounding_box & cv::Rect(0, 0, grayscale_image.cols, grayscale_image.rows);
 
-	clnf_model.face_template = grayscale_image(bounding_box).clone();
+	clnf_model.face_template_tracker.Update(grayscale_image, bounding_box, clnf_model.params_global[0], params.face_template_scale, params.face_template_drift);
 }
 
 // This method uses basic template matching in order to allow for better tracking of fast moving faces
@@ -244,46 +245,16 @@ void CorrectGlobalParametersVideo(const cv::Mat_<uchar> &grayscale_image, CLNF&
 	cv::Rect init_box;
 	clnf_model.pdm.CalcBoundingBox(init_box, clnf_model.params_global, clnf_model.params_local);
 
-	cv::Rect roi(init_box.x - init_box.width/2, init_box.y - init_box.height/2, init_box.width * 2, init_box.height * 2);
-	roi = roi & cv::Rect(0, 0, grayscale_image.cols, grayscale_image.rows);
-
-	int off_x = roi.x;
-	int off_y = roi.y;
-
-	double scaling = params.face_template_scale / clnf_model.params_global[0];
-	cv::Mat_<uchar> image;
-	if(scaling < 1)
-	{
-		cv::resize(clnf_model.face_template, clnf_model.face_template, cv::Size(), scaling, scaling);
-		cv::resize(grayscale_image(roi), image, cv::Size(), scaling, scaling);
-	}
-	else
+	cv::Point2d shift;
+	if(clnf_model.face_template_tracker.Track(shift, grayscale_image, init_box, clnf_model.params_global[0], params.face_template_scale))
 	{
-		scaling = 1;
-		image = grayscale_image(roi).clone();
+		clnf_model.params_global[4] = clnf_model.params_global[4] + shift.x;
+		clnf_model.params_global[5] = clnf_model.params_global[5] + shift.y;
 	}
-		
-	// Resizing the template			
-	cv::Mat corr_out;
-	cv::matchTemplate(image, clnf_model.face_template, corr_out, CV_TM_CCOEFF_NORMED);
-
-	// Actually matching it
-	//double min, max;
-	int max_loc[2];
-
-	cv::minMaxIdx(corr_out, NULL, NULL, NULL, max_loc);
-
-	cv::Rect_<double> out_bbox(max_loc[1]/scaling + off_x, max_loc[0]/scaling + off_y, clnf_model.face_template.rows / scaling, clnf_model.face_template.cols / scaling);
-
-	double shift_x = out_bbox.x - (double)init_box.x;
-	double shift_y = out_bbox.y - (double)init_box.y;
-			
-	clnf_model.params_global[4] = clnf_model.params_global[4] + shift_x;
-	clnf_model.params_global[5] = clnf_model.params_global[5] + shift_y;
-	
 }
 
-bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> &depth_image, CLNF& clnf_model, FaceModelParameters& params)
+// The tracking itself, run inside of the arena of the model
+bool DetectLandmarksInVideoArena(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> &depth_image, CLNF& clnf_model, FaceModelParameters& params)
 {
 	// First need to decide if the landmarks should be "detected" or "tracked"
 	// Detected means running face detection and a larger search area, tracked means initialising from previous step
@@ -296,33 +267,60 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_i
 	if(clnf_model.tracking_initialised)
 	{
 
+		bool predicted = params.use_motion_prediction && clnf_model.detection_success && clnf_model.motion_predictor.Initialised();
+
 		// The area of interest search size will depend if the previous track was successful
 		if(!clnf_model.detection_success)
 		{
 			params.window_sizes_current = params.window_sizes_init;
 		}
+		else if(predicted)
+		{
+			// Start from where the face is expected, with windows that cover how far the last fit landed from its prediction
+			clnf_model.motion_predictor.Predict(clnf_model.params_global, clnf_model.params_local, params.predict_shape);
+			clnf_model.motion_predictor.ChooseWindows(params, clnf_model.patch_experts.patch_scaling, clnf_model.params_global[0], params.window_sizes_current);
+		}
 		else
 		{
 			params.window_sizes_current = params.window_sizes_small;
 		}
 
 		// Before the expensive landmark detection step apply a quick template tracking approach
-		if(params.use_face_template && !clnf_model.face_template.empty() && clnf_model.detection_success)
+		if(params.use_face_template && !clnf_model.face_template_tracker.Empty() && clnf_model.detection_success)
 		{
 			CorrectGlobalParametersVideo(grayscale_image, clnf_model, params);
 		}
 
+		// Where the fit starts from, to measure how far off the prediction was
+		cv::Mat_<double> start_shape;
+		if(params.use_motion_prediction)
+		{
+			clnf_model.pdm.CalcShape2D(start_shape, clnf_model.params_local, clnf_model.params_global);
+		}
+
 		bool track_success = clnf_model.DetectLandmarks(grayscale_image, depth_image, params);
 		if(!track_success)
 		{
 			// Make a record that tracking failed
 			clnf_model.failures_in_a_row++;
+
+			// The motion is not known any more
+			clnf_model.motion_predictor.Reset();
 		}
 		else
 		{
 			// indicate that tracking is a success
 			clnf_model.failures_in_a_row = -1;			
-			UpdateTemplate(grayscale_image, clnf_model);
+			if(params.use_face_template)
+			{
+				UpdateTemplate(grayscale_image, clnf_model, params);
+			}
+
+			if(params.use_motion_prediction)
+			{
+				clnf_model.fit_stats.prediction_residual = cv::norm(start_shape, clnf_model.detected_landmarks) / sqrt((double)clnf_model.pdm.NumberOfPoints());
+				clnf_model.motion_predictor.Update(clnf_model.params_global, clnf_model.params_local, clnf_model.fit_stats.prediction_residual);
+			}
 		}
 	}
 
@@ -349,15 +347,52 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_i
 			clnf_model.preference_det = cv::Point(-1, -1);
 		}
 
-		bool face_detection_success;
-		if(params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
+		bool face_detection_success = false;
+
+		// If the face was only just lost, first look for it around its last location on a downsampled window (unless a specific face was requested)
+		bool staged = params.use_staged_redetection && clnf_model.tracking_initialised && clnf_model.params_global[0] > 0 && preference_det.x == -1;
+		if(staged)
 		{
-			double confidence;
-			face_detection_success = LandmarkDetector::DetectSingleFaceHOG(bounding_box, grayscale_image, clnf_model.face_detector_HOG, confidence, preference_det);
+			cv::Rect prev_box;
+			clnf_model.pdm.CalcBoundingBox(prev_box, clnf_model.params_global, clnf_model.params_local);
+
+			int64 roi_start = cv::getTickCount();
+			if(params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
+			{
+				double confidence;
+				face_detection_success = LandmarkDetector::DetectSingleFaceHOGROI(bounding_box, grayscale_image, clnf_model.face_detector_HOG, confidence, prev_box, params.redetection_roi_scale, params.redetection_face_width);
+			}
+			else if(params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
+			{
+				face_detection_success = LandmarkDetector::DetectSingleFaceROI(bounding_box, grayscale_image, clnf_model.face_detector_HAAR, prev_box, params.redetection_roi_scale, params.redetection_face_width);
+			}
+			clnf_model.redetection_stats.roi_time += (cv::getTickCount() - roi_start) / cv::getTickFrequency();
+			clnf_model.redetection_stats.roi_attempts++;
+			if(face_detection_success)
+			{
+				clnf_model.redetection_stats.roi_hits++;
+			}
 		}
-		else if(params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
+
+		// Widen the search to the full frame
+		if(!face_detection_success)
 		{
-			face_detection_success = LandmarkDetector::DetectSingleFace(bounding_box, grayscale_image, clnf_model.face_detector_HAAR, preference_det);
+			int64 full_start = cv::getTickCount();
+			if(params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
+			{
+				double confidence;
+				face_detection_success = LandmarkDetector::DetectSingleFaceHOG(bounding_box, grayscale_image, clnf_model.face_detector_HOG, confidence, preference_det);
+			}
+			else if(params.curr_face_detector == FaceModelParameters::HAAR_DETECTOR)
+			{
+				face_detection_success = LandmarkDetector::DetectSingleFace(bounding_box, grayscale_image, clnf_model.face_detector_HAAR, preference_det);
+			}
+			clnf_model.redetection_stats.full_time += (cv::getTickCount() - full_start) / cv::getTickFrequency();
+			clnf_model.redetection_stats.full_attempts++;
+			if(face_detection_success)
+			{
+				clnf_model.redetection_stats.full_hits++;
+			}
 		}
 
 		// Attempt to detect landmarks using the detected face (if unseccessful the detection will be ignored)
@@ -402,7 +437,14 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_i
 			else
 			{
 				clnf_model.failures_in_a_row = -1;				
-				UpdateTemplate(grayscale_image, clnf_model);
+				if(params.use_face_template)
+				{
+					UpdateTemplate(grayscale_image, clnf_model, params);
+				}
+
+				// The motion starts again from the detection
+				clnf_model.motion_predictor.Reset();
+				clnf_model.motion_predictor.Update(clnf_model.params_global, clnf_model.params_local, 0);
 				return true;
 			}
 		}
@@ -424,6 +466,19 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_i
 	
 }
 
+bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> &depth_image, CLNF& clnf_model, FaceModelParameters& params)
+{
+	// All of the parallel work of this tracker stays within its own share of the TBB threads
+	clnf_model.arena.Configure(params.max_concurrency, params.pin_first_core);
+
+	bool success = false;
+	clnf_model.arena.Execute([&](){
+		success = DetectLandmarksInVideoArena(grayscale_image, depth_image, clnf_model, params);
+	});
+
+	return success;
+}
+
 bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> &depth_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
 {
 	if(bounding_box.width > 0)
@@ -450,13 +505,59 @@ bool LandmarkDetector::DetectLandmarksInVideo(const cv::Mat_<uchar> &grayscale_i
 	return DetectLandmarksInVideo(grayscale_image, cv::Mat_<float>(), bounding_box, clnf_model, params);
 }
 
+// Only the eye models are fit, from where they were in the previous frame
+bool LandmarkDetector::DetectEyesInVideo(const cv::Mat_<uchar> &grayscale_image, CLNF& clnf_model, FaceModelParameters& params, int left_eye_part, int right_eye_part)
+{
+	if(!clnf_model.tracking_initialised || !clnf_model.detection_success || left_eye_part < 0 || right_eye_part < 0)
+	{
+		return false;
+	}
+
+	const int num_eye_parts = 2;
+	const int eye_parts[num_eye_parts] = {left_eye_part, right_eye_part};
+
+	// As in the full fit, the eyes are not fit when they would need upsampling
+	if(clnf_model.params_global[0] <= 0.9 * clnf_model.hierarchical_models[left_eye_part].patch_experts.patch_scaling[0])
+	{
+		return false;
+	}
+
+	clnf_model.arena.Configure(params.max_concurrency, params.pin_first_core);
+
+	clnf_model.arena.Execute([&](){
+		tbb::parallel_for(0, num_eye_parts, [&](int i) {
+			int part = eye_parts[i];
+
+			clnf_model.hierarchical_params[part].window_sizes_current = clnf_model.hierarchical_params[part].window_sizes_init;
+			clnf_model.hierarchical_models[part].DetectLandmarks(grayscale_image, cv::Mat_<float>(), clnf_model.hierarchical_params[part]);
+		});
+	});
+
+	// Move the eye landmarks of the face along with the eye models, as the full fit does before refitting the face
+	int n = clnf_model.pdm.NumberOfPoints();
+	for(int i = 0; i < num_eye_parts; ++i)
+	{
+		const CLNF& eye_model = clnf_model.hierarchical_models[eye_parts[i]];
+		const vector<pair<int, int> >& mappings = clnf_model.hierarchical_mapping[eye_parts[i]];
+		int n_part = eye_model.pdm.NumberOfPoints();
+
+		for(size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
+		{
+			clnf_model.detected_landmarks.at<double>(mappings[mapping_ind].first) = eye_model.detected_landmarks.at<double>(mappings[mapping_ind].second);
+			clnf_model.detected_landmarks.at<double>(mappings[mapping_ind].first + n) = eye_model.detected_landmarks.at<double>(mappings[mapping_ind].second + n_part);
+		}
+	}
+
+	return true;
+}
+
 //================================================================================================================
 // Landmark detection in image, need to provide an image and optionally CLNF model together with parameters (default values work well)
 // Optionally can provide a bounding box in which detection is performed (this is useful if multiple faces are to be detected in images)
 //================================================================================================================
 
-// This is the one where the actual work gets done, other DetectLandmarksInImage calls lead to this one
-bool LandmarkDetector::DetectLandmarksInImage(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> depth_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
+// This is the one where the actual work gets done, other DetectLandmarksInImage calls lead to this one (run inside of the arena of the model)
+bool DetectLandmarksInImageArena(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> depth_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
 {
 
 	// Can have multiple hypotheses
@@ -554,6 +655,18 @@ bool LandmarkDetector::DetectLandmarksInImage(const cv::Mat_<uchar> &grayscale_i
 	return best_success;
 }
 
+bool LandmarkDetector::DetectLandmarksInImage(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> depth_image, const cv::Rect_<double> bounding_box, CLNF& clnf_model, FaceModelParameters& params)
+{
+	clnf_model.arena.Configure(params.max_concurrency, params.pin_first_core);
+
+	bool success = false;
+	clnf_model.arena.Execute([&](){
+		success = DetectLandmarksInImageArena(grayscale_image, depth_image, bounding_box, clnf_model, params);
+	});
+
+	return success;
+}
+
 bool LandmarkDetector::DetectLandmarksInImage(const cv::Mat_<uchar> &grayscale_image, const cv::Mat_<float> depth_image, CLNF& clnf_model, FaceModelParameters& params)
 {
 
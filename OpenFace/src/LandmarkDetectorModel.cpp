@@ -66,9 +66,14 @@
 
 // TBB includes
 #include <tbb/tbb.h>
+#include <tbb/flow_graph.h>
+
+// System includes
+#include <memory>
 
 // Local includes
 #include <LandmarkDetectorUtils.h>
+#include <FaceDetectorCache.h>
 
 using namespace LandmarkDetector;
 
@@ -100,6 +105,8 @@ CLNF::CLNF(const CLNF& other): pdm(other.pdm), params_local(other.params_local.c
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->redetection_stats = other.redetection_stats;
+	this->motion_predictor = other.motion_predictor;
 	
 	// Load the CascadeClassifier (as it does not have a proper copy constructor)
 	if(!face_detector_location.empty())
@@ -121,7 +128,7 @@ CLNF::CLNF(const CLNF& other): pdm(other.pdm), params_local(other.params_local.c
 		this->kde_resp_precalc.insert(std::pair<int, cv::Mat_<float>>(it->first, it->second.clone()));
 	}
 
-	this->face_detector_HOG = dlib::get_frontal_face_detector();
+	this->face_detector_HOG = CopyCachedHOGDetector();
 
 }
 
@@ -145,6 +152,8 @@ CLNF & CLNF::operator= (const CLNF& other)
 		this->detection_certainty = other.detection_certainty;
 		this->model_likelihood = other.model_likelihood;
 		this->failures_in_a_row = other.failures_in_a_row;
+		this->redetection_stats = other.redetection_stats;
+		this->motion_predictor = other.motion_predictor;
 
 		this->eye_model = other.eye_model;
 
@@ -175,7 +184,7 @@ CLNF & CLNF::operator= (const CLNF& other)
 		this->hierarchical_params = other.hierarchical_params;
 	}
 
-	face_detector_HOG = dlib::get_frontal_face_detector();
+	face_detector_HOG = CopyCachedHOGDetector();
 
 	return *this;
 }
@@ -188,6 +197,8 @@ CLNF::CLNF(const CLNF&& other)
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->redetection_stats = other.redetection_stats;
+	this->motion_predictor = other.motion_predictor;
 
 	pdm = other.pdm;
 	params_local = other.params_local;
@@ -203,7 +214,7 @@ CLNF::CLNF(const CLNF&& other)
 	triangulations = other.triangulations;
 	kde_resp_precalc = other.kde_resp_precalc;
 
-	face_detector_HOG = dlib::get_frontal_face_detector();
+	face_detector_HOG = CopyCachedHOGDetector();
 
 	// Copy over the hierarchical models
 	this->hierarchical_mapping = other.hierarchical_mapping;
@@ -223,6 +234,8 @@ CLNF & CLNF::operator= (const CLNF&& other)
 	this->detection_certainty = other.detection_certainty;
 	this->model_likelihood = other.model_likelihood;
 	this->failures_in_a_row = other.failures_in_a_row;
+	this->redetection_stats = other.redetection_stats;
+	this->motion_predictor = other.motion_predictor;
 
 	pdm = other.pdm;
 	params_local = other.params_local;
@@ -238,7 +251,7 @@ CLNF & CLNF::operator= (const CLNF&& other)
 	triangulations = other.triangulations;
 	kde_resp_precalc = other.kde_resp_precalc;
 
-	face_detector_HOG = dlib::get_frontal_face_detector();
+	face_detector_HOG = CopyCachedHOGDetector();
 
 	// Copy over the hierarchical models
 	this->hierarchical_mapping = other.hierarchical_mapping;
@@ -346,7 +359,7 @@ void CLNF::Read_CLNF(string clnf_location)
 	patch_experts.Read(intensity_expert_locations, depth_expert_locations, ccnf_expert_locations);
 
 	// Read in a face detector
-	face_detector_HOG = dlib::get_frontal_face_detector();
+	face_detector_HOG = CopyCachedHOGDetector();
 
 }
 
@@ -567,7 +580,8 @@ void CLNF::Reset()
 	params_global = cv::Vec6d(1, 0, 0, 0, 0, 0);
 
 	failures_in_a_row = -1;
-	face_template = cv::Mat_<uchar>();
+	face_template_tracker.Reset();
+	motion_predictor.Reset();
 }
 
 // Resetting the model, choosing the face nearest (x,y)
@@ -583,98 +597,208 @@ void CLNF::Reset(double x, double y)
 
 }
 
+void CLNF::Translate(double dx, double dy)
+{
+	params_global[4] += dx;
+	params_global[5] += dy;
+
+	// The x coordinates of the landmarks are followed by the y ones
+	int n = detected_landmarks.rows / 2;
+	if(n > 0)
+	{
+		cv::Mat_<double> landmarks_x = detected_landmarks.rowRange(0, n);
+		cv::Mat_<double> landmarks_y = detected_landmarks.rowRange(n, n * 2);
+		landmarks_x += dx;
+		landmarks_y += dy;
+	}
+
+	motion_predictor.Translate(dx, dy);
+
+	for(size_t part = 0; part < hierarchical_models.size(); ++part)
+	{
+		hierarchical_models[part].Translate(dx, dy);
+	}
+}
+
+// The facial features a hierarchical part model refines (unknown parts are assumed to refine all of them)
+static int PartFeatures(const string& part_name)
+{
+	if(part_name.compare("left_eye_28") == 0 || part_name.compare("right_eye_28") == 0)
+	{
+		return FaceModelParameters::FEATURE_GAZE;
+	}
+	else if(part_name.compare("left_eye") == 0 || part_name.compare("right_eye") == 0)
+	{
+		return FaceModelParameters::FEATURE_EYES;
+	}
+	else if(part_name.compare("mouth") == 0)
+	{
+		return FaceModelParameters::FEATURE_MOUTH;
+	}
+	else if(part_name.compare("brow") == 0)
+	{
+		return FaceModelParameters::FEATURE_BROWS;
+	}
+	else if(part_name.compare("inner") == 0)
+	{
+		return FaceModelParameters::FEATURE_MOUTH | FaceModelParameters::FEATURE_BROWS | FaceModelParameters::FEATURE_EYES;
+	}
+	return FaceModelParameters::FEATURE_ALL;
+}
+
 // The main internal landmark detection call (should not be used externally?)
 bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, const cv::Mat_<float> &depth, FaceModelParameters& params)
 {
+	int64 start = cv::getTickCount();
 
 	// Fits from the current estimate of local and global parameters in the model
 	bool fit_success = Fit(image, depth, params.window_sizes_current, params);
 
 	// Store the landmarks converged on in detected_landmarks
 	pdm.CalcShape2D(detected_landmarks, params_local, params_global);	
-	
-	if(params.refine_hierarchical && hierarchical_models.size() > 0)
-	{
-		bool parts_used = false;		
 
-		// Do the hierarchical models in parallel
-		tbb::parallel_for(0, (int)hierarchical_models.size(), [&](int part_model){
+	detection_times.fit = (cv::getTickCount() - start) / cv::getTickFrequency();
+	detection_times.parts = 0;
+	detection_times.validation = 0;
+
+	// Only refine the parts that contribute to the requested features (and the synthetic eye models only if we're doing gaze)
+	vector<int> requested_parts;
+	if(params.refine_hierarchical)
+	{
+		for (size_t part_model = 0; part_model < hierarchical_models.size(); ++part_model)
 		{
-			// Only do the synthetic eye models if we're doing gaze
-			if (!((hierarchical_model_names[part_model].compare("right_eye_28") == 0 ||
-			hierarchical_model_names[part_model].compare("left_eye_28") == 0)
-			&& !params.track_gaze))
+			int features = PartFeatures(hierarchical_model_names[part_model]);
+			if((features & params.feature_mask) != 0 && (features != FaceModelParameters::FEATURE_GAZE || params.track_gaze))
 			{
+				requested_parts.push_back(part_model);
+			}
+		}
+	}
 
-				int n_part_points = hierarchical_models[part_model].pdm.NumberOfPoints();
+	bool validate = params.validate_detections && fit_success;
 
-				vector<pair<int, int>> mappings = this->hierarchical_mapping[part_model];
+	// The validator only depends on the main fit, while the part models refine it further, so the two are run concurrently as a TBB flow graph
+	// (the validator gets its own copy of the main fit as the parts are reincorporated into detected_landmarks)
+	cv::Mat_<double> fit_landmarks;
+	cv::Vec3d fit_orientation(params_global[1], params_global[2], params_global[3]);
+	if(validate)
+	{
+		fit_landmarks = detected_landmarks.clone();
+	}
 
-				cv::Mat_<double> part_model_locs(n_part_points * 2, 1, 0.0);
+	tbb::flow::graph detection_graph;
+	tbb::flow::broadcast_node<tbb::flow::continue_msg> fit_done(detection_graph);
 
-				// Extract the corresponding landmarks
-				for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
-				{
-					part_model_locs.at<double>(mappings[mapping_ind].second) = detected_landmarks.at<double>(mappings[mapping_ind].first);
-					part_model_locs.at<double>(mappings[mapping_ind].second + n_part_points) = detected_landmarks.at<double>(mappings[mapping_ind].first + this->pdm.NumberOfPoints());
-				}
+	tbb::flow::continue_node<tbb::flow::continue_msg> validation(detection_graph, [&](const tbb::flow::continue_msg&) {
+		int64 validation_start = cv::getTickCount();
+		detection_certainty = landmark_validator.Check(fit_orientation, image, fit_landmarks);
+		detection_times.validation = (cv::getTickCount() - validation_start) / cv::getTickFrequency();
+	});
 
-				// Fit the part based model PDM
-				hierarchical_models[part_model].pdm.CalcParams(hierarchical_models[part_model].params_global, hierarchical_models[part_model].params_local, part_model_locs);
+	if(validate)
+	{
+		tbb::flow::make_edge(fit_done, validation);
+	}
 
-				// Only do this if we don't need to upsample
-				if (params_global[0] > 0.9 * hierarchical_models[part_model].patch_experts.patch_scaling[0])
-				{
-					parts_used = true;
+	// Parts that were actually fit (and not just placed based on the main model), not a vector<bool> as it is written concurrently
+	vector<char> part_fit(requested_parts.size(), 0);
 
-					this->hierarchical_params[part_model].window_sizes_current = this->hierarchical_params[part_model].window_sizes_init;
+	vector<unique_ptr<tbb::flow::continue_node<tbb::flow::continue_msg> > > part_nodes;
+	for (size_t i = 0; i < requested_parts.size(); ++i)
+	{
+		int part_model = requested_parts[i];
 
-					// Do the actual landmark detection
-					hierarchical_models[part_model].DetectLandmarks(image, depth, hierarchical_params[part_model]);
+		part_nodes.push_back(unique_ptr<tbb::flow::continue_node<tbb::flow::continue_msg> >(new tbb::flow::continue_node<tbb::flow::continue_msg>(detection_graph, [&, i, part_model](const tbb::flow::continue_msg&) {
 
-				}
-				else
-				{
-					hierarchical_models[part_model].pdm.CalcShape2D(hierarchical_models[part_model].detected_landmarks, hierarchical_models[part_model].params_local, hierarchical_models[part_model].params_global);
-				}
+			int n_part_points = hierarchical_models[part_model].pdm.NumberOfPoints();
+
+			const vector<pair<int, int>>& mappings = this->hierarchical_mapping[part_model];
+
+			cv::Mat_<double> part_model_locs(n_part_points * 2, 1, 0.0);
+
+			// Extract the corresponding landmarks
+			for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
+			{
+				part_model_locs.at<double>(mappings[mapping_ind].second) = detected_landmarks.at<double>(mappings[mapping_ind].first);
+				part_model_locs.at<double>(mappings[mapping_ind].second + n_part_points) = detected_landmarks.at<double>(mappings[mapping_ind].first + this->pdm.NumberOfPoints());
+			}
+
+			// Fit the part based model PDM
+			hierarchical_models[part_model].pdm.CalcParams(hierarchical_models[part_model].params_global, hierarchical_models[part_model].params_local, part_model_locs, cv::Vec3d(0.0),
+				hierarchical_models[part_model].calc_params_workspace);
+
+			// Only do this if we don't need to upsample
+			if (params_global[0] > 0.9 * hierarchical_models[part_model].patch_experts.patch_scaling[0])
+			{
+				part_fit[i] = 1;
+
+				this->hierarchical_params[part_model].window_sizes_current = this->hierarchical_params[part_model].window_sizes_init;
+
+				// Do the actual landmark detection
+				hierarchical_models[part_model].DetectLandmarks(image, depth, hierarchical_params[part_model]);
+
+			}
+			else
+			{
+				hierarchical_models[part_model].pdm.CalcShape2D(hierarchical_models[part_model].detected_landmarks, hierarchical_models[part_model].params_local, hierarchical_models[part_model].params_global);
 			}
+		})));
+
+		tbb::flow::make_edge(fit_done, *part_nodes.back());
+	}
+
+	// Recompute main model based on the fit part models, once all of them are done
+	tbb::flow::continue_node<tbb::flow::continue_msg> reincorporation(detection_graph, [&](const tbb::flow::continue_msg&) {
+
+		bool parts_used = false;
+		for (size_t i = 0; i < part_fit.size(); ++i)
+		{
+			parts_used = parts_used || part_fit[i] != 0;
 		}
-		});
 
-		// Recompute main model based on the fit part models
 		if(parts_used)
 		{
-
-			for (size_t part_model = 0; part_model < hierarchical_models.size(); ++part_model)
+			for (size_t i = 0; i < requested_parts.size(); ++i)
 			{
-				vector<pair<int, int>> mappings = this->hierarchical_mapping[part_model];
+				int part_model = requested_parts[i];
 
-				if (!((hierarchical_model_names[part_model].compare("right_eye_28") == 0 ||
-					hierarchical_model_names[part_model].compare("left_eye_28") == 0)
-					&& !params.track_gaze))
+				const vector<pair<int, int>>& mappings = this->hierarchical_mapping[part_model];
+
+				// Reincorporate the models into main tracker
+				for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
 				{
-					// Reincorporate the models into main tracker
-					for (size_t mapping_ind = 0; mapping_ind < mappings.size(); ++mapping_ind)
-					{
-						detected_landmarks.at<double>(mappings[mapping_ind].first) = hierarchical_models[part_model].detected_landmarks.at<double>(mappings[mapping_ind].second);
-						detected_landmarks.at<double>(mappings[mapping_ind].first + pdm.NumberOfPoints()) = hierarchical_models[part_model].detected_landmarks.at<double>(mappings[mapping_ind].second + hierarchical_models[part_model].pdm.NumberOfPoints());
-					}
+					detected_landmarks.at<double>(mappings[mapping_ind].first) = hierarchical_models[part_model].detected_landmarks.at<double>(mappings[mapping_ind].second);
+					detected_landmarks.at<double>(mappings[mapping_ind].first + pdm.NumberOfPoints()) = hierarchical_models[part_model].detected_landmarks.at<double>(mappings[mapping_ind].second + hierarchical_models[part_model].pdm.NumberOfPoints());
 				}
 			}
 
-			pdm.CalcParams(params_global, params_local, detected_landmarks);		
+			pdm.CalcParams(params_global, params_local, detected_landmarks, cv::Vec3d(0.0), calc_params_workspace);
 			pdm.CalcShape2D(detected_landmarks, params_local, params_global);
 		}
 
-	}
+		detection_times.parts = (cv::getTickCount() - start) / cv::getTickFrequency() - detection_times.fit;
+	});
 
-	// Check detection correctness
-	if(params.validate_detections && fit_success)
+	for (size_t i = 0; i < part_nodes.size(); ++i)
 	{
-		cv::Vec3d orientation(params_global[1], params_global[2], params_global[3]);
+		tbb::flow::make_edge(*part_nodes[i], reincorporation);
+	}
 
-		detection_certainty = landmark_validator.Check(orientation, image, detected_landmarks);
+	if(!part_nodes.empty())
+	{
+		fit_done.try_put(tbb::flow::continue_msg());
+		detection_graph.wait_for_all();
+	}
+	else if(validate)
+	{
+		// Nothing to overlap with, no need to go through the graph
+		validation.try_put(tbb::flow::continue_msg());
+		detection_graph.wait_for_all();
+	}
 
+	// Check detection correctness
+	if(validate)
+	{
 		detection_success = detection_certainty < params.validation_boundary;
 	}
 	else
@@ -691,6 +815,8 @@ bool CLNF::DetectLandmarks(const cv::Mat_<uchar> &image, const cv::Mat_<float> &
 
 	}
 
+	detection_times.total = (cv::getTickCount() - start) / cv::getTickFrequency();
+
 	return detection_success;
 }
 
@@ -730,6 +856,10 @@ bool CLNF::Fit(const cv::Mat_<uchar>& im, const cv::Mat_<float>& depthImg, const
 
 	FaceModelParameters tmp_parameters = parameters;
 
+	// The scales that are skipped stay at 0
+	fit_stats.window_sizes.assign(num_scales, 0);
+	fit_stats.iterations.assign(num_scales, 0);
+
 	// Optimise the model across a number of areas of interest (usually in descending window size and ascending scale size)
 	for(int scale = 0; scale < num_scales; scale++)
 	{
@@ -769,10 +899,14 @@ bool CLNF::Fit(const cv::Mat_<uchar>& im, const cv::Mat_<float>& depthImg, const
 		int view_id = patch_experts.GetViewIdx(params_global, scale);
 
 		// the actual optimisation step
-		this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6d(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, true, scale, this->landmark_likelihoods, tmp_parameters);
+		int rigid_iterations, non_rigid_iterations;
+		this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6d(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, true, scale, this->landmark_likelihoods, tmp_parameters, rigid_iterations);
 
 		// non-rigid optimisation
-		this->model_likelihood = this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6d(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, false, scale, this->landmark_likelihoods, tmp_parameters);
+		this->model_likelihood = this->NU_RLMS(params_global, params_local, patch_expert_responses, cv::Vec6d(params_global), params_local.clone(), current_shape, sim_img_to_ref, sim_ref_to_img, window_size, view_id, false, scale, this->landmark_likelihoods, tmp_parameters, non_rigid_iterations);
+
+		fit_stats.window_sizes[scale] = window_size;
+		fit_stats.iterations[scale] = rigid_iterations + non_rigid_iterations;
 		
 		// Can't track very small images reliably (less than ~30px across)
 		if(params_global[0] < 0.25)
@@ -944,7 +1078,7 @@ void CLNF::GetWeightMatrix(cv::Mat_<float>& WeightMatrix, int scale, int view_id
 //=============================================================================
 double CLNF::NU_RLMS(cv::Vec6d& final_global, cv::Mat_<double>& final_local, const vector<cv::Mat_<float> >& patch_expert_responses, const cv::Vec6d& initial_global, const cv::Mat_<double>& initial_local,
 		          const cv::Mat_<double>& base_shape, const cv::Matx22d& sim_img_to_ref, const cv::Matx22f& sim_ref_to_img, int resp_size, int view_id, bool rigid, int scale, cv::Mat_<double>& landmark_lhoods,
-				  const FaceModelParameters& parameters)
+				  const FaceModelParameters& parameters, int& o_iterations)
 {		
 
 	int n = pdm.NumberOfPoints();  
@@ -989,7 +1123,8 @@ double CLNF::NU_RLMS(cv::Vec6d& final_global, cv::Mat_<double>& final_local, con
 	// The preallocated memory for the mean shifts
 	cv::Mat_<float> mean_shifts(2 * pdm.NumberOfPoints(), 1, 0.0);
 
-	// Number of iterations
+	// Number of iterations (the ones that ran before the shape converged are counted)
+	o_iterations = 0;
 	for(int iter = 0; iter < parameters.num_optimisation_iteration; iter++)
 	{
 		// get the current estimates of x
@@ -1005,6 +1140,7 @@ double CLNF::NU_RLMS(cv::Vec6d& final_global, cv::Mat_<double>& final_local, con
 		}
 
 		current_shape.copyTo(previous_shape);
+		o_iterations++;
 		
 		// Jacobian, and transposed weighted jacobian
 		cv::Mat_<float> J, J_w_t;
@@ -158,6 +158,24 @@ FaceModelParameters::FaceModelParameters(vector<string> &arguments)
 			valid[i + 1] = false;
 			i++;
 		}
+		else if (arguments[i].compare("-max_threads") == 0)
+		{
+			stringstream data(arguments[i + 1]);
+			data >> max_concurrency;
+
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
+		else if (arguments[i].compare("-pin_core") == 0)
+		{
+			stringstream data(arguments[i + 1]);
+			data >> pin_first_core;
+
+			valid[i] = false;
+			valid[i + 1] = false;
+			i++;
+		}
 		else if (arguments[i].compare("-gaze") == 0)
 		{
 			track_gaze = true;
@@ -244,10 +262,15 @@ void FaceModelParameters::init()
 	face_template_scale = 0.3;
 	// Off by default (as it might lead to some slight inaccuracies in slowly moving faces)
 	use_face_template = false;
+	face_template_drift = 0.2;
 
 	// For first frame use the initialisation
 	window_sizes_current = window_sizes_init;
 
+	// Tracking from the previous frame by default
+	use_motion_prediction = false;
+	predict_shape = false;
+
 	model_location = "model/main_clnf_general.txt";
 
 	sigma = 1.5;
@@ -261,6 +284,11 @@ void FaceModelParameters::init()
 
 	reinit_video_every = 4;
 
+	// Look around the last known face location first, HOG detector needs around 70px faces so leave some margin
+	use_staged_redetection = true;
+	redetection_roi_scale = 3.0;
+	redetection_face_width = 100;
+
 	// Face detection
 #if OS_UNIX
 	face_detector_location = "classifiers/haarcascade_frontalface_alt.xml";
@@ -275,5 +303,12 @@ void FaceModelParameters::init()
 
 	// The gaze tracking has to be explicitly initialised
 	track_gaze = false;
+
+	// By default refine all of the features
+	feature_mask = FEATURE_ALL;
+
+	// By default trackers share the global TBB pool and are not pinned
+	max_concurrency = 0;
+	pin_first_core = -1;
 }
 
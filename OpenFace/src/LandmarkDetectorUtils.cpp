@@ -59,6 +59,7 @@
 #include "../stdafx.h"
 
 #include <LandmarkDetectorUtils.h>
+#include <FaceDetectorCache.h>
 
 // OpenCV includes
 #include <opencv2/core/core.hpp>
@@ -69,6 +70,9 @@
 #include <filesystem.hpp>
 #include <filesystem/fstream.hpp>
 
+// TBB includes
+#include <tbb/tbb.h>
+
 using namespace boost::filesystem;
 
 using namespace std;
@@ -1297,24 +1301,24 @@ cv::Vec3d RotationMatrix2AxisAngle(const cv::Matx33d& rotation_matrix)
 //============================================================================
 bool DetectFaces(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity)
 {
-	cv::CascadeClassifier classifier("./classifiers/haarcascade_frontalface_alt.xml");
-	if(classifier.empty())
+	// Borrow a loaded classifier instead of reading it from disk every time
+	CachedHaarDetector classifier;
+	if(classifier.Empty())
 	{
-		cout << "Couldn't load the Haar cascade classifier" << endl;
 		return false;
 	}
 	else
 	{
-		return DetectFaces(o_regions, intensity, classifier);
+		return DetectFaces(o_regions, intensity, classifier.Get());
 	}
 
 }
 
-bool DetectFaces(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity, cv::CascadeClassifier& classifier)
+bool DetectFaces(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity, cv::CascadeClassifier& classifier, const cv::Size& min_size, const cv::Size& max_size)
 {
 		
 	vector<cv::Rect> face_detections;
-	classifier.detectMultiScale(intensity, face_detections, 1.2, 2, 0, cv::Size(50, 50));
+	classifier.detectMultiScale(intensity, face_detections, 1.2, 2, 0, min_size, max_size);
 
 	// Convert from int bounding box do a double one with corrections
 	o_regions.resize(face_detections.size());
@@ -1401,10 +1405,136 @@ bool DetectSingleFace(cv::Rect_<double>& o_region, const cv::Mat_<uchar>& intens
 
 bool DetectFacesHOG(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity, std::vector<double>& confidences)
 {
-	dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+	CachedHOGDetector detector;
+
+	return DetectFacesHOG(o_regions, intensity, detector.Get(), confidences);
+
+}
+
+// The dlib detector scans the image pyramid level after level, here the levels (and the detector's filters) are scanned as separate TBB tasks
+// The downsampled images, the per level features and the non-maximum suppression are the same as in object_detector::operator(), so the
+// detections are identical to the serial call detector(image, detections, adjust_threshold)
+void DetectHOGParallel(const dlib::frontal_face_detector& detector, const cv::Mat_<uchar>& intensity, std::vector<dlib::full_detection>& o_detections, double adjust_threshold)
+{
+	typedef dlib::frontal_face_detector::image_scanner_type scanner_type;
+	typedef scanner_type::pyramid_type pyramid_type;
+
+	const scanner_type& scanner = detector.get_scanner();
+	pyramid_type pyr;
+
+	dlib::cv_image<uchar> image(intensity);
+
+	// Work out the number of pyramid levels the same way the scanner does
+	unsigned long levels = 0;
+	dlib::rectangle level_rect = dlib::get_rect(image);
+	do
+	{
+		level_rect = pyr.rect_down(level_rect);
+		++levels;
+	} while(level_rect.width() >= scanner.get_min_pyramid_layer_width() && level_rect.height() >= scanner.get_min_pyramid_layer_height() &&
+		levels < scanner.get_max_pyramid_levels());
+
+	// The downsampled images depend on each other so they are built serially (this is cheap compared to the scanning)
+	dlib::array<dlib::array2d<uchar> > pyramid;
+	pyramid.set_size(levels);
+	for(unsigned long l = 1; l < levels; ++l)
+	{
+		if(l == 1)
+		{
+			pyr(image, pyramid[l]);
+		}
+		else
+		{
+			pyr(pyramid[l-1], pyramid[l]);
+		}
+	}
+
+	// The frontal face detector consists of several filters (for different views)
+	const HOGFilterBanks& banks = GetHOGFilterBanks(detector);
+	const vector<scanner_type::fhog_filterbank>& filters = banks.filters;
+	const vector<double>& thresholds = banks.thresholds;
+	int num_filters = (int)filters.size();
+
+	// Raw detections for every level and filter (in full image coordinates)
+	vector<vector<vector<pair<double, dlib::rectangle> > > > level_dets(levels, vector<vector<pair<double, dlib::rectangle> > >(num_filters));
+
+	tbb::parallel_for(0, (int)levels, [&](int l){
+
+		// A single level scanner over the already downsampled image computes the same features as level l of the full scanner
+		scanner_type level_scanner;
+		level_scanner.copy_configuration(scanner);
+		level_scanner.set_max_pyramid_levels(1);
+
+		if(l == 0)
+		{
+			level_scanner.load(image);
+		}
+		else
+		{
+			level_scanner.load(pyramid[l]);
+		}
+
+		tbb::parallel_for(0, num_filters, [&](int i){
+			level_scanner.detect(filters[i], level_dets[l][i], thresholds[i] + adjust_threshold);
+			for(size_t d = 0; d < level_dets[l][i].size(); ++d)
+			{
+				level_dets[l][i][d].second = pyr.rect_up(level_dets[l][i][d].second, l);
+			}
+		});
+	});
+
+	// Merge the levels and order the detections the same way object_detector does
+	std::vector<dlib::rect_detection> dets_accum;
+	for(int i = 0; i < num_filters; ++i)
+	{
+		vector<pair<double, dlib::rectangle> > dets;
+		for(unsigned long l = 0; l < levels; ++l)
+		{
+			dets.insert(dets.end(), level_dets[l][i].begin(), level_dets[l][i].end());
+		}
+		// Only by the score, as object_detector does (the levels are concatenated in the order its scanner reports them, so ties
+		// end up in the same order too)
+		std::sort(dets.rbegin(), dets.rend(), [](const pair<double, dlib::rectangle>& a, const pair<double, dlib::rectangle>& b){ return a.first < b.first; });
 
-	return DetectFacesHOG(o_regions, intensity, detector, confidences);
+		for(size_t d = 0; d < dets.size(); ++d)
+		{
+			dlib::rect_detection det;
+			det.detection_confidence = dets[d].first - thresholds[i];
+			det.weight_index = i;
+			det.rect = dets[d].second;
+			dets_accum.push_back(det);
+		}
+	}
+
+	if(num_filters > 1)
+	{
+		std::sort(dets_accum.rbegin(), dets_accum.rend());
+	}
+
+	// Non-maximum suppression
+	const dlib::test_box_overlap& overlap_tester = detector.get_overlap_tester();
+	std::vector<dlib::rect_detection> final_dets;
+	for(size_t d = 0; d < dets_accum.size(); ++d)
+	{
+		bool overlaps = false;
+		for(size_t f = 0; f < final_dets.size() && !overlaps; ++f)
+		{
+			overlaps = overlap_tester(dets_accum[d].rect, final_dets[f].rect);
+		}
 
+		if(!overlaps)
+		{
+			final_dets.push_back(dets_accum[d]);
+		}
+	}
+
+	o_detections.resize(final_dets.size());
+	for(size_t d = 0; d < final_dets.size(); ++d)
+	{
+		o_detections[d].detection_confidence = final_dets[d].detection_confidence;
+		o_detections[d].weight_index = final_dets[d].weight_index;
+		o_detections[d].rect = dlib::full_object_detection(final_dets[d].rect);
+	}
 }
 
 bool DetectFacesHOG(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>& intensity, dlib::frontal_face_detector& detector, std::vector<double>& o_confidences)
@@ -1416,10 +1546,8 @@ bool DetectFacesHOG(vector<cv::Rect_<double> >& o_regions, const cv::Mat_<uchar>
 
 	cv::resize(intensity, upsampled_intensity, cv::Size((int)(intensity.cols * scaling), (int)(intensity.rows * scaling)));
 
-	dlib::cv_image<uchar> cv_grayscale(upsampled_intensity);
-
 	std::vector<dlib::full_detection> face_detections;
-	detector(cv_grayscale, face_detections, -0.2);
+	DetectHOGParallel(detector, upsampled_intensity, face_detections, -0.2);
 
 	// Convert from int bounding box do a double one with corrections
 	o_regions.resize(face_detections.size());
@@ -1512,6 +1640,140 @@ bool DetectSingleFaceHOG(cv::Rect_<double>& o_region, const cv::Mat_<uchar>& int
 	return detect_success;
 }
 
+// Cut out a search window around a previously tracked face and downsample it so that the face is roughly face_width pixels across
+// Returns the scaling applied to the window (0 if the window falls outside the image)
+static double PrepareRedetectionWindow(cv::Mat_<uchar>& o_window, cv::Rect& o_roi, const cv::Mat_<uchar>& intensity, const cv::Rect_<double>& prev_box, double roi_scale, double face_width)
+{
+	double cx = prev_box.x + prev_box.width / 2.0;
+	double cy = prev_box.y + prev_box.height / 2.0;
+	double size = max(prev_box.width, prev_box.height) * roi_scale;
+
+	o_roi = cv::Rect((int)(cx - size / 2.0), (int)(cy - size / 2.0), (int)size, (int)size);
+	o_roi = o_roi & cv::Rect(0, 0, intensity.cols, intensity.rows);
+
+	if(o_roi.width <= 0 || o_roi.height <= 0 || prev_box.width <= 0)
+	{
+		return 0;
+	}
+
+	// Only ever downsample, small faces are searched at their original resolution
+	double scaling = min(1.0, face_width / prev_box.width);
+
+	if(scaling < 1)
+	{
+		cv::resize(intensity(o_roi), o_window, cv::Size(), scaling, scaling, cv::INTER_AREA);
+	}
+	else
+	{
+		// No need to copy, just a header into the original image
+		o_window = intensity(o_roi);
+	}
+	return scaling;
+}
+
+// Pick the detection closest to the centre of the lost face, in the coordinates of the (possibly clipped and downsampled) window
+static int PickClosestToCentre(const vector<cv::Rect_<double> >& detections, const cv::Rect_<double>& prev_box, const cv::Rect& roi, double scaling)
+{
+	double centre_x = (prev_box.x + prev_box.width / 2.0 - roi.x) * scaling;
+	double centre_y = (prev_box.y + prev_box.height / 2.0 - roi.y) * scaling;
+
+	int best_index = 0;
+	double best_dist = -1;
+	for(int i = 0; i < (int)detections.size(); ++i)
+	{
+		double dx = detections[i].x + detections[i].width / 2.0 - centre_x;
+		double dy = detections[i].y + detections[i].height / 2.0 - centre_y;
+		double dist = dx * dx + dy * dy;
+		if(best_dist < 0 || dist < best_dist)
+		{
+			best_dist = dist;
+			best_index = i;
+		}
+	}
+	return best_index;
+}
+
+bool DetectSingleFaceROI(cv::Rect_<double>& o_region, const cv::Mat_<uchar>& intensity, cv::CascadeClassifier& classifier, const cv::Rect_<double>& prev_box, double roi_scale, double face_width)
+{
+	o_region = cv::Rect_<double>(0,0,0,0);
+
+	cv::Mat_<uchar> window;
+	cv::Rect roi;
+	double scaling = PrepareRedetectionWindow(window, roi, intensity, prev_box, roi_scale, face_width);
+
+	if(scaling == 0)
+	{
+		return false;
+	}
+
+	// Only look for faces of a similar scale to the lost one (Haar boxes are larger than the corrected ones, hence the asymmetry)
+	int face_size = (int)(prev_box.width * scaling);
+	cv::Size min_size(max(20, face_size / 2), max(20, face_size / 2));
+	cv::Size max_size(face_size * 3, face_size * 3);
+
+	vector<cv::Rect_<double> > face_detections;
+	if(!LandmarkDetector::DetectFaces(face_detections, window, classifier, min_size, max_size))
+	{
+		return false;
+	}
+
+	cv::Rect_<double> best = face_detections[PickClosestToCentre(face_detections, prev_box, roi, scaling)];
+
+	o_region = cv::Rect_<double>(best.x / scaling + roi.x, best.y / scaling + roi.y, best.width / scaling, best.height / scaling);
+
+	return true;
+}
+
+bool DetectSingleFaceHOGROI(cv::Rect_<double>& o_region, const cv::Mat_<uchar>& intensity, dlib::frontal_face_detector& detector, double& confidence, const cv::Rect_<double>& prev_box, double roi_scale, double face_width)
+{
+	o_region = cv::Rect_<double>(0,0,0,0);
+	confidence = -2;
+
+	cv::Mat_<uchar> window;
+	cv::Rect roi;
+	double scaling = PrepareRedetectionWindow(window, roi, intensity, prev_box, roi_scale, face_width);
+
+	if(scaling == 0)
+	{
+		return false;
+	}
+
+	vector<cv::Rect_<double> > face_detections;
+	vector<double> confidences;
+	if(!LandmarkDetector::DetectFacesHOG(face_detections, window, detector, confidences))
+	{
+		return false;
+	}
+
+	int best_index = PickClosestToCentre(face_detections, prev_box, roi, scaling);
+	cv::Rect_<double> best = face_detections[best_index];
+
+	o_region = cv::Rect_<double>(best.x / scaling + roi.x, best.y / scaling + roi.y, best.width / scaling, best.height / scaling);
+	confidence = confidences[best_index];
+
+	return true;
+}
+
+// Batch detection, every image is processed as a separate task and borrows its own detector from the cache
+void DetectFacesBatch(vector<vector<cv::Rect_<double> > >& o_regions, const vector<cv::Mat_<uchar> >& intensities)
+{
+	o_regions.resize(intensities.size());
+
+	tbb::parallel_for(0, (int)intensities.size(), [&](int i){
+		DetectFaces(o_regions[i], intensities[i]);
+	});
+}
+
+void DetectFacesHOGBatch(vector<vector<cv::Rect_<double> > >& o_regions, const vector<cv::Mat_<uchar> >& intensities, vector<vector<double> >& o_confidences)
+{
+	o_regions.resize(intensities.size());
+	o_confidences.resize(intensities.size());
+
+	tbb::parallel_for(0, (int)intensities.size(), [&](int i){
+		DetectFacesHOG(o_regions[i], intensities[i], o_confidences[i]);
+	});
+}
+
 //============================================================================
 // Matrix reading functionality
 //============================================================================
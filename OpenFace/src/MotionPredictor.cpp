@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../stdafx.h"
+
+#include <MotionPredictor.h>
+
+using namespace LandmarkDetector;
+
+MotionPredictor::MotionPredictor() : alpha(1.0), beta(0.5), window_margin(2.0)
+{
+	Reset();
+}
+
+void MotionPredictor::Reset()
+{
+	updates = 0;
+	global = cv::Vec6d(0, 0, 0, 0, 0, 0);
+	global_velocity = cv::Vec6d(0, 0, 0, 0, 0, 0);
+	local.release();
+	local_velocity.release();
+	residual = 0;
+}
+
+void MotionPredictor::Translate(double dx, double dy)
+{
+	global[4] += dx;
+	global[5] += dy;
+}
+
+void MotionPredictor::Predict(cv::Vec6d& io_global, cv::Mat_<double>& io_local, bool predict_local) const
+{
+	if(!Initialised())
+	{
+		return;
+	}
+
+	io_global = global + global_velocity;
+
+	if(predict_local && local.rows == io_local.rows)
+	{
+		io_local = local + local_velocity;
+	}
+}
+
+void MotionPredictor::Update(const cv::Vec6d& fit_global, const cv::Mat_<double>& fit_local, double fit_residual)
+{
+	residual = fit_residual;
+
+	if(updates == 0 || local.rows != fit_local.rows)
+	{
+		// Nothing to predict from yet, start still
+		global = fit_global;
+		global_velocity = cv::Vec6d(0, 0, 0, 0, 0, 0);
+		local = fit_local.clone();
+		local_velocity = cv::Mat_<double>::zeros(fit_local.rows, 1);
+	}
+	else if(updates == 1)
+	{
+		// The first velocity is the difference of the first two fits
+		global_velocity = fit_global - global;
+		global = fit_global;
+		local_velocity = fit_local - local;
+		fit_local.copyTo(local);
+	}
+	else
+	{
+		cv::Vec6d global_error = fit_global - (global + global_velocity);
+		global = global + global_velocity + alpha * global_error;
+		global_velocity = global_velocity + beta * global_error;
+
+		cv::Mat_<double> local_error = fit_local - (local + local_velocity);
+		local = local + local_velocity + alpha * local_error;
+		local_velocity = local_velocity + beta * local_error;
+	}
+
+	updates++;
+}
+
+void MotionPredictor::ChooseWindows(const FaceModelParameters& params, const vector<double>& patch_scaling, double face_scale, vector<int>& o_window_sizes) const
+{
+	o_window_sizes = params.window_sizes_small;
+
+	double needed = window_margin * residual;
+
+	// A window reaches (size - 1) / 2 pixels of the patch expert space in each direction, which are face_scale / patch_scaling image pixels
+	vector<double> reach(o_window_sizes.size(), 0.0);
+	int first_scale = -1;
+	for(size_t scale = 0; scale < o_window_sizes.size() && scale < patch_scaling.size(); ++scale)
+	{
+		reach[scale] = (params.window_sizes_small[scale] - 1) / 2.0 * face_scale / patch_scaling[scale];
+		if(first_scale < 0 && params.window_sizes_small[scale] > 0)
+		{
+			first_scale = scale;
+		}
+	}
+
+	// The coarsest small window covers the residual, the finer scales only refine
+	if(first_scale < 0 || reach[first_scale] >= needed)
+	{
+		return;
+	}
+
+	// Otherwise widen the scales whose small windows fall short, bringing back the ones the small windows skip
+	for(size_t scale = 0; scale < o_window_sizes.size() && scale < patch_scaling.size(); ++scale)
+	{
+		if(params.window_sizes_small[scale] == 0 || reach[scale] < needed)
+		{
+			o_window_sizes[scale] = params.window_sizes_init[scale];
+		}
+	}
+}
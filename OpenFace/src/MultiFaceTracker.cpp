@@ -0,0 +1,407 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../stdafx.h"
+
+#include <MultiFaceTracker.h>
+
+// TBB includes
+#include <tbb/tbb.h>
+
+// Local includes
+#include <LandmarkDetectorFunc.h>
+#include <LandmarkDetectorUtils.h>
+#include <FaceDetectorCache.h>
+
+// System includes
+#include <iostream>
+
+using namespace LandmarkDetector;
+
+namespace
+{
+	// Intersection over union of two boxes
+	double BoxOverlap(const cv::Rect_<double>& a, const cv::Rect_<double>& b)
+	{
+		double intersection = (a & b).area();
+		double union_area = a.area() + b.area() - intersection;
+
+		return union_area > 0 ? intersection / union_area : 0;
+	}
+
+	// The fraction of the detected landmarks of a model that are inside of a box
+	double LandmarkOverlap(const CLNF& model, const cv::Rect_<double>& box)
+	{
+		int n = model.detected_landmarks.rows / 2;
+
+		if(n == 0)
+		{
+			return 0;
+		}
+
+		int inside = 0;
+		for(int i = 0; i < n; ++i)
+		{
+			if(box.contains(cv::Point2d(model.detected_landmarks.at<double>(i), model.detected_landmarks.at<double>(i + n))))
+			{
+				inside++;
+			}
+		}
+		return (double)inside / n;
+	}
+}
+
+MultiFaceTracker::MultiFaceTracker() : max_faces(4), detection_interval(8), association_iou(0.3), association_landmark_overlap(0.5), max_track_failures(10),
+	last_detection_time(0), last_fit_time(0), next_id(0), frame_count(0)
+{
+}
+
+MultiFaceTracker::~MultiFaceTracker()
+{
+	Reset();
+
+	for(size_t i = 0; i < idle_models.size(); ++i)
+	{
+		delete idle_models[i];
+	}
+}
+
+void MultiFaceTracker::SetModel(const CLNF& model)
+{
+	Reset();
+
+	// The idle trackers were copied from the previous model
+	for(size_t i = 0; i < idle_models.size(); ++i)
+	{
+		delete idle_models[i];
+	}
+	idle_models.clear();
+
+	face_model = model;
+	face_model.Reset();
+}
+
+void MultiFaceTracker::Reset()
+{
+	while(!faces.empty())
+	{
+		Retire(faces.size() - 1);
+	}
+	frame_count = 0;
+}
+
+void MultiFaceTracker::Translate(double dx, double dy)
+{
+	for(size_t i = 0; i < faces.size(); ++i)
+	{
+		faces[i].model->Translate(dx, dy);
+
+		// The detection a new face is yet to be fitted from
+		if(faces[i].init_box.width > 0)
+		{
+			faces[i].init_box.x += dx;
+			faces[i].init_box.y += dy;
+		}
+	}
+}
+
+void MultiFaceTracker::InvalidateResponseCaches()
+{
+	face_model.InvalidateResponseCaches();
+
+	for(size_t i = 0; i < faces.size(); ++i)
+	{
+		faces[i].model->InvalidateResponseCaches();
+	}
+	for(size_t i = 0; i < idle_models.size(); ++i)
+	{
+		idle_models[i]->InvalidateResponseCaches();
+	}
+}
+
+void MultiFaceTracker::Spawn(const cv::Rect_<double>& bounding_box)
+{
+	FaceTrack face;
+	face.id = next_id++;
+	face.init_box = bounding_box;
+
+	if(idle_models.empty())
+	{
+		face.model = new CLNF(face_model);
+	}
+	else
+	{
+		face.model = idle_models.back();
+		idle_models.pop_back();
+	}
+
+	faces.push_back(face);
+}
+
+void MultiFaceTracker::Retire(size_t face)
+{
+	faces[face].model->Reset();
+	idle_models.push_back(faces[face].model);
+	faces.erase(faces.begin() + face);
+}
+
+void MultiFaceTracker::DetectAndAssociate(const cv::Mat_<uchar>& grayscale_image, const FaceModelParameters& params)
+{
+	vector<cv::Rect_<double> > detections;
+
+	if(params.curr_face_detector == FaceModelParameters::HOG_SVM_DETECTOR)
+	{
+		vector<double> confidences;
+		LandmarkDetector::DetectFacesHOG(detections, grayscale_image, confidences);
+	}
+	else
+	{
+		CachedHaarDetector classifier(params.face_detector_location);
+		if(!classifier.Empty())
+		{
+			LandmarkDetector::DetectFaces(detections, grayscale_image, classifier.Get());
+		}
+	}
+
+	// Greedily match the detections to the tracked faces, best score first
+	vector<char> face_matched(faces.size(), 0);
+	vector<char> detection_matched(detections.size(), 0);
+
+	while(true)
+	{
+		double best_score = 0;
+		int best_face = -1;
+		int best_detection = -1;
+
+		for(size_t f = 0; f < faces.size(); ++f)
+		{
+			if(face_matched[f])
+			{
+				continue;
+			}
+
+			// Newly spawned faces have not been fitted yet
+			cv::Rect_<double> face_box = faces[f].init_box.width > 0 ? faces[f].init_box : faces[f].model->GetBoundingBox();
+
+			for(size_t d = 0; d < detections.size(); ++d)
+			{
+				if(detection_matched[d])
+				{
+					continue;
+				}
+
+				double iou = BoxOverlap(face_box, detections[d]);
+				double landmark_overlap = faces[f].init_box.width > 0 ? 0 : LandmarkOverlap(*faces[f].model, detections[d]);
+
+				if(iou < association_iou && landmark_overlap < association_landmark_overlap)
+				{
+					continue;
+				}
+
+				double score = max(iou, landmark_overlap);
+				if(score > best_score)
+				{
+					best_score = score;
+					best_face = (int)f;
+					best_detection = (int)d;
+				}
+			}
+		}
+
+		if(best_face == -1)
+		{
+			break;
+		}
+
+		face_matched[best_face] = 1;
+		detection_matched[best_detection] = 1;
+
+		// A face that is currently failing is put back on its detection
+		if(!faces[best_face].model->detection_success)
+		{
+			faces[best_face].init_box = detections[best_detection];
+		}
+	}
+
+	// The remaining detections are new faces, when all of the trackers are in use they replace the failing faces that no detection
+	// was matched to
+	size_t replaced = 0;
+	for(size_t d = 0; d < detections.size(); ++d)
+	{
+		if(detection_matched[d])
+		{
+			continue;
+		}
+
+		if((int)faces.size() < max_faces)
+		{
+			Spawn(detections[d]);
+			continue;
+		}
+
+		while(replaced < face_matched.size() && (face_matched[replaced] || faces[replaced].model->detection_success))
+		{
+			replaced++;
+		}
+		if(replaced == face_matched.size())
+		{
+			break;
+		}
+
+		faces[replaced].id = next_id++;
+		faces[replaced].init_box = detections[d];
+		face_matched[replaced] = 1;
+	}
+}
+
+bool MultiFaceTracker::Track(const cv::Mat_<uchar>& grayscale_image, const cv::Mat_<float>& depth_image, FaceModelParameters& params)
+{
+	if(Empty())
+	{
+		cout << "No model to track the faces with" << endl;
+		return false;
+	}
+
+	last_detection_time = 0;
+
+	// Once all of the trackers are in use, detecting is only needed to put back (or replace) the faces that are failing
+	bool any_failing = false;
+	for(size_t f = 0; f < faces.size(); ++f)
+	{
+		any_failing = any_failing || (faces[f].init_box.width == 0 && !faces[f].model->detection_success);
+	}
+
+	if(((int)faces.size() < max_faces || any_failing) && (faces.empty() || detection_interval <= 1 || frame_count % detection_interval == 0))
+	{
+		int64 detection_start = cv::getTickCount();
+		DetectAndAssociate(grayscale_image, params);
+		last_detection_time = (cv::getTickCount() - detection_start) / cv::getTickFrequency();
+	}
+	frame_count++;
+
+	int64 fit_start = cv::getTickCount();
+
+	// The faces share the threads of the model arena
+	face_model.arena.Configure(params.max_concurrency, params.pin_first_core);
+	face_model.arena.Execute([&](){
+		tbb::parallel_for(0, (int)faces.size(), [&](int f){
+
+			// Every tracker keeps its own copy of the parameters (the window sizes are changed while fitting), the trackers never
+			// re-detect on their own as they could jump to another face, and they run in the enclosing arena
+			FaceModelParameters face_params(params);
+			face_params.reinit_video_every = -1;
+			face_params.max_concurrency = 0;
+
+			if(faces[f].init_box.width > 0)
+			{
+				faces[f].model->Reset();
+				LandmarkDetector::DetectLandmarksInVideo(grayscale_image, depth_image, faces[f].init_box, *faces[f].model, face_params);
+				faces[f].init_box = cv::Rect_<double>();
+			}
+			else
+			{
+				LandmarkDetector::DetectLandmarksInVideo(grayscale_image, depth_image, *faces[f].model, face_params);
+			}
+		});
+	});
+
+	last_fit_time = (cv::getTickCount() - fit_start) / cv::getTickFrequency();
+
+	// Drop the faces that were lost, and the duplicates of the same face (keeping the more certain one, lower certainty is better)
+	vector<char> lost(faces.size(), 0);
+	for(size_t f = 0; f < faces.size(); ++f)
+	{
+		if(faces[f].model->failures_in_a_row >= max_track_failures)
+		{
+			lost[f] = 1;
+		}
+	}
+
+	for(size_t f = 0; f < faces.size(); ++f)
+	{
+		for(size_t g = f + 1; g < faces.size() && !lost[f]; ++g)
+		{
+			if(!lost[g] && BoxOverlap(faces[f].model->GetBoundingBox(), faces[g].model->GetBoundingBox()) > 0.5)
+			{
+				if(faces[g].model->detection_certainty < faces[f].model->detection_certainty)
+				{
+					lost[f] = 1;
+				}
+				else
+				{
+					lost[g] = 1;
+				}
+			}
+		}
+	}
+
+	for(int f = (int)faces.size() - 1; f >= 0; --f)
+	{
+		if(lost[f])
+		{
+			Retire(f);
+		}
+	}
+
+	return !faces.empty();
+}
+
+bool MultiFaceTracker::Track(const cv::Mat_<uchar>& grayscale_image, FaceModelParameters& params)
+{
+	return Track(grayscale_image, cv::Mat_<float>(), params);
+}
@@ -0,0 +1,456 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../stdafx.h"
+
+#include <MultiStreamEngine.h>
+
+// System includes
+#include <algorithm>
+#include <functional>
+#include <iostream>
+
+using namespace LandmarkDetector;
+
+namespace
+{
+	double Now()
+	{
+		return cv::getTickCount() / cv::getTickFrequency();
+	}
+
+	// Runs a function when leaving the scope, also when it is left by an exception
+	class ScopeExit
+	{
+	public:
+		explicit ScopeExit(const std::function<void()>& on_exit) : on_exit(on_exit) {}
+		~ScopeExit() { on_exit(); }
+
+	private:
+		std::function<void()> on_exit;
+
+		ScopeExit(const ScopeExit&);
+		ScopeExit& operator= (const ScopeExit&);
+	};
+}
+
+MultiStreamEngine::MultiStreamEngine() : next_stream_id(0), tasks_in_flight(0)
+{
+}
+
+MultiStreamEngine::~MultiStreamEngine()
+{
+	{
+		std::lock_guard<std::mutex> lock(streams_mutex);
+		for(map<int, shared_ptr<Stream> >::iterator it = streams.begin(); it != streams.end(); ++it)
+		{
+			it->second->closed = true;
+		}
+	}
+	WaitForIdle();
+}
+
+bool MultiStreamEngine::LoadModel(const FaceModelParameters& params)
+{
+	face_model = CLNF(params.model_location);
+
+	if(face_model.pdm.NumberOfPoints() == 0)
+	{
+		cout << "Couldn't load the model from " << params.model_location << endl;
+		return false;
+	}
+
+	model_params = params;
+
+	// The trackers run in the arena of the engine rather than in arenas of their own
+	model_params.max_concurrency = 0;
+
+	arena.reset(new tbb::task_arena(params.max_concurrency > 0 ? params.max_concurrency : tbb::task_arena::automatic));
+
+	return true;
+}
+
+int MultiStreamEngine::RegisterStream(double latency_target, int max_faces, int queue_capacity)
+{
+	if(!arena)
+	{
+		cout << "No model loaded for the streams" << endl;
+		return -1;
+	}
+
+	shared_ptr<Stream> stream(new Stream());
+	stream->latency_target = latency_target;
+	stream->queue_capacity = max(1, queue_capacity);
+	stream->queued = 0;
+	stream->pushed = 0;
+	stream->dropped = 0;
+	stream->waiting_since = 0;
+	stream->busy = false;
+	stream->closed = false;
+	stream->params = model_params;
+	stream->tracker.SetModel(face_model);
+	stream->tracker.max_faces = max_faces;
+	stream->processed = 0;
+	stream->first_capture_time = -1;
+	stream->last_done_time = 0;
+
+	std::lock_guard<std::mutex> lock(streams_mutex);
+	stream->id = next_stream_id++;
+	streams[stream->id] = stream;
+
+	return stream->id;
+}
+
+void MultiStreamEngine::UnregisterStream(int stream_id)
+{
+	std::unique_lock<std::mutex> lock(streams_mutex);
+
+	map<int, shared_ptr<Stream> >::iterator it = streams.find(stream_id);
+	if(it == streams.end())
+	{
+		return;
+	}
+
+	// A task can not pick the stream up any more once it is closed
+	shared_ptr<Stream> stream = it->second;
+	stream->closed = true;
+	while(stream->busy)
+	{
+		state_changed.wait(lock);
+	}
+
+	// Another call might have removed it in the meantime
+	it = streams.find(stream_id);
+	if(it != streams.end() && it->second == stream)
+	{
+		streams.erase(it);
+	}
+}
+
+shared_ptr<MultiStreamEngine::Stream> MultiStreamEngine::FindStream(int stream_id)
+{
+	std::lock_guard<std::mutex> lock(streams_mutex);
+
+	map<int, shared_ptr<Stream> >::iterator it = streams.find(stream_id);
+	if(it == streams.end() || it->second->closed)
+	{
+		return shared_ptr<Stream>();
+	}
+	return it->second;
+}
+
+bool MultiStreamEngine::PushFrame(int stream_id, const cv::Mat_<uchar>& grayscale_image, double capture_time)
+{
+	shared_ptr<Stream> stream = FindStream(stream_id);
+	if(!stream)
+	{
+		return false;
+	}
+
+	Frame frame;
+	frame.image = grayscale_image.clone();
+	frame.capture_time = capture_time;
+	frame.number = stream->pushed++;
+
+	if(frame.number == 0)
+	{
+		tbb::spin_mutex::scoped_lock lock(stream->stats_mutex);
+		stream->first_capture_time = capture_time;
+	}
+
+	{
+		tbb::spin_mutex::scoped_lock lock(stream->frames_mutex);
+
+		stream->frames.push_back(frame);
+
+		// Keep the queue bounded, the oldest frames go first
+		while((int)stream->frames.size() > stream->queue_capacity)
+		{
+			stream->frames.pop_front();
+			stream->dropped++;
+		}
+
+		stream->waiting_since = stream->frames.front().capture_time;
+		stream->queued = (int)stream->frames.size();
+	}
+
+	Schedule();
+
+	return true;
+}
+
+void MultiStreamEngine::Schedule()
+{
+	{
+		std::lock_guard<std::mutex> lock(streams_mutex);
+		tasks_in_flight++;
+	}
+
+	arena->enqueue([this](){
+		ScopeExit task_done([this](){
+			std::lock_guard<std::mutex> lock(streams_mutex);
+			if(--tasks_in_flight == 0)
+			{
+				state_changed.notify_all();
+			}
+		});
+
+		// An exception must not leave a TBB task (that terminates the process)
+		try
+		{
+			RunNext();
+		}
+		catch(...)
+		{
+		}
+	});
+}
+
+void MultiStreamEngine::RunNext()
+{
+	// Earliest deadline first among the streams that have frames waiting and are not being fitted
+	shared_ptr<Stream> next;
+	{
+		std::lock_guard<std::mutex> lock(streams_mutex);
+
+		double earliest_deadline = 0;
+		for(map<int, shared_ptr<Stream> >::iterator it = streams.begin(); it != streams.end(); ++it)
+		{
+			Stream& stream = *it->second;
+			if(stream.busy || stream.closed || stream.queued == 0)
+			{
+				continue;
+			}
+
+			double deadline = stream.waiting_since + stream.latency_target;
+			if(!next || deadline < earliest_deadline)
+			{
+				next = it->second;
+				earliest_deadline = deadline;
+			}
+		}
+
+		if(!next)
+		{
+			// Every stream with waiting frames is being fitted, they schedule themselves again when done
+			return;
+		}
+		next->busy = true;
+	}
+
+	{
+		ScopeExit release([this, &next](){
+			std::lock_guard<std::mutex> lock(streams_mutex);
+			next->busy = false;
+			state_changed.notify_all();
+		});
+
+		// A frame of which the fit throws (e.g. an OpenCV exception) is counted as dropped
+		try
+		{
+			Process(*next);
+		}
+		catch(...)
+		{
+			next->dropped++;
+		}
+	}
+
+	// The frames that arrived while fitting (whose tasks could not pick the stream up)
+	if(next->queued > 0)
+	{
+		Schedule();
+	}
+}
+
+void MultiStreamEngine::Process(Stream& stream)
+{
+	// Frames that already missed the latency target are skipped as long as there is a newer one
+	Frame frame;
+	bool have_frame = false;
+	{
+		tbb::spin_mutex::scoped_lock lock(stream.frames_mutex);
+
+		while(!stream.frames.empty())
+		{
+			frame = stream.frames.front();
+			stream.frames.pop_front();
+			have_frame = true;
+
+			if(!stream.frames.empty() && Now() - frame.capture_time > stream.latency_target)
+			{
+				stream.dropped++;
+				have_frame = false;
+				continue;
+			}
+			break;
+		}
+
+		// The deadline of the stream now follows the next waiting frame
+		if(!stream.frames.empty())
+		{
+			stream.waiting_since = stream.frames.front().capture_time;
+		}
+		stream.queued = (int)stream.frames.size();
+	}
+
+	if(!have_frame)
+	{
+		return;
+	}
+
+	stream.tracker.Track(frame.image, stream.params);
+
+	StreamResult result;
+	result.stream_id = stream.id;
+	result.frame_number = frame.number;
+	result.capture_time = frame.capture_time;
+
+	for(size_t face = 0; face < stream.tracker.NumFaces(); ++face)
+	{
+		result.face_ids.push_back(stream.tracker.FaceID(face));
+		result.landmarks.push_back(stream.tracker.Face(face).detected_landmarks.clone());
+		result.certainties.push_back(stream.tracker.Face(face).detection_certainty);
+	}
+
+	double done_time = Now();
+	result.latency = done_time - frame.capture_time;
+
+	{
+		tbb::spin_mutex::scoped_lock lock(stream.stats_mutex);
+
+		if((int)stream.latencies.size() < latency_history)
+		{
+			stream.latencies.push_back(result.latency);
+		}
+		else
+		{
+			stream.latencies[stream.processed % latency_history] = result.latency;
+		}
+		stream.processed++;
+		stream.last_done_time = done_time;
+	}
+
+	stream.results.push(result);
+}
+
+bool MultiStreamEngine::PopResult(int stream_id, StreamResult& o_result)
+{
+	shared_ptr<Stream> stream = FindStream(stream_id);
+	if(!stream)
+	{
+		return false;
+	}
+	return stream->results.try_pop(o_result);
+}
+
+bool MultiStreamEngine::GetStats(int stream_id, StreamStats& o_stats)
+{
+	shared_ptr<Stream> stream = FindStream(stream_id);
+	if(!stream)
+	{
+		return false;
+	}
+
+	vector<double> latencies;
+	double first_capture_time, last_done_time;
+	{
+		tbb::spin_mutex::scoped_lock lock(stream->stats_mutex);
+		latencies = stream->latencies;
+		o_stats.frames_processed = stream->processed;
+		first_capture_time = stream->first_capture_time;
+		last_done_time = stream->last_done_time;
+	}
+	o_stats.frames_pushed = stream->pushed;
+	o_stats.frames_dropped = stream->dropped;
+
+	o_stats.throughput = 0;
+	o_stats.mean_latency = 0;
+	o_stats.p99_latency = 0;
+
+	if(latencies.empty())
+	{
+		return true;
+	}
+
+	if(last_done_time > first_capture_time)
+	{
+		o_stats.throughput = o_stats.frames_processed / (last_done_time - first_capture_time);
+	}
+
+	for(size_t i = 0; i < latencies.size(); ++i)
+	{
+		o_stats.mean_latency += latencies[i];
+	}
+	o_stats.mean_latency /= latencies.size();
+
+	size_t p99 = min(latencies.size() - 1, (size_t)(0.99 * latencies.size()));
+	std::nth_element(latencies.begin(), latencies.begin() + p99, latencies.end());
+	o_stats.p99_latency = latencies[p99];
+
+	return true;
+}
+
+void MultiStreamEngine::WaitForIdle()
+{
+	std::unique_lock<std::mutex> lock(streams_mutex);
+	while(tasks_in_flight > 0)
+	{
+		state_changed.wait(lock);
+	}
+}
@@ -62,6 +62,7 @@
 
 // OpenCV include
 #include <opencv2/core/core.hpp>
+#include <opencv2/core/hal/hal.hpp>
 #include <opencv2/imgproc.hpp>
 
 // Math includes
@@ -474,7 +475,7 @@ void PDM::ComputeJacobian(const cv::Mat_<float>& params_local, const cv::Vec6d&
 
 //===========================================================================
 // Updating the parameters (more details in my thesis)
-void PDM::UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>& params_local, cv::Vec6d& params_global)
+void PDM::UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>& params_local, cv::Vec6d& params_global) const
 {
 
 	// The scaling and translation parameters can be just added
@@ -517,161 +518,261 @@ void PDM::UpdateModelParameters(const cv::Mat_<float>& delta_p, cv::Mat_<float>&
 
 }
 
-void PDM::CalcParams(cv::Vec6d& out_params_global, const cv::Mat_<double>& out_params_local, const cv::Mat_<double>& landmark_locations, const cv::Vec3d rotation)
+void PDM::CalcParams(cv::Vec6d& out_params_global, const cv::Mat_<double>& out_params_local, const cv::Mat_<double>& landmark_locations, const cv::Vec3d rotation) const
 {
-		
-	int m = this->NumberOfModes();
-	int n = this->NumberOfPoints();
+	// Buffers of this call only, callers fitting repeatedly keep their own workspace instead
+	CalcParamsWorkspace workspace;
+	CalcParams(out_params_global, out_params_local, landmark_locations, rotation, workspace);
+}
 
-	cv::Mat_<int> visi_ind_2D(n * 2, 1, 1);
-	cv::Mat_<int> visi_ind_3D(3 * n , 1, 1);
+void PDM::CalcParams(cv::Vec6d& out_params_global, const cv::Mat_<double>& out_params_local, const cv::Mat_<double>& landmark_locations, const cv::Vec3d rotation, CalcParamsWorkspace& workspace) const
+{
+
+	int m = this->NumberOfModes();
+	int n_all = this->NumberOfPoints();
 
-	for(int i = 0; i < n; ++i)
+	// The visible landmarks (an invisible one is at 0)
+	workspace.visible.clear();
+	for(int i = 0; i < n_all; ++i)
 	{
-		// If the landmark is invisible indicate this
-		if(landmark_locations.at<double>(i) == 0)
+		if(landmark_locations.at<double>(i) != 0)
 		{
-			visi_ind_2D.at<int>(i) = 0;
-			visi_ind_2D.at<int>(i+n) = 0;
-			visi_ind_3D.at<int>(i) = 0;
-			visi_ind_3D.at<int>(i+n) = 0;
-			visi_ind_3D.at<int>(i+2*n) = 0;
+			workspace.visible.push_back(i);
 		}
 	}
 
-	// As this might be subsampled have special versions
-	cv::Mat_<double> M(0, mean_shape.cols, 0.0);
-	cv::Mat_<double> V(0, princ_comp.cols, 0.0);
+	// The new number of points
+	int n = (int)workspace.visible.size();
 
-	for(int i = 0; i < n * 3; ++i)
+	if(n == 0)
 	{
-		if(visi_ind_3D.at<int>(i) == 1)
-		{
-			cv::vconcat(M, this->mean_shape.row(i), M);
-			cv::vconcat(V, this->princ_comp.row(i), V);
-		}
+		// Nothing to fit to
+		cv::Mat_<double>(m, 1, 0.0).copyTo(out_params_local);
+		return;
 	}
 
-	cv::Mat_<double> m_old = this->mean_shape.clone();
-	cv::Mat_<double> v_old = this->princ_comp.clone();
+	// As this might be subsampled have special versions, gathering the x, y and z rows of the visible points
+	cv::Mat_<double>& M = workspace.mean_shape;
+	cv::Mat_<double>& V = workspace.princ_comp;
+	cv::Mat_<double>& landmark_locs_vis = workspace.landmark_locations;
 
-	this->mean_shape = M;
-	this->princ_comp = V;
-
-	// The new number of points
-	n  = M.rows / 3;
+	M.create(n * 3, 1);
+	V.create(n * 3, m);
+	landmark_locs_vis.create(n * 2, 1);
 
-	// Extract the relevant landmark locations
-	cv::Mat_<double> landmark_locs_vis(n*2, 1, 0.0);
-	int k = 0;
-	for(int i = 0; i < visi_ind_2D.rows; ++i)
+	for(int k = 0; k < n; ++k)
 	{
-		if(visi_ind_2D.at<int>(i) == 1)
+		const int i = workspace.visible[k];
+		for(int d = 0; d < 3; ++d)
 		{
-			landmark_locs_vis.at<double>(k) = landmark_locations.at<double>(i);
-			k++;
-		}		
+			M(k + d * n) = this->mean_shape(i + d * n_all);
+			this->princ_comp.row(i + d * n_all).copyTo(V.row(k + d * n));
+		}
+		landmark_locs_vis(k) = landmark_locations.at<double>(i);
+		landmark_locs_vis(k + n) = landmark_locations.at<double>(i + n_all);
 	}
 
-	// Compute the initial global parameters
+	// Compute the initial global parameters, from the bounding box of the visible landmarks only (the invisible ones are at 0)
 	double min_x;
 	double max_x;
-	cv::minMaxLoc(landmark_locations(cv::Rect(0, 0, 1, this->NumberOfPoints())), &min_x, &max_x);
+	cv::minMaxLoc(landmark_locs_vis(cv::Rect(0, 0, 1, n)), &min_x, &max_x);
 
 	double min_y;
 	double max_y;
-	cv::minMaxLoc(landmark_locations(cv::Rect(0, this->NumberOfPoints(), 1, this->NumberOfPoints())), &min_y, &max_y);
+	cv::minMaxLoc(landmark_locs_vis(cv::Rect(0, n, 1, n)), &min_y, &max_y);
 
 	double width = abs(min_x - max_x);
 	double height = abs(min_y - max_y);
 
-	cv::Rect model_bbox;
-	CalcBoundingBox(model_bbox, cv::Vec6d(1.0, 0.0, 0.0, 0.0, 0.0, 0.0), cv::Mat_<double>(this->NumberOfModes(), 1, 0.0));
+	// The bounding box of the visible part of the mean shape (unit scale, no rotation or translation)
+	double model_min_x, model_max_x, model_min_y, model_max_y;
+	cv::minMaxLoc(M(cv::Rect(0, 0, 1, n)), &model_min_x, &model_max_x);
+	cv::minMaxLoc(M(cv::Rect(0, n, 1, n)), &model_min_y, &model_max_y);
 
-	cv::Rect bbox((int)min_x, (int)min_y, (int)width, (int)height);
+	cv::Rect model_bbox((int)model_min_x, (int)model_min_y, (int)abs(model_min_x - model_max_x), (int)abs(model_min_y - model_max_y));
 
 	double scaling = ((width / model_bbox.width) + (height / model_bbox.height)) / 2;
-        
+
 	cv::Vec3d rotation_init = rotation;
 	cv::Matx33d R = Euler2RotationMatrix(rotation_init);
 	cv::Vec2d translation((min_x + max_x) / 2.0, (min_y + max_y) / 2.0);
-    
-	cv::Mat_<float> loc_params(this->NumberOfModes(),1, 0.0);
+
+	cv::Mat_<float>& loc_params = workspace.params_local;
+	loc_params.create(m, 1);
+	loc_params.setTo(0);
 	cv::Vec6d glob_params(scaling, rotation_init[0], rotation_init[1], rotation_init[2], translation[0], translation[1]);
 
-	// get the 3D shape of the object
-	cv::Mat_<double> loc_params_d;
-	loc_params.convertTo(loc_params_d, CV_64F);
-	cv::Mat_<double> shape_3D = M + V * loc_params_d;
+	cv::Mat_<double>& shape_3D = workspace.shape_3D;
+	shape_3D.create(n * 3, 1);
 
-	cv::Mat_<double> curr_shape(2*n, 1);
-	
-	// for every vertex
-	for(int i = 0; i < n; i++)
+	// The 3D shape of the visible points from the local parameters
+	auto calc_shape_3D = [&]()
 	{
-		// Transform this using the weak-perspective mapping to 2D from 3D
-		curr_shape.at<double>(i  ,0) = scaling * ( R(0,0) * shape_3D.at<double>(i, 0) + R(0,1) * shape_3D.at<double>(i+n  ,0) + R(0,2) * shape_3D.at<double>(i+n*2,0) ) + translation[0];
-		curr_shape.at<double>(i+n,0) = scaling * ( R(1,0) * shape_3D.at<double>(i, 0) + R(1,1) * shape_3D.at<double>(i+n  ,0) + R(1,2) * shape_3D.at<double>(i+n*2,0) ) + translation[1];
-	}
-		    
-    double currError = cv::norm(curr_shape - landmark_locs_vis);
+		for(int r = 0; r < n * 3; ++r)
+		{
+			const double* V_row = V.ptr<double>(r);
+			double value = M(r);
+			for(int j = 0; j < m; ++j)
+			{
+				value += V_row[j] * (double)loc_params(j);
+			}
+			shape_3D(r) = value;
+		}
+	};
 
-	cv::Mat_<float> regularisations = cv::Mat_<double>::zeros(1, 6 + m);
+	// The residuals of a point from the 2D projection of shape_3D (using the weak-perspective mapping)
+	auto calc_residual = [&](int i, double& resid_x, double& resid_y)
+	{
+		const double X = shape_3D(i), Y = shape_3D(i + n), Z = shape_3D(i + n * 2);
+		resid_x = landmark_locs_vis(i) - (scaling * (R(0,0) * X + R(0,1) * Y + R(0,2) * Z) + translation[0]);
+		resid_y = landmark_locs_vis(i + n) - (scaling * (R(1,0) * X + R(1,1) * Y + R(1,2) * Z) + translation[1]);
+	};
 
-	double reg_factor = 1;
+	// The distance of the landmarks from the projection of shape_3D
+	auto calc_error = [&]()
+	{
+		double error = 0;
+		for(int i = 0; i < n; i++)
+		{
+			double resid_x, resid_y;
+			calc_residual(i, resid_x, resid_y);
+			error += resid_x * resid_x + resid_y * resid_y;
+		}
+		return sqrt(error);
+	};
+
+	calc_shape_3D();
+    double currError = calc_error();
 
 	// Setting the regularisation to the inverse of eigenvalues
-	cv::Mat(reg_factor / this->eigen_values).copyTo(regularisations(cv::Rect(6, 0, m, 1)));
-	cv::Mat_<double> regTerm_d = cv::Mat::diag(regularisations.t());
-	regTerm_d.convertTo(regularisations, CV_32F);    
-    
-	cv::Mat_<float> WeightMatrix = cv::Mat_<float>::eye(n*2, n*2);
+	const int num_params = 6 + m;
+	cv::Mat_<float>& regularisations = workspace.regularisation;
+	regularisations.create(num_params, 1);
+	regularisations.setTo(0);
+
+	double reg_factor = 1;
+	for(int j = 0; j < m; ++j)
+	{
+		regularisations(6 + j) = (float)(reg_factor / this->eigen_values.at<double>(j));
+	}
+
+	cv::Mat_<float>& Hessian = workspace.Hessian;
+	cv::Mat_<float>& J_w_t_m = workspace.J_w_t_m;
+	cv::Mat_<float>& J_x = workspace.J_x;
+	cv::Mat_<float>& J_y = workspace.J_y;
+	Hessian.create(num_params, num_params);
+	J_w_t_m.create(num_params, 1);
+	J_x.create(1, num_params);
+	J_y.create(1, num_params);
+
+	float* Jx = J_x.ptr<float>(0);
+	float* Jy = J_y.ptr<float>(0);
 
 	int not_improved_in = 0;
 
     for (size_t i = 0; i < 1000; ++i)
 	{
 		// get the 3D shape of the object
-		cv::Mat_<double> loc_params_d;
-		loc_params.convertTo(loc_params_d, CV_64F);
-		shape_3D = M + V * loc_params_d;
+		calc_shape_3D();
 
-		shape_3D = shape_3D.reshape(1, 3);
+		Hessian.setTo(0);
+		J_w_t_m.setTo(0);
 
-		cv::Matx23d R_2D(R(0,0), R(0,1), R(0,2), R(1,0), R(1,1), R(1,2));
+		float s = (float) scaling;
 
-		cv::Mat_<double> curr_shape_2D = scaling * shape_3D.t() * cv::Mat(R_2D).t();
-        curr_shape_2D.col(0) = curr_shape_2D.col(0) + translation(0);
-		curr_shape_2D.col(1) = curr_shape_2D.col(1) + translation(1);
+		float r11 = (float) R(0,0);
+		float r12 = (float) R(0,1);
+		float r13 = (float) R(0,2);
+		float r21 = (float) R(1,0);
+		float r22 = (float) R(1,1);
+		float r23 = (float) R(1,2);
 
-		curr_shape_2D = cv::Mat(curr_shape_2D.t()).reshape(1, n * 2);
-		
-		cv::Mat_<float> error_resid;
-		cv::Mat(landmark_locs_vis - curr_shape_2D).convertTo(error_resid, CV_32F);
-        
-		cv::Mat_<float> J, J_w_t;
-		this->ComputeJacobian(loc_params, glob_params, J, WeightMatrix, J_w_t);
-        
-		// projection of the meanshifts onto the jacobians (using the weighted Jacobian, see Baltrusaitis 2013)
-		cv::Mat_<float> J_w_t_m = J_w_t * error_resid;
+		// The Hessian approximation and the projection of the residuals onto the Jacobian are accumulated from the two Jacobian
+		// rows of each point (the same rows as ComputeJacobian with uniform weights), instead of forming the Jacobian
+		for(int p = 0; p < n; p++)
+		{
+			float X = (float) shape_3D(p);
+			float Y = (float) shape_3D(p + n);
+			float Z = (float) shape_3D(p + n * 2);
+
+			// scaling term
+			Jx[0] = (X  * r11 + Y * r12 + Z * r13);
+			Jy[0] = (X  * r21 + Y * r22 + Z * r23);
+
+			// rotation terms
+			Jx[1] = (s * (Y * r13 - Z * r12) );
+			Jy[1] = (s * (Y * r23 - Z * r22) );
+			Jx[2] = (-s * (X * r13 - Z * r11));
+			Jy[2] = (-s * (X * r23 - Z * r21));
+			Jx[3] = (s * (X * r12 - Y * r11) );
+			Jy[3] = (s * (X * r22 - Y * r21) );
+
+			// translation terms
+			Jx[4] = 1.0f;
+			Jy[4] = 0.0f;
+			Jx[5] = 0.0f;
+			Jy[5] = 1.0f;
+
+			const double* Vx = V.ptr<double>(p);
+			const double* Vy = V.ptr<double>(p + n);
+			const double* Vz = V.ptr<double>(p + n * 2);
+			for(int j = 0; j < m; j++)
+			{
+				// How much the change of the non-rigid parameters (when object is rotated) affect 2D motion
+				Jx[6 + j] = (float) ( s*(r11*Vx[j] + r12*Vy[j] + r13*Vz[j]) );
+				Jy[6 + j] = (float) ( s*(r21*Vx[j] + r22*Vy[j] + r23*Vz[j]) );
+			}
 
-		// Add the regularisation term
-		J_w_t_m(cv::Rect(0,6,1, m)) = J_w_t_m(cv::Rect(0,6,1, m)) - regularisations(cv::Rect(6,6, m, m)) * loc_params;
+			// The residuals of the point
+			double resid_x_d, resid_y_d;
+			calc_residual(p, resid_x_d, resid_y_d);
+			const float resid_x = (float)resid_x_d;
+			const float resid_y = (float)resid_y_d;
 
-		cv::Mat_<float> Hessian = J_w_t * J;
+			// Only the upper triangle of the Hessian, it is symmetric
+			for(int a = 0; a < num_params; ++a)
+			{
+				float* H_row = Hessian.ptr<float>(a);
+				const float jx = Jx[a];
+				const float jy = Jy[a];
+				for(int b = a; b < num_params; ++b)
+				{
+					H_row[b] += jx * Jx[b] + jy * Jy[b];
+				}
+				J_w_t_m(a) += jx * resid_x + jy * resid_y;
+			}
+		}
 
-		// Add the Tikhonov regularisation
-		Hessian = Hessian + regularisations;
+		for(int a = 0; a < num_params; ++a)
+		{
+			for(int b = 0; b < a; ++b)
+			{
+				Hessian(a, b) = Hessian(b, a);
+			}
 
-		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011)
-		cv::Mat_<float> param_update;
-		cv::solve(Hessian, J_w_t_m, param_update, CV_CHOLESKY);
+			// Add the Tikhonov regularisation, and the regularisation term of the projection
+			Hessian(a, a) += regularisations(a);
+			if(a >= 6)
+			{
+				J_w_t_m(a) -= regularisations(a) * loc_params(a - 6);
+			}
+		}
+
+		// Solve for the parameter update (from Baltrusaitis 2013 based on eq (36) Saragih 2011), in place in J_w_t_m, no update
+		// if the Hessian is not positive definite (as cv::solve)
+		if(!cv::hal::Cholesky32f(Hessian.ptr<float>(0), Hessian.step, num_params, J_w_t_m.ptr<float>(0), J_w_t_m.step, 1))
+		{
+			J_w_t_m.setTo(0);
+		}
+		cv::Mat_<float>& param_update = J_w_t_m;
 
 		// To not overshoot, have the gradient decent rate a bit smaller
-		param_update = 0.5 * param_update;
+		param_update *= 0.5;
+
+		// The rigid parameters are updated as in UpdateModelParameters, the local ones in place
+		UpdateModelParameters(param_update.rowRange(0, 6), loc_params, glob_params);
+		loc_params += param_update.rowRange(6, num_params);
 
-		UpdateModelParameters(param_update, loc_params, glob_params);		
-        
         scaling = glob_params[0];
 		rotation_init[0] = glob_params[1];
 		rotation_init[1] = glob_params[2];
@@ -679,20 +780,12 @@ void PDM::CalcParams(cv::Vec6d& out_params_global, const cv::Mat_<double>& out_p
 
 		translation[0] = glob_params[4];
 		translation[1] = glob_params[5];
-        
-		R = Euler2RotationMatrix(rotation_init);
 
-		R_2D(0,0) = R(0,0);R_2D(0,1) = R(0,1); R_2D(0,2) = R(0,2);
-		R_2D(1,0) = R(1,0);R_2D(1,1) = R(1,1); R_2D(1,2) = R(1,2); 
+		R = Euler2RotationMatrix(rotation_init);
 
-		curr_shape_2D = scaling * shape_3D.t() * cv::Mat(R_2D).t();
-        curr_shape_2D.col(0) = curr_shape_2D.col(0) + translation(0);
-		curr_shape_2D.col(1) = curr_shape_2D.col(1) + translation(1);
+		// The error of the shape before the update of the local parameters, with the updated global ones
+        double error = calc_error();
 
-		curr_shape_2D = cv::Mat(curr_shape_2D.t()).reshape(1, n * 2);
-        
-        double error = cv::norm(curr_shape_2D - landmark_locs_vis);
-        
         if(0.999 * currError < error)
 		{
 			not_improved_in++;
@@ -703,15 +796,11 @@ void PDM::CalcParams(cv::Vec6d& out_params_global, const cv::Mat_<double>& out_p
 		}
 
 		currError = error;
-        
+
 	}
 
 	out_params_global = glob_params;
 	loc_params.convertTo(out_params_local, CV_64F);
-    	
-	this->mean_shape = m_old;
-	this->princ_comp = v_old;
-
 
 }
 
@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016, Carnegie Mellon University and University of Cambridge,
+// all rights reserved.
+//
+// THIS SOFTWARE IS PROVIDED AS IS FOR ACADEMIC USE ONLY AND ANY EXPRESS
+// OR IMPLIED WARRANTIES WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY.
+// OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+// HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Notwithstanding the license granted herein, Licensee acknowledges that certain components
+// of the Software may be covered by so-called open source software licenses (Open Source
+// Components), which means any software licenses approved as open source licenses by the
+// Open Source Initiative or any substantially similar licenses, including without limitation any
+// license that, as a condition of distribution of the software licensed under such license,
+// requires that the distributor make the software available in source code format. Licensor shall
+// provide a list of Open Source Components for a particular version of the Software upon
+// Licensees request. Licensee will comply with the applicable terms of such licenses and to
+// the extent required by the licenses covering Open Source Components, the terms of such
+// licenses will apply in lieu of the terms of this Agreement. To the extent the terms of the
+// licenses applicable to Open Source Components prohibit any of the restrictions in this
+// License Agreement with respect to such Open Source Component, such restrictions will not
+// apply to such Open Source Component. To the extent the terms of the licenses applicable to
+// Open Source Components require Licensor to make an offer to provide source code or
+// related information in connection with the Software, such offer is hereby made. Any request
+// for source code or related information should be directed to cl-face-tracker-distribution@lists.cam.ac.uk
+// Licensee acknowledges receipt of notices for the Open Source Components for the initial
+// delivery of the Software.
+
+//     * Any publications arising from the use of this software, including but
+//       not limited to academic journal and conference publications, technical
+//       reports and manuals, must cite at least one of the following works:
+//
+//       OpenFace: an open source facial behavior analysis toolkit
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency
+//       in IEEE Winter Conference on Applications of Computer Vision, 2016  
+//
+//       Rendering of Eyes for Eye-Shape Registration and Gaze Estimation
+//       Erroll Wood, Tadas Baltruaitis, Xucong Zhang, Yusuke Sugano, Peter Robinson, and Andreas Bulling 
+//       in IEEE International. Conference on Computer Vision (ICCV),  2015 
+//
+//       Cross-dataset learning and person-speci?c normalisation for automatic Action Unit detection
+//       Tadas Baltruaitis, Marwa Mahmoud, and Peter Robinson 
+//       in Facial Expression Recognition and Analysis Challenge, 
+//       IEEE International Conference on Automatic Face and Gesture Recognition, 2015 
+//
+//       Constrained Local Neural Fields for robust facial landmark detection in the wild.
+//       Tadas Baltruaitis, Peter Robinson, and Louis-Philippe Morency. 
+//       in IEEE Int. Conference on Computer Vision Workshops, 300 Faces in-the-Wild Challenge, 2013.    
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Observers local to an arena are a preview feature in older TBB releases
+#define TBB_PREVIEW_LOCAL_OBSERVER 1
+
+#include "../stdafx.h"
+
+#include <TrackerArena.h>
+
+// TBB includes
+#include <tbb/task_scheduler_observer.h>
+
+// System includes
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace LandmarkDetector
+{
+
+// Pins every worker that joins the arena to the core of its arena slot, and gives it back its previous affinity when it leaves (the
+// workers are shared with the global arena and the other trackers). Slot 0 is the one of the thread calling Execute, which is not
+// pinned.
+class ArenaPinningObserver : public tbb::task_scheduler_observer
+{
+public:
+
+	ArenaPinningObserver(tbb::task_arena& arena, int first_core, int num_cores) : tbb::task_scheduler_observer(arena), first_core(first_core), num_cores(num_cores),
+		previous_affinity(num_cores), pinned(num_cores, 0)
+	{
+		observe(true);
+	}
+
+	~ArenaPinningObserver()
+	{
+		observe(false);
+	}
+
+	void on_scheduler_entry(bool)
+	{
+		int slot = tbb::this_task_arena::current_thread_index();
+		if(slot <= 0 || slot >= num_cores)
+		{
+			return;
+		}
+
+		int core = first_core + slot;
+
+#ifdef _WIN32
+		// The affinity mask has a bit per core, the cores past it can not be pinned to
+		if(core >= (int)(sizeof(DWORD_PTR) * 8))
+		{
+			return;
+		}
+		DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+		if(previous != 0)
+		{
+			previous_affinity[slot] = previous;
+			pinned[slot] = 1;
+		}
+#else
+		if(core >= CPU_SETSIZE || pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &previous_affinity[slot]) != 0)
+		{
+			return;
+		}
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET(core, &cpu_set);
+		pinned[slot] = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#endif
+	}
+
+	void on_scheduler_exit(bool)
+	{
+		int slot = tbb::this_task_arena::current_thread_index();
+		if(slot <= 0 || slot >= num_cores || !pinned[slot])
+		{
+			return;
+		}
+
+#ifdef _WIN32
+		SetThreadAffinityMask(GetCurrentThread(), previous_affinity[slot]);
+#else
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &previous_affinity[slot]);
+#endif
+		pinned[slot] = 0;
+	}
+
+private:
+
+	int first_core;
+	int num_cores;
+
+	// The affinity each slot had before it was pinned, only the thread in the slot touches its entries
+#ifdef _WIN32
+	vector<DWORD_PTR> previous_affinity;
+#else
+	vector<cpu_set_t> previous_affinity;
+#endif
+	vector<char> pinned;
+};
+
+}
+
+using namespace LandmarkDetector;
+
+TrackerArena::TrackerArena() : max_concurrency(0), first_core(-1)
+{
+}
+
+TrackerArena::~TrackerArena()
+{
+	// The observer has to go before the arena it observes
+	observer.reset();
+	arena.reset();
+}
+
+void TrackerArena::Configure(int max_concurrency, int first_core)
+{
+	if(max_concurrency == this->max_concurrency && first_core == this->first_core)
+	{
+		return;
+	}
+
+	observer.reset();
+	arena.reset();
+
+	this->max_concurrency = max_concurrency > 0 ? max_concurrency : 0;
+	this->first_core = this->max_concurrency > 0 ? first_core : -1;
+
+	if(this->max_concurrency > 0)
+	{
+		arena.reset(new tbb::task_arena(this->max_concurrency));
+		arena->initialize();
+
+		if(this->first_core >= 0)
+		{
+			observer.reset(new ArenaPinningObserver(*arena, this->first_core, this->max_concurrency));
+		}
+	}
+}